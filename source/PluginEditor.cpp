@@ -238,23 +238,8 @@ PolyphonicTrackerAudioProcessorEditor::PolyphonicTrackerAudioProcessorEditor(Pol
     m_debugTextEditor.setColour(juce::TextEditor::textColourId, juce::Colours::white);
     mainPanel->addAndMakeVisible(m_debugTextEditor);
 
-    // Set up FFT data callback with thread safety - use a weak reference to prevent crashes
-    std::weak_ptr<SpectrogramComponent> weakSpectrogram = std::shared_ptr<SpectrogramComponent>(spectrogramComponent.get(), 
-        [](SpectrogramComponent*){});  // Non-owning shared_ptr
-        
-    audioProcessor.setFFTDataCallback([weakSpectrogram](const float* data, int size) {
-        if (data == nullptr || size <= 0) return;
-        
-        // Make a safe copy of data before accessing any objects
-        std::vector<float> dataCopy(data, data + size);
-        
-        // Post to the message thread for safety - NEVER lock across threads
-        juce::MessageManager::callAsync([weakSpectrogram, dataCopy, size]() {
-            if (auto spectrogram = weakSpectrogram.lock()) {
-                spectrogram->updateFFT(dataCopy.data(), size);
-            }
-        });
-    });
+    // The spectrogram pulls spectra from the processor's lock-free FIFO on its own timer
+    spectrogramComponent->setSpectrumSource(&audioProcessor.getSpectrumFifo());
 
     // Set up button callbacks
     learnFretButton.onClick = [this]() {
@@ -473,6 +458,11 @@ void PolyphonicTrackerAudioProcessorEditor::timerCallback()
         }
         m_debugTextEditor.setText(lastLines);
     }
+    else
+    {
+        // Without a log file the panel shows where the processing time goes
+        m_debugTextEditor.setText(audioProcessor.getPerformanceReport(), false);
+    }
     
     // Periodically update debug info and force components to be visible
     if (counter % 10 == 0) {
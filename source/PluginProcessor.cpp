@@ -5,11 +5,6 @@
 // Forward declaration of the editor class - include happens later
 class PolyphonicTrackerAudioProcessorEditor;
 
-//for debugging
-#include <fstream>
-static std::ofstream debugLog("/tmp/polyphonic_tracker_debug.log"); // macOS path
-// Use the JUCE DBG macro instead of redefining it
-#define CUSTOM_LOG(message) debugLog << message << std::endl
 //==============================================================================
 PolyphonicTrackerAudioProcessor::PolyphonicTrackerAudioProcessor()
     : AudioProcessor (BusesProperties()
@@ -18,6 +13,7 @@ PolyphonicTrackerAudioProcessor::PolyphonicTrackerAudioProcessor()
       parameters (*this, nullptr, "PARAMETERS", createParameterLayout()),
       currentFFTSize(4096),
       currentOverlapFactor(0.75f),
+      maxFramesPerBlock(0),
       numFrets(24),
       currentGuitarString(0),
       currentGuitarFret(0),
@@ -25,12 +21,18 @@ PolyphonicTrackerAudioProcessor::PolyphonicTrackerAudioProcessor()
 {
     // Initialize DSP components
     fftProcessor = std::make_unique<FFTProcessor>(currentFFTSize);
+    fftProcessor->setOverlapFactor(currentOverlapFactor);
+    fftProcessor->setMaxFramesPerBlock(maxFramesPerBlock);
+    fftProcessor->setStageTimings(&stageTimings);
     pitchDetector = std::make_unique<PitchDetector>(6); // Default to 6 notes of polyphony
+    pitchDetector->setStageTimings(&stageTimings);
     midiManager = std::make_unique<MIDIManager>();
+    silentSpectrum.assign(static_cast<size_t>(spectrumFifo.getMaxSpectrumSize()), 0.0f);
+    applyInputGateSettings();
     
     // Set up FFT processor callback
-    fftProcessor->setSpectrumDataCallback([this](const float* spectrum, int size) {
-        handleNewFFTBlock(spectrum, size);
+    fftProcessor->setSpectrumDataCallback([this](const float* spectrum, int size, int sampleOffset) {
+        handleNewFFTBlock(spectrum, size, sampleOffset);
     });
     
     // Initialize parameters
@@ -49,6 +51,10 @@ PolyphonicTrackerAudioProcessor::PolyphonicTrackerAudioProcessor()
 PolyphonicTrackerAudioProcessor::~PolyphonicTrackerAudioProcessor()
 {
     stopTimer();
+    
+    // The workers call into the DSP components, so they have to go first
+    analysisWorker.reset();
+    hexaphonicAnalyser.reset();
 }
 
 //==============================================================================
@@ -105,9 +111,14 @@ void PolyphonicTrackerAudioProcessor::changeProgramName (int index, const juce::
 }
 
 //==============================================================================
-void PolyphonicTrackerAudioProcessor::prepareToPlay(double sampleRate, int /*samplesPerBlock*/)
+void PolyphonicTrackerAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    // Preallocate everything the audio thread needs so processBlock never allocates
+    monoBuffer.setSize(1, samplesPerBlock);
+    loadMeasurer.reset(sampleRate, samplesPerBlock);
+    
     fftProcessor->reset();
+    pitchDetector->prepare(sampleRate, currentFFTSize);
     pitchDetector->setMaxPolyphony(static_cast<int>(*maxPolyphonyParam));
     pitchDetector->setLearningModeActive(*learningModeParam > 0.5f);
     pitchDetector->setCurrentLearningNote(static_cast<int>(*currentNoteParam));
@@ -117,26 +128,120 @@ void PolyphonicTrackerAudioProcessor::prepareToPlay(double sampleRate, int /*sam
     midiManager->setNoteOnDelayMs(static_cast<int>(*noteOnDelayParam));
     midiManager->setNoteOffDelayMs(static_cast<int>(*noteOffDelayParam));
     midiManager->updateSampleRate(sampleRate); // Add this line
+    
+    prepareAnalysisScheduling(sampleRate, samplesPerBlock);
+}
+
+void PolyphonicTrackerAudioProcessor::prepareAnalysisScheduling(double sampleRate, int samplesPerBlock)
+{
+    // (Re)build the background worker. The ring holds two seconds of input, or four
+    // windows for very large FFTs, before the worker is considered to have stalled.
+    analysisWorker.reset();
+    samplePosition = 0;
+    hasDeferredFrame = false;
+    
+    analysisDelaySamples = backgroundAnalysisHeadroom > 0 ? backgroundAnalysisHeadroom
+                                                          : fftProcessor->getHopSize() + 2 * samplesPerBlock;
+    
+    prepareHexaphonicAnalyser(sampleRate, samplesPerBlock);
+    
+    // In hexaphonic mode the strings have their own workers; the mono path then only
+    // runs (directly) while learning
+    backgroundAnalysisActive = backgroundAnalysisEnabled && hexaphonicAnalyser == nullptr;
+    
+    if (backgroundAnalysisActive)
+    {
+        const int ringCapacity = juce::jmax(static_cast<int>(sampleRate * 2.0), currentFFTSize * 4);
+        
+        analysisWorker = std::make_unique<AnalysisWorker>(ringCapacity, juce::jmax(samplesPerBlock, 1024));
+        analysisWorker->setAnalysisCallback([this](const float* samples, int numSamples, juce::int64 firstSample, bool followsGap) {
+            // A frame must not straddle input the worker never saw
+            if (followsGap)
+                fftProcessor->reset();
+            
+            analysisChunkStart = firstSample;
+            fftProcessor->processBlock(samples, numSamples);
+        });
+        
+        analysisWorker->start();
+    }
+    else
+    {
+        analysisDelaySamples = 0;
+    }
+    
+    updateLatency();
+}
+
+void PolyphonicTrackerAudioProcessor::prepareHexaphonicAnalyser(double sampleRate, int samplesPerBlock)
+{
+    const int numInputChannels = getTotalNumInputChannels();
+    
+    if (!hexaphonicModeEnabled || numInputChannels < 2)
+    {
+        hexaphonicAnalyser.reset();
+        return;
+    }
+    
+    if (hexaphonicAnalyser == nullptr)
+    {
+        hexaphonicAnalyser = std::make_unique<HexaphonicAnalyser>();
+        hexaphonicAnalyser->setStageTimings(&stageTimings);
+        
+        // Every string shares the main FFT size and overlap, so merged frames are one hop apart
+        hexaphonicAnalyser->setFrameCallback([this](const NoteEvent* events, int numEvents, int sampleOffset) {
+            if (currentMidiOutput != nullptr)
+            {
+                StageTimings::Stopwatch stopwatch(&stageTimings);
+                midiManager->processNotes(events, numEvents, *currentMidiOutput, sampleOffset,
+                                          fftProcessor->getHopSize());
+                stopwatch.lap(StageTimings::Stage::midiGeneration);
+            }
+        });
+        
+        hexaphonicAnalyser->setSpectrumCallback([this](const float* spectrum, int size) {
+            spectrumFifo.push(spectrum, size);
+        });
+    }
+    
+    const int schedulingDelay = backgroundAnalysisHeadroom > 0 ? backgroundAnalysisHeadroom
+                                                               : fftProcessor->getHopSize() + 2 * samplesPerBlock;
+    
+    hexaphonicAnalyser->setInputGate(inputGateEnabled, gateOpenThresholdDb, gateCloseThresholdDb);
+    hexaphonicAnalyser->prepare(*pitchDetector, pitchDetector->getGuitarSettings(), numInputChannels,
+                                sampleRate, currentFFTSize, currentOverlapFactor,
+                                backgroundAnalysisEnabled, schedulingDelay);
+    
+    // The strings idle while learning; see applyLearningMode
+    if (pitchDetector->isLearningModeActive())
+        hexaphonicAnalyser->stopWorkers();
 }
 
 void PolyphonicTrackerAudioProcessor::releaseResources()
 {
-    // Release any resources when playback stops
+    // Stop the background workers; they are rebuilt in prepareToPlay
+    if (analysisWorker != nullptr)
+        analysisWorker->stop();
+    
+    if (hexaphonicAnalyser != nullptr)
+        hexaphonicAnalyser->release();
 }
 
 bool PolyphonicTrackerAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
 {
-    // We only support mono or stereo inputs
+    // We only support mono or stereo outputs
     if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
      && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
         return false;
     
-    // We require at least one input channel
-    if (layouts.getMainInputChannelSet().size() < 1)
+    // We require at least one input channel, and one per string at most
+    const int numInputChannels = layouts.getMainInputChannelSet().size();
+    
+    if (numInputChannels < 1 || numInputChannels > HexaphonicAnalyser::maxStrings)
         return false;
     
-    // Input and output layouts should match
-    if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
+    // Mono and stereo inputs should match the output; wider inputs are per-string pickups
+    if (numInputChannels <= 2 && layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
         return false;
     
     return true;
@@ -144,95 +249,132 @@ bool PolyphonicTrackerAudioProcessor::isBusesLayoutSupported (const BusesLayout&
 // In PluginProcessor.cpp
 void PolyphonicTrackerAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
+    // Counts allocations, locks and blocking calls made by this callback (checked builds only)
+    RealtimeSafety::ScopedAudioCallback realtimeSafetyScope(lastCallbackSafetyReport, realtimeSafetyTotals);
+    
+    // Share of the block's real-time budget this callback uses
+    juce::AudioProcessLoadMeasurer::ScopedTimer loadTimer(loadMeasurer, buffer.getNumSamples());
+    
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
-
+    
     // Clear output channels that don't contain input data
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear(i, 0, buffer.getNumSamples());
-
+    
     // Clear the incoming MIDI buffer as we'll be generating our own MIDI
     midiMessages.clear();
-
+    
     // Get total samples
     auto numSamples = buffer.getNumSamples();
     
-    // Reduce processing load by only processing every Nth block
-    static int blockCounter = 0;
-    blockCounter = (blockCounter + 1) % 8; // Increased to every 8th block
-    
-    if (blockCounter == 0 && fftProcessor != nullptr)
+    if (fftProcessor != nullptr)
     {
-        // Thread safety check - use atomic flag to avoid callback crashes
-        static std::atomic<bool> processingFFT{false};
-        
-        if (!processingFFT.exchange(true))
+        try
         {
-            try
+            // Mix down to mono into the buffer preallocated in prepareToPlay; it only
+            // grows if the host delivers more samples than it announced
+            StageTimings::Stopwatch stopwatch(&stageTimings);
+            
+            if (numSamples > monoBuffer.getNumSamples())
+                monoBuffer.setSize(1, numSamples, false, false, true);
+            
+            if (totalNumInputChannels == 1)
             {
-                // Mix down to mono more efficiently
-                juce::AudioBuffer<float> monoBuffer(1, numSamples);
-                monoBuffer.clear();
-                
-                if (totalNumInputChannels == 1)
-                {
-                    monoBuffer.copyFrom(0, 0, buffer, 0, 0, numSamples);
-                }
-                else
-                {
-                    // Mix down to mono using only first two channels
-                    float scaleFactor = 1.0f / std::min(2, totalNumInputChannels);
-                    for (int ch = 0; ch < std::min(2, totalNumInputChannels); ++ch)
-                    {
-                        monoBuffer.addFrom(0, 0, buffer, ch, 0, numSamples, scaleFactor);
-                    }
-                }
-                
-                // Process the mono buffer through FFT with safety checks
-                bool fftPerformed = fftProcessor->processBlock(monoBuffer.getReadPointer(0), numSamples);
-                
-                // If FFT was performed, generate MIDI
-                if (fftPerformed && pitchDetector != nullptr && midiManager != nullptr)
-                {
-                    auto spectrum = fftProcessor->getMagnitudeSpectrum();
-                    auto spectrumSize = fftProcessor->getSpectrumSize();
-                    
-                    if (spectrum != nullptr && spectrumSize > 0)
-                    {
-                        // Only process pitch detection if we have meaningful data
-                        bool hasSignal = false;
-                        for (int i = 0; i < std::min(spectrumSize, 10); i++) {
-                            if (spectrum[i] > 0.001f) {
-                                hasSignal = true;
-                                break;
-                            }
-                        }
-                        
-                        if (hasSignal)
-                        {
-                            auto detectedNotes = pitchDetector->processSpectrum(spectrum, spectrumSize);
-                            if (!detectedNotes.empty())
-                            {
-                                midiManager->processNotes(detectedNotes, midiMessages, 0);
-                            }
-                        }
-                    }
-                }
+                monoBuffer.copyFrom(0, 0, buffer, 0, 0, numSamples);
             }
-            catch (const std::exception& e)
+            else
             {
-                // Log error but don't crash
-                juce::Logger::writeToLog("Error in processBlock: " + juce::String(e.what()));
+                // Mix down to mono using only first two channels
+                float scaleFactor = 1.0f / std::min(2, totalNumInputChannels);
+                monoBuffer.copyFrom(0, 0, buffer.getReadPointer(0), numSamples, scaleFactor);
+                monoBuffer.addFrom(0, 0, buffer, 1, 0, numSamples, scaleFactor);
             }
             
-            processingFFT = false;
+            stopwatch.lap(StageTimings::Stage::mixdown);
+            
+            sendDeferredFrame(midiMessages);
+            
+            if (hexaphonicAnalyser != nullptr && !pitchDetector->isLearningModeActive())
+            {
+                // One analyser per string; merged notes come back through the frame callback
+                currentMidiOutput = &midiMessages;
+                hexaphonicAnalyser->processBlock(buffer, numSamples);
+                currentMidiOutput = nullptr;
+            }
+            else if (backgroundAnalysisActive && analysisWorker != nullptr)
+            {
+                // Hand the samples to the worker and play back whatever results are due
+                analysisWorker->pushSamples(monoBuffer.getReadPointer(0), numSamples);
+                scheduleAnalysisResults(midiMessages, numSamples);
+            }
+            else
+            {
+                // Every sample goes to the analyser; it runs one FFT per completed hop,
+                // within the per-block frame budget. Each frame goes through
+                // handleNewFFTBlock, which writes its MIDI straight into this block's buffer.
+                currentMidiOutput = &midiMessages;
+                currentBlockSize = numSamples;
+                fftProcessor->processBlock(monoBuffer.getReadPointer(0), numSamples);
+                currentMidiOutput = nullptr;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            // Log error but don't crash
+            currentMidiOutput = nullptr;
+            RealtimeSafety::noteBlockingCall("Logger::writeToLog");
+            juce::Logger::writeToLog("Error in processBlock: " + juce::String(e.what()));
         }
     }
     
+    samplePosition += numSamples;
+    
     // Always pass audio through unchanged
 }
 
+void PolyphonicTrackerAudioProcessor::scheduleAnalysisResults(juce::MidiBuffer& midiMessages, int numSamples)
+{
+    const juce::int64 blockEnd = samplePosition + numSamples;
+    
+    // Each frame's MIDI is due a fixed delay after the frame ended. Results arrive in
+    // order, so stop at the first one that belongs to a later block.
+    while (const auto* result = analysisWorker->peekResult())
+    {
+        const juce::int64 due = result->frameEndSample + analysisDelaySamples;
+        
+        if (due >= blockEnd)
+            break;
+        
+        // The worker missed its deadline; send it now rather than dropping it
+        if (due < samplePosition)
+            lateAnalysisResults.fetch_add(1, std::memory_order_relaxed);
+        
+        StageTimings::Stopwatch stopwatch(&stageTimings);
+        midiManager->processNotes(result->notes.data(), result->numNotes, midiMessages,
+                                  static_cast<int>(juce::jmax(juce::int64(0), due - samplePosition)),
+                                  fftProcessor->getHopSize());
+        stopwatch.lap(StageTimings::Stage::midiGeneration);
+        
+        analysisWorker->popResult();
+    }
+}
+
+void PolyphonicTrackerAudioProcessor::sendDeferredFrame(juce::MidiBuffer& midiMessages)
+{
+    if (!hasDeferredFrame)
+        return;
+    
+    // The frame ended exactly where this block starts, so it is on time at offset 0
+    StageTimings::Stopwatch stopwatch(&stageTimings);
+    midiManager->processNotes(deferredFrame.notes.data(), deferredFrame.numNotes, midiMessages, 0,
+                              fftProcessor->getHopSize());
+    stopwatch.lap(StageTimings::Stage::midiGeneration);
+    
+    hasDeferredFrame = false;
+}
+
 //==============================================================================
 bool PolyphonicTrackerAudioProcessor::hasEditor() const
 {
@@ -266,29 +408,58 @@ void PolyphonicTrackerAudioProcessor::setStateInformation (const void* data, int
 }
 
 //==============================================================================
-void PolyphonicTrackerAudioProcessor::handleNewFFTBlock(const float* fftData, int fftSize)
+void PolyphonicTrackerAudioProcessor::handleNewFFTBlock(const float* fftData, int fftSize, int sampleOffset)
 {
-    if (fftData == nullptr || fftSize <= 0)
+    if (fftSize <= 0)
         return;  // Safety check
-        
-    // Process the FFT data through the pitch detector
-    auto detectedNotes = pitchDetector->processSpectrum(fftData, fftSize);
     
-    // Create a temporary MIDI buffer for the notes
-    juce::MidiBuffer tempBuffer;
+    // Frames skipped by the input gate carry no spectrum. They still advance the note
+    // state below, so notes that were sounding are released while the input is silent.
+    const bool hasSignal = fftData != nullptr;
+    
+    // Run detection exactly once per frame, writing the note events straight into the
+    // frame's result. The frame end is on the timeline of whichever thread runs the FFT.
+    const bool isDirect = currentMidiOutput != nullptr;
+    AnalysisWorker::FrameResult result;
+    result.frameEndSample = (isDirect ? samplePosition : analysisChunkStart) + sampleOffset;
     
-    // Process the detected notes and generate MIDI
-    midiManager->processNotes(detectedNotes, tempBuffer, 0);
+    if (hasSignal)
+        result.numNotes = pitchDetector->processSpectrum(fftData, fftSize, result.notes.data(),
+                                                         AnalysisWorker::maxNotesPerResult, result.frameEndSample);
     
-    // Call the FFT data callback if registered, with additional safety
-    if (fftDataCallback && fftData != nullptr && fftSize > 0)
+    // Advance the note state once per frame, even for silent frames so pending note-offs progress.
+    // Events are stamped at the sample where the frame's hop ended, and the debounce
+    // timers advance by the hop, the time that passed since the previous frame.
+    if (isDirect && sampleOffset >= currentBlockSize)
     {
-        try {
-            fftDataCallback(fftData, fftSize);
-        }
-        catch (const std::exception& e) {
-            CUSTOM_LOG("Exception in FFT callback: " << e.what());
-        }
+        // The hop ended on the block's last sample; its events belong at the start of the next block
+        deferredFrame = result;
+        hasDeferredFrame = true;
+    }
+    else if (isDirect)
+    {
+        StageTimings::Stopwatch stopwatch(&stageTimings);
+        midiManager->processNotes(result.notes.data(), result.numNotes, *currentMidiOutput, sampleOffset,
+                                  fftProcessor->getHopSize());
+        stopwatch.lap(StageTimings::Stage::midiGeneration);
+    }
+    else if (analysisWorker != nullptr)
+    {
+        // Background mode: the timestamped frame goes to the audio thread for scheduling
+        analysisWorker->pushResult(result);
+    }
+    
+    // Publish the spectrum for the display; a frame the GUI hasn't taken yet is replaced.
+    // A gated stretch is shown as a single empty frame.
+    if (hasSignal)
+    {
+        spectrumFifo.push(fftData, fftSize);
+        displayCleared = false;
+    }
+    else if (!displayCleared)
+    {
+        spectrumFifo.push(silentSpectrum.data(), fftSize);
+        displayCleared = true;
     }
 }
 
@@ -301,7 +472,7 @@ void PolyphonicTrackerAudioProcessor::timerCallback()
         int currentNote = static_cast<int>(*currentNoteParam);
         int maxPolyphony = static_cast<int>(*maxPolyphonyParam);
         
-        pitchDetector->setLearningModeActive(learningMode);
+        applyLearningMode(learningMode);
         pitchDetector->setCurrentLearningNote(currentNote);
         pitchDetector->setMaxPolyphony(maxPolyphony);
     }
@@ -320,14 +491,11 @@ void PolyphonicTrackerAudioProcessor::timerCallback()
     }
 }
 
-void PolyphonicTrackerAudioProcessor::setFFTDataCallback(std::function<void(const float*, int)> callback)
-{
-    fftDataCallback = callback;
-}
-
-const float* PolyphonicTrackerAudioProcessor::getLatestFFTData() const
+juce::String PolyphonicTrackerAudioProcessor::getPerformanceReport() const
 {
-    return fftProcessor ? fftProcessor->getMagnitudeSpectrum() : nullptr;
+    juce::String report;
+    report << "CPU load: " << juce::String(100.0 * getCpuLoad(), 1) << "% (" << getNumXRuns() << " overruns)\n";
+    return report + stageTimings.toString();
 }
 
 int PolyphonicTrackerAudioProcessor::getLatestFFTSize() const
@@ -391,7 +559,7 @@ juce::AudioProcessorValueTreeState::ParameterLayout PolyphonicTrackerAudioProces
     
     layout.add(std::make_unique<juce::AudioParameterInt>(
         "guitarFret", "Guitar Fret", 0, 24, 0));
-
+    
     // MIDI output parameters
     layout.add(std::make_unique<juce::AudioParameterInt>(
         "midiChannel", "MIDI Channel", 1, 16, 1));
@@ -413,12 +581,56 @@ juce::AudioProcessorValueTreeState::ParameterLayout PolyphonicTrackerAudioProces
 //==============================================================================
 void PolyphonicTrackerAudioProcessor::setLearningModeActive(bool shouldBeActive)
 {
-    if (pitchDetector != nullptr)
-        pitchDetector->setLearningModeActive(shouldBeActive);
+    applyLearningMode(shouldBeActive);
     
     *parameters.getRawParameterValue("learningMode") = shouldBeActive ? 1.0f : 0.0f;
 }
 
+void PolyphonicTrackerAudioProcessor::applyLearningMode(bool shouldBeActive)
+{
+    if (pitchDetector == nullptr || pitchDetector->isLearningModeActive() == shouldBeActive)
+        return;
+    
+    // Turning learning on sets aside room for the new templates, which may move the
+    // ones being matched, so the audio callback and the worker are held off
+    suspendProcessing(true);
+    const bool workerWasRunning = analysisWorker != nullptr && analysisWorker->isRunning();
+    
+    if (workerWasRunning)
+        analysisWorker->stop();
+    
+    pitchDetector->setLearningModeActive(shouldBeActive);
+    
+    // In hexaphonic mode learning goes through the main detector while the strings idle.
+    // Their workers are stopped meanwhile, so the display spectrum only ever comes from
+    // one thread: the main path while learning, the lowest string otherwise. Leaving
+    // learning mode hands the new templates to the strings and restarts them.
+    if (hexaphonicAnalyser != nullptr)
+    {
+        if (shouldBeActive)
+            hexaphonicAnalyser->stopWorkers();
+        else
+            hexaphonicAnalyser->updateProfiles(*pitchDetector);
+    }
+    
+    if (workerWasRunning)
+        analysisWorker->start();
+    
+    suspendProcessing(false);
+}
+
+void PolyphonicTrackerAudioProcessor::updateStringDetectors()
+{
+    // While learning the strings aren't analysed; leaving learning mode updates them
+    if (hexaphonicAnalyser == nullptr || pitchDetector->isLearningModeActive())
+        return;
+    
+    // The string workers read their detectors, so they are replaced with processing held off
+    suspendProcessing(true);
+    hexaphonicAnalyser->updateProfiles(*pitchDetector);
+    suspendProcessing(false);
+}
+
 bool PolyphonicTrackerAudioProcessor::isLearningModeActive() const
 {
     return pitchDetector != nullptr && pitchDetector->isLearningModeActive();
@@ -450,6 +662,129 @@ int PolyphonicTrackerAudioProcessor::getMaxPolyphony() const
     return pitchDetector != nullptr ? pitchDetector->getMaxPolyphony() : 6;
 }
 
+void PolyphonicTrackerAudioProcessor::setDetectionEngine(PitchDetector::DetectionEngine engine)
+{
+    if (pitchDetector != nullptr)
+    {
+        pitchDetector->setDetectionEngine(engine);
+        updateStringDetectors();
+    }
+}
+
+PitchDetector::DetectionEngine PolyphonicTrackerAudioProcessor::getDetectionEngine() const
+{
+    return pitchDetector != nullptr ? pitchDetector->getDetectionEngine()
+                                    : PitchDetector::DetectionEngine::CosineSimilarity;
+}
+
+void PolyphonicTrackerAudioProcessor::setSolverIterationLimit(int maxIterations)
+{
+    if (pitchDetector != nullptr)
+    {
+        pitchDetector->setSolverIterationLimit(maxIterations);
+        updateStringDetectors();
+    }
+}
+
+void PolyphonicTrackerAudioProcessor::setSolverTolerance(float tolerance)
+{
+    if (pitchDetector != nullptr)
+    {
+        pitchDetector->setSolverTolerance(tolerance);
+        updateStringDetectors();
+    }
+}
+
+void PolyphonicTrackerAudioProcessor::setSparsityPenalty(float penalty)
+{
+    if (pitchDetector != nullptr)
+    {
+        pitchDetector->setSparsityPenalty(penalty);
+        updateStringDetectors();
+    }
+}
+
+void PolyphonicTrackerAudioProcessor::setOnsetGatingEnabled(bool shouldBeEnabled)
+{
+    if (pitchDetector != nullptr)
+    {
+        pitchDetector->setOnsetGatingEnabled(shouldBeEnabled);
+        updateStringDetectors();
+    }
+}
+
+bool PolyphonicTrackerAudioProcessor::isOnsetGatingEnabled() const
+{
+    return pitchDetector != nullptr && pitchDetector->isOnsetGatingEnabled();
+}
+
+void PolyphonicTrackerAudioProcessor::setOnsetThreshold(float threshold)
+{
+    if (pitchDetector != nullptr)
+    {
+        pitchDetector->setOnsetThreshold(threshold);
+        updateStringDetectors();
+    }
+}
+
+void PolyphonicTrackerAudioProcessor::setCandidatePruningEnabled(bool shouldBeEnabled)
+{
+    if (pitchDetector != nullptr)
+    {
+        pitchDetector->setCandidatePruningEnabled(shouldBeEnabled);
+        updateStringDetectors();
+    }
+}
+
+bool PolyphonicTrackerAudioProcessor::isCandidatePruningEnabled() const
+{
+    return pitchDetector != nullptr && pitchDetector->isCandidatePruningEnabled();
+}
+
+void PolyphonicTrackerAudioProcessor::setInputGateEnabled(bool shouldBeEnabled)
+{
+    inputGateEnabled = shouldBeEnabled;
+    applyInputGateSettings();
+}
+
+bool PolyphonicTrackerAudioProcessor::isInputGateEnabled() const
+{
+    return inputGateEnabled;
+}
+
+void PolyphonicTrackerAudioProcessor::setInputGateThresholds(float openThresholdDb, float closeThresholdDb)
+{
+    gateOpenThresholdDb = openThresholdDb;
+    gateCloseThresholdDb = closeThresholdDb;
+    applyInputGateSettings();
+}
+
+void PolyphonicTrackerAudioProcessor::applyInputGateSettings()
+{
+    if (fftProcessor != nullptr)
+    {
+        fftProcessor->setInputGateEnabled(inputGateEnabled);
+        fftProcessor->setInputGateThresholds(gateOpenThresholdDb, gateCloseThresholdDb);
+    }
+    
+    if (hexaphonicAnalyser != nullptr)
+        hexaphonicAnalyser->setInputGate(inputGateEnabled, gateOpenThresholdDb, gateCloseThresholdDb);
+}
+
+void PolyphonicTrackerAudioProcessor::setLogFrequencyResolution(int binsPerSemitone)
+{
+    if (pitchDetector != nullptr)
+    {
+        pitchDetector->setLogFrequencyResolution(binsPerSemitone);
+        updateStringDetectors();
+    }
+}
+
+int PolyphonicTrackerAudioProcessor::getLogFrequencyResolution() const
+{
+    return pitchDetector != nullptr ? pitchDetector->getLogFrequencyResolution() : 0;
+}
+
 bool PolyphonicTrackerAudioProcessor::saveInstrumentData(const juce::String& filePath)
 {
     return pitchDetector != nullptr && pitchDetector->saveInstrumentData(filePath);
@@ -457,7 +792,28 @@ bool PolyphonicTrackerAudioProcessor::saveInstrumentData(const juce::String& fil
 
 bool PolyphonicTrackerAudioProcessor::loadInstrumentData(const juce::String& filePath)
 {
-    return pitchDetector != nullptr && pitchDetector->loadInstrumentData(filePath);
+    if (pitchDetector == nullptr)
+        return false;
+    
+    // Loading frees (and unmaps) the templates the detector is reading, so the audio
+    // callback and the analysis worker are held off until the new set is in place
+    suspendProcessing(true);
+    const bool workerWasRunning = analysisWorker != nullptr && analysisWorker->isRunning();
+    
+    if (workerWasRunning)
+        analysisWorker->stop();
+    
+    const bool loaded = pitchDetector->loadInstrumentData(filePath);
+    
+    // The per-string detectors get their own copies of the new templates
+    if (loaded && hexaphonicAnalyser != nullptr)
+        hexaphonicAnalyser->updateProfiles(*pitchDetector);
+    
+    if (workerWasRunning)
+        analysisWorker->start();
+    
+    suspendProcessing(false);
+    return loaded;
 }
 
 void PolyphonicTrackerAudioProcessor::setMidiChannel(int channel)
@@ -492,18 +848,54 @@ void PolyphonicTrackerAudioProcessor::setNoteOffDelayMs(int ms)
     *parameters.getRawParameterValue("noteOffDelay") = static_cast<float>(ms);
 }
 
+void PolyphonicTrackerAudioProcessor::setNoteConfidenceThresholds(float onThreshold, float offThreshold)
+{
+    if (midiManager != nullptr)
+        midiManager->setConfidenceThresholds(onThreshold, offThreshold);
+}
+
+void PolyphonicTrackerAudioProcessor::setVelocityFromLevelEnabled(bool shouldBeEnabled)
+{
+    if (midiManager != nullptr)
+        midiManager->setVelocityFromLevelEnabled(shouldBeEnabled);
+}
+
+void PolyphonicTrackerAudioProcessor::setVelocityCurve(const MIDIManager::VelocityCurve& curve)
+{
+    if (midiManager != nullptr)
+        midiManager->setVelocityCurve(curve);
+}
+
 void PolyphonicTrackerAudioProcessor::setFFTSize(int fftSize)
 {
     if (fftSize != currentFFTSize && fftProcessor != nullptr)
     {
+        // The audio thread and the workers all use the FFT processor, so none of them
+        // may run until it has been replaced and the scheduling rebuilt for the new hop
+        suspendProcessing(true);
+        analysisWorker.reset();
+        
         currentFFTSize = fftSize;
         fftProcessor.reset(new FFTProcessor(fftSize));
         fftProcessor->setOverlapFactor(currentOverlapFactor);
+        fftProcessor->setMaxFramesPerBlock(maxFramesPerBlock);
+        fftProcessor->setStageTimings(&stageTimings);
+        applyInputGateSettings();
+        pitchDetector->prepare(getSampleRate(), fftSize);
         
         // Reconnect the FFT callback
-        fftProcessor->setSpectrumDataCallback([this](const float* spectrum, int size) {
-            handleNewFFTBlock(spectrum, size);
+        fftProcessor->setSpectrumDataCallback([this](const float* spectrum, int size, int sampleOffset) {
+            handleNewFFTBlock(spectrum, size, sampleOffset);
         });
+        
+        // Once prepared, the worker's ring, the scheduling delay and the per-string
+        // analysers depend on the FFT size and hop; otherwise prepareToPlay sets them up
+        if (getSampleRate() > 0.0)
+            prepareAnalysisScheduling(getSampleRate(), getBlockSize());
+        else
+            updateLatency();
+        
+        suspendProcessing(false);
     }
 }
 
@@ -514,12 +906,29 @@ int PolyphonicTrackerAudioProcessor::getFFTSize() const
 
 void PolyphonicTrackerAudioProcessor::setFFTOverlap(float overlapFactor)
 {
-    currentOverlapFactor = overlapFactor;
+    if (overlapFactor == currentOverlapFactor)
+        return;
     
-    if (fftProcessor != nullptr)
+    if (fftProcessor == nullptr)
     {
-        fftProcessor->setOverlapFactor(overlapFactor);
+        currentOverlapFactor = overlapFactor;
+        return;
     }
+    
+    // The hop sets the worker's scheduling delay, the reported latency and the
+    // per-string analysers, so rebuild them the same way setFFTSize does
+    suspendProcessing(true);
+    analysisWorker.reset();
+    
+    currentOverlapFactor = overlapFactor;
+    fftProcessor->setOverlapFactor(overlapFactor);
+    
+    if (getSampleRate() > 0.0)
+        prepareAnalysisScheduling(getSampleRate(), getBlockSize());
+    else
+        updateLatency();
+    
+    suspendProcessing(false);
 }
 
 float PolyphonicTrackerAudioProcessor::getFFTOverlap() const
@@ -527,6 +936,73 @@ float PolyphonicTrackerAudioProcessor::getFFTOverlap() const
     return currentOverlapFactor;
 }
 
+void PolyphonicTrackerAudioProcessor::setLatencyCompensationEnabled(bool shouldBeEnabled)
+{
+    latencyCompensationEnabled = shouldBeEnabled;
+    updateLatency();
+}
+
+bool PolyphonicTrackerAudioProcessor::isLatencyCompensationEnabled() const
+{
+    return latencyCompensationEnabled;
+}
+
+void PolyphonicTrackerAudioProcessor::updateLatency()
+{
+    // A note is typically detected once it fills half of the analysis window,
+    // so report half the FFT size and let the host shift our MIDI back into place.
+    // Background analysis adds its fixed scheduling delay on top.
+    const int schedulingDelay = hexaphonicAnalyser != nullptr ? hexaphonicAnalyser->getLatencySamples()
+                                                              : analysisDelaySamples;
+    
+    setLatencySamples((latencyCompensationEnabled ? currentFFTSize / 2 : 0) + schedulingDelay);
+}
+
+void PolyphonicTrackerAudioProcessor::setMaxFramesPerBlock(int maxFrames)
+{
+    maxFramesPerBlock = juce::jmax(0, maxFrames);
+    
+    if (fftProcessor != nullptr)
+    {
+        fftProcessor->setMaxFramesPerBlock(maxFramesPerBlock);
+    }
+}
+
+int PolyphonicTrackerAudioProcessor::getMaxFramesPerBlock() const
+{
+    return maxFramesPerBlock;
+}
+
+void PolyphonicTrackerAudioProcessor::setBackgroundAnalysisEnabled(bool shouldBeEnabled)
+{
+    backgroundAnalysisEnabled = shouldBeEnabled;
+}
+
+bool PolyphonicTrackerAudioProcessor::isBackgroundAnalysisEnabled() const
+{
+    return backgroundAnalysisEnabled;
+}
+
+void PolyphonicTrackerAudioProcessor::setBackgroundAnalysisHeadroom(int numSamples)
+{
+    backgroundAnalysisHeadroom = juce::jmax(0, numSamples);
+}
+
+int PolyphonicTrackerAudioProcessor::getBackgroundAnalysisHeadroom() const
+{
+    return backgroundAnalysisHeadroom;
+}
+
+void PolyphonicTrackerAudioProcessor::setHexaphonicModeEnabled(bool shouldBeEnabled)
+{
+    hexaphonicModeEnabled = shouldBeEnabled;
+}
+
+bool PolyphonicTrackerAudioProcessor::isHexaphonicModeEnabled() const
+{
+    return hexaphonicModeEnabled;
+}
+
 //==============================================================================
 // This creates new instances of the plugin..
 juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
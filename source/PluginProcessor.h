@@ -2,11 +2,16 @@
 
 #include <juce_audio_processors/juce_audio_processors.h>
 #include "dsp/PitchDetector.h"
+#include "dsp/AnalysisWorker.h"
+#include "dsp/HexaphonicAnalyser.h"
+#include "midi/MIDIManager.h"
+#include "utils/RealtimeSafety.h"
+#include "utils/SpectrumFifo.h"
+#include "utils/StageTimings.h"
 
 // Forward declarations
 class FFTProcessor;
 class PitchDetector;
-class MIDIManager;
 
 //==============================================================================
 class PolyphonicTrackerAudioProcessor : public juce::AudioProcessor, public juce::Timer
@@ -51,9 +56,9 @@ public:
     // Parameter access
     juce::AudioProcessorValueTreeState& getParameterTree() { return parameters; }
     
-    // FFT Visualization support
-    void setFFTDataCallback(std::function<void(const float*, int)> callback);
-    const float* getLatestFFTData() const;
+    // FFT Visualization support: the audio thread publishes every spectrum here
+    // and the GUI pulls the newest one at its own refresh rate
+    SpectrumFifo& getSpectrumFifo() { return spectrumFifo; }
     int getLatestFFTSize() const;
 
 
@@ -69,6 +74,33 @@ public:
     // Set max polyphony
     void setMaxPolyphony(int maxNotes);
     int getMaxPolyphony() const;  // Add this line
+    
+    // Detection engine (cosine similarity or sparse activations)
+    void setDetectionEngine(PitchDetector::DetectionEngine engine);
+    PitchDetector::DetectionEngine getDetectionEngine() const;
+    void setSolverIterationLimit(int maxIterations);
+    void setSolverTolerance(float tolerance);
+    void setSparsityPenalty(float penalty);
+    
+    // Onset gating: full detection only on spectral-flux onsets, verified reuse in between
+    void setOnsetGatingEnabled(bool shouldBeEnabled);
+    bool isOnsetGatingEnabled() const;
+    void setOnsetThreshold(float threshold);
+    
+    // Candidate pruning: a harmonic-salience pre-pass limits which templates are scored
+    void setCandidatePruningEnabled(bool shouldBeEnabled);
+    bool isCandidatePruningEnabled() const;
+    
+    // Time-domain input gate: while the input is quiet, FFT, detection and the spectrum
+    // display are skipped, and pending note-offs are still flushed once per hop
+    void setInputGateEnabled(bool shouldBeEnabled);
+    bool isInputGateEnabled() const;
+    void setInputGateThresholds(float openThresholdDb, float closeThresholdDb);
+    
+    // Template feature space: bins per semitone on a log-frequency axis (0 = linear FFT bins).
+    // Changing it clears the learned templates.
+    void setLogFrequencyResolution(int binsPerSemitone);
+    int getLogFrequencyResolution() const;
 
 
     // Instrument type
@@ -96,6 +128,9 @@ public:
     void setMidiVelocity(int velocity);
     void setNoteOnDelayMs(int ms);
     void setNoteOffDelayMs(int ms);
+    void setNoteConfidenceThresholds(float onThreshold, float offThreshold);
+    void setVelocityFromLevelEnabled(bool shouldBeEnabled);
+    void setVelocityCurve(const MIDIManager::VelocityCurve& curve);
     
     // Processor settings
     void setFFTSize(int fftSize);
@@ -103,6 +138,54 @@ public:
     
     void setFFTOverlap(float overlapFactor);
     float getFFTOverlap() const;
+    
+    // Report the analysis delay to the host so it can compensate the MIDI output
+    void setLatencyCompensationEnabled(bool shouldBeEnabled);
+    bool isLatencyCompensationEnabled() const;
+    
+    // Analysis budget: maximum FFT frames per host block (0 = no limit)
+    void setMaxFramesPerBlock(int maxFrames);
+    int getMaxFramesPerBlock() const;
+    
+    // Background analysis: processBlock only queues samples and a worker thread runs
+    // the FFT and detection. MIDI is delayed by a fixed, host-reported amount so the
+    // worker has time to finish. Takes effect at the next prepareToPlay.
+    void setBackgroundAnalysisEnabled(bool shouldBeEnabled);
+    bool isBackgroundAnalysisEnabled() const;
+    
+    // Delay between the end of an analysis frame and its MIDI output in background
+    // mode, in samples (0 = automatic: one hop plus two host blocks)
+    void setBackgroundAnalysisHeadroom(int numSamples);
+    int getBackgroundAnalysisHeadroom() const;
+    
+    // Results that arrived after their scheduled time and were sent at the start of a block
+    int getNumLateAnalysisResults() const { return lateAnalysisResults.load(std::memory_order_relaxed); }
+    
+    // Hexaphonic mode: each input channel is one guitar string, analysed on its own
+    // within that string's fret range (in parallel when background analysis is on).
+    // Needs at least two input channels; takes effect at the next prepareToPlay.
+    void setHexaphonicModeEnabled(bool shouldBeEnabled);
+    bool isHexaphonicModeEnabled() const;
+    bool isHexaphonicModeActive() const { return hexaphonicAnalyser != nullptr; }
+    
+    // Real-time safety of processBlock: what the last callback did that could block, and
+    // the totals since the last reset. Only counted in builds with
+    // POLYPHONIC_TRACKER_REALTIME_CHECKS; read while the audio thread is idle.
+    const RealtimeSafety::Report& getLastCallbackSafetyReport() const { return lastCallbackSafetyReport; }
+    const RealtimeSafety::Report& getRealtimeSafetyReport() const { return realtimeSafetyTotals; }
+    void resetRealtimeSafetyReport() { lastCallbackSafetyReport = {}; realtimeSafetyTotals = {}; }
+    
+    // Time spent in each analysis stage (mixdown, windowing, FFT, magnitude, template
+    // matching, decision, MIDI generation) and the share of the block budget processBlock
+    // uses. Lock-free; readable from any thread.
+    const StageTimings& getStageTimings() const { return stageTimings; }
+    void resetStageTimings() { stageTimings.reset(); }
+    double getCpuLoad() const { return loadMeasurer.getLoadAsProportion(); }
+    int getNumXRuns() const { return loadMeasurer.getXRunCount(); }
+    
+    // CPU load and the per-stage timings as text, for the editor
+    juce::String getPerformanceReport() const;
+    
     void timerCallback() override; // Declare the virtual method
     // In PluginProcessor.h
     void logDebugState() const
@@ -122,24 +205,95 @@ private:
     // Create parameter layout
     juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
     
-    // Process the FFT results and handle pitch detection
-    void handleNewFFTBlock(const float* fftData, int fftSize);
+    // Analysis pipeline stage, called once per FFT frame: runs pitch detection,
+    // advances the MIDI state into the current output buffer and feeds the display
+    void handleNewFFTBlock(const float* fftData, int fftSize, int sampleOffset);
+    
+    // Reports the current analysis latency to the host
+    void updateLatency();
+    
+    // Background mode: sends the worker's results that fall inside this block to the MIDI manager
+    void scheduleAnalysisResults(juce::MidiBuffer& midiMessages, int numSamples);
+    
+    // Direct mode: sends a frame held back from the previous block at the start of this one
+    void sendDeferredFrame(juce::MidiBuffer& midiMessages);
+    
+    // Rebuilds the background worker, the scheduling delay and the per-string analysers
+    // for the current FFT settings, then reports the latency; restarts the sample timeline
+    void prepareAnalysisScheduling(double sampleRate, int samplesPerBlock);
+    
+    // Builds (or removes) the per-string analysers for the current settings
+    void prepareHexaphonicAnalyser(double sampleRate, int samplesPerBlock);
+    
+    // Hands the input gate settings to the mono and per-string FFT processors
+    void applyInputGateSettings();
+    
+    // Switches learning mode; leaving it hands the new templates to the per-string detectors
+    void applyLearningMode(bool shouldBeActive);
+    
+    // Copies the main detector's templates and settings to the per-string detectors
+    void updateStringDetectors();
     
     //==============================================================================
     // Parameter storage
     juce::AudioProcessorValueTreeState parameters;
     
+    // Per-stage timings and CPU load; declared before the components that record into them
+    StageTimings stageTimings;
+    juce::AudioProcessLoadMeasurer loadMeasurer;
+    
     // DSP components
     std::unique_ptr<FFTProcessor> fftProcessor;
     std::unique_ptr<PitchDetector> pitchDetector;
     std::unique_ptr<MIDIManager> midiManager;
     
-    // FFT visualization support
-    std::function<void(const float*, int)> fftDataCallback;
+    // Mono analysis signal, sized in prepareToPlay
+    juce::AudioBuffer<float> monoBuffer;
+    
+    // FFT visualization support. One thread writes the spectrum at a time: the audio
+    // thread or the analysis worker, or in hexaphonic mode the lowest string's analysis
+    // unless learning. The writer only changes while processing is suspended.
+    SpectrumFifo spectrumFifo;
+    std::vector<float> silentSpectrum;      // Published once when the input gate closes
+    bool displayCleared = false;
+    
+    // Input gate settings
+    bool inputGateEnabled = true;
+    float gateOpenThresholdDb = InputGate::defaultOpenThresholdDb;
+    float gateCloseThresholdDb = InputGate::defaultCloseThresholdDb;
+    
+    // Background analysis; declared after the components it drives so it stops first
+    std::unique_ptr<AnalysisWorker> analysisWorker;
+    bool backgroundAnalysisEnabled = false;
+    bool backgroundAnalysisActive = false;
+    int backgroundAnalysisHeadroom = 0;
+    int analysisDelaySamples = 0;
+    juce::int64 samplePosition = 0;         // Input samples seen by processBlock (audio thread)
+    juce::int64 analysisChunkStart = 0;     // Position of the chunk being analysed (worker thread)
+    std::atomic<int> lateAnalysisResults { 0 };
+    
+    // Per-string analysis for hexaphonic pickups (null unless the mode is active)
+    std::unique_ptr<HexaphonicAnalyser> hexaphonicAnalyser;
+    bool hexaphonicModeEnabled = false;
+    
+    // Output buffer of the block currently being processed (only valid inside processBlock)
+    juce::MidiBuffer* currentMidiOutput = nullptr;
+    int currentBlockSize = 0;
+    
+    // Direct mode: a frame whose hop ended on the last sample of a block is sent at
+    // the start of the next one, so no event is stamped outside its buffer
+    AnalysisWorker::FrameResult deferredFrame;
+    bool hasDeferredFrame = false;
+    
+    // Real-time safety reports, written at the end of each processBlock
+    RealtimeSafety::Report lastCallbackSafetyReport;
+    RealtimeSafety::Report realtimeSafetyTotals;
     
     // Internal state
     int currentFFTSize;
     float currentOverlapFactor;
+    int maxFramesPerBlock;
+    bool latencyCompensationEnabled = false;
     
     // Guitar settings
     juce::StringArray openStringMidiNotes;
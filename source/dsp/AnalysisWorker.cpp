@@ -0,0 +1,176 @@
+#include "AnalysisWorker.h"
+
+AnalysisWorker::AnalysisWorker(int ringCapacity, int maxChunkSize, int resultCapacity)
+    : juce::Thread("Analysis Worker"),
+      sampleFifo(ringCapacity),
+      sampleRing(static_cast<size_t>(ringCapacity), 0.0f),
+      chunk(static_cast<size_t>(maxChunkSize), 0.0f),
+      resultFifo(resultCapacity),
+      results(static_cast<size_t>(resultCapacity)),
+      gapFifo(maxPendingGaps),
+      gaps(static_cast<size_t>(maxPendingGaps))
+{
+}
+
+AnalysisWorker::~AnalysisWorker()
+{
+    stop();
+}
+
+void AnalysisWorker::setAnalysisCallback(AnalysisCallback callback)
+{
+    jassert(!isThreadRunning());
+    analysisCallback = std::move(callback);
+}
+
+void AnalysisWorker::start()
+{
+    if (!isThreadRunning())
+        startThread();
+}
+
+void AnalysisWorker::stop()
+{
+    stopThread(1000);
+}
+
+void AnalysisWorker::reset()
+{
+    jassert(!isThreadRunning());
+    
+    sampleFifo.reset();
+    resultFifo.reset();
+    gapFifo.reset();
+    samplesPushed = 0;
+    inputPosition = 0;
+    gapPending = false;
+    samplesRead = 0;
+    samplesAnalysed = 0;
+}
+
+bool AnalysisWorker::pushSamples(const float* samples, int numSamples)
+{
+    if (numSamples <= 0)
+        return true;
+    
+    // A block that doesn't fit is dropped whole, and so is one that would need a gap
+    // record while the gap queue is full; the gap then simply grows
+    if (sampleFifo.getFreeSpace() < numSamples || (gapPending && gapFifo.getFreeSpace() == 0))
+    {
+        droppedSamples.fetch_add(numSamples, std::memory_order_relaxed);
+        inputPosition += numSamples;
+        gapPending = true;
+        return false;
+    }
+    
+    // The gap is published before the samples after it, so the worker sees it in time
+    if (gapPending)
+    {
+        int start1, size1, start2, size2;
+        gapFifo.prepareToWrite(1, start1, size1, start2, size2);
+        gaps[static_cast<size_t>(size1 > 0 ? start1 : start2)] = { samplesPushed, inputPosition };
+        gapFifo.finishedWrite(1);
+        gapPending = false;
+    }
+    
+    int start1, size1, start2, size2;
+    sampleFifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+    
+    std::copy(samples, samples + size1, sampleRing.begin() + start1);
+    std::copy(samples + size1, samples + size1 + size2, sampleRing.begin() + start2);
+    sampleFifo.finishedWrite(size1 + size2);
+    
+    samplesPushed += numSamples;
+    inputPosition += numSamples;
+    return true;
+}
+
+const AnalysisWorker::FrameResult* AnalysisWorker::peekResult()
+{
+    int start1, size1, start2, size2;
+    resultFifo.prepareToRead(1, start1, size1, start2, size2);
+    
+    if (size1 + size2 == 0)
+        return nullptr;
+    
+    return &results[static_cast<size_t>(size1 > 0 ? start1 : start2)];
+}
+
+void AnalysisWorker::popResult()
+{
+    resultFifo.finishedRead(juce::jmin(1, resultFifo.getNumReady()));
+}
+
+bool AnalysisWorker::pushResult(const FrameResult& result)
+{
+    int start1, size1, start2, size2;
+    resultFifo.prepareToWrite(1, start1, size1, start2, size2);
+    
+    if (size1 + size2 == 0)
+    {
+        droppedResults.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    
+    results[static_cast<size_t>(size1 > 0 ? start1 : start2)] = result;
+    resultFifo.finishedWrite(1);
+    return true;
+}
+
+void AnalysisWorker::run()
+{
+    while (!threadShouldExit())
+    {
+        // The audio thread never signals us (that could block it), so poll
+        int numToRead = juce::jmin(sampleFifo.getNumReady(), static_cast<int>(chunk.size()));
+        
+        if (numToRead == 0)
+        {
+            wait(1);
+            continue;
+        }
+        
+        // Gaps are published before the samples that follow them, so any gap inside the
+        // ready samples is visible by now. A chunk never spans one.
+        bool followsGap = false;
+        
+        if (const auto* gap = peekGap())
+        {
+            if (gap->ringPosition == samplesRead)
+            {
+                samplesAnalysed = gap->inputPosition;
+                followsGap = true;
+                gapFifo.finishedRead(1);
+                gap = peekGap();
+            }
+            
+            if (gap != nullptr)
+                numToRead = static_cast<int>(juce::jmin(static_cast<juce::int64>(numToRead), gap->ringPosition - samplesRead));
+        }
+        
+        int start1, size1, start2, size2;
+        sampleFifo.prepareToRead(numToRead, start1, size1, start2, size2);
+        const int numSamples = size1 + size2;
+        
+        std::copy(sampleRing.begin() + start1, sampleRing.begin() + start1 + size1, chunk.begin());
+        std::copy(sampleRing.begin() + start2, sampleRing.begin() + start2 + size2, chunk.begin() + size1);
+        sampleFifo.finishedRead(numSamples);
+        
+        if (analysisCallback)
+            analysisCallback(chunk.data(), numSamples, samplesAnalysed, followsGap);
+        
+        samplesRead += numSamples;
+        samplesAnalysed += numSamples;
+    }
+}
+
+const AnalysisWorker::Gap* AnalysisWorker::peekGap() const
+{
+    int start1, size1, start2, size2;
+    gapFifo.prepareToRead(1, start1, size1, start2, size2);
+    
+    if (size1 + size2 == 0)
+        return nullptr;
+    
+    return &gaps[static_cast<size_t>(size1 > 0 ? start1 : start2)];
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include "NoteEvent.h"
+#include <array>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+/**
+ * AnalysisWorker moves the analysis off the audio thread.
+ *
+ * The audio thread pushes samples into a lock-free ring and collects
+ * timestamped results from a lock-free queue; it never blocks, allocates or
+ * signals the worker. The worker thread polls the ring, hands each chunk to
+ * the analysis callback (FFT + detection) and publishes one result per frame,
+ * stamped with the absolute sample position where the frame ended.
+ *
+ * If the worker falls so far behind that a block doesn't fit in the ring, the
+ * whole block is dropped. The worker later moves its timeline past the missing
+ * stretch, so every result stays stamped at its real input position.
+ */
+class AnalysisWorker : private juce::Thread
+{
+public:
+    static constexpr int maxNotesPerResult = 16;
+    
+    /**
+     * Notes detected in one analysis frame
+     */
+    struct FrameResult
+    {
+        juce::int64 frameEndSample = 0;     // Absolute input sample position where the frame ended
+        int numNotes = 0;
+        std::array<NoteEvent, maxNotesPerResult> notes {};
+    };
+    
+    /**
+     * Called on the worker thread for every chunk of samples
+     * @param samples Mono input
+     * @param numSamples Number of samples
+     * @param firstSample Absolute position of samples[0] in the input stream
+     * @param followsGap True if input was dropped just before this chunk; state that
+     *                   spans chunks (such as a partly filled FFT window) should restart
+     */
+    using AnalysisCallback = std::function<void(const float* samples, int numSamples, juce::int64 firstSample, bool followsGap)>;
+    
+    /**
+     * Constructor
+     * @param ringCapacity Number of input samples the worker can fall behind by before input is dropped
+     * @param maxChunkSize Largest number of samples passed to the callback at once
+     * @param resultCapacity Number of results that can be waiting for the audio thread
+     */
+    AnalysisWorker(int ringCapacity, int maxChunkSize, int resultCapacity = 256);
+    ~AnalysisWorker() override;
+    
+    /**
+     * Sets the analysis callback. Only call while the worker is stopped.
+     * @param callback Function that analyses a chunk of samples
+     */
+    void setAnalysisCallback(AnalysisCallback callback);
+    
+    /**
+     * Starts the worker thread
+     */
+    void start();
+    
+    /**
+     * Stops the worker thread, waiting for the current chunk to finish. Queued samples
+     * are kept, so the worker can be restarted without breaking the sample timeline.
+     */
+    void stop();
+    
+    /**
+     * Checks if the worker thread is running
+     * @return True between start() and stop()
+     */
+    bool isRunning() const { return isThreadRunning(); }
+    
+    /**
+     * Clears both queues and restarts the timeline at sample 0. Only call while the
+     * worker is stopped and the audio thread is not pushing.
+     */
+    void reset();
+    
+    //==============================================================================
+    // Audio thread
+    
+    /**
+     * Queues input samples for analysis. Never blocks or allocates.
+     * @param samples Mono input
+     * @param numSamples Number of samples
+     * @return False if the ring had no room and the block was dropped
+     */
+    bool pushSamples(const float* samples, int numSamples);
+    
+    /**
+     * Gets the oldest result without removing it
+     * @return The result, or nullptr if none is waiting
+     */
+    const FrameResult* peekResult();
+    
+    /**
+     * Removes the result returned by peekResult()
+     */
+    void popResult();
+    
+    //==============================================================================
+    // Worker thread (from inside the analysis callback)
+    
+    /**
+     * Publishes a result to the audio thread
+     * @param result Result to queue
+     * @return False if the queue was full and the result was dropped
+     */
+    bool pushResult(const FrameResult& result);
+    
+    //==============================================================================
+    int getNumDroppedSamples() const { return droppedSamples.load(std::memory_order_relaxed); }
+    int getNumDroppedResults() const { return droppedResults.load(std::memory_order_relaxed); }
+
+private:
+    // Gaps the worker hasn't reached yet; while the queue is full, input keeps being dropped
+    static constexpr int maxPendingGaps = 32;
+    
+    struct Gap;
+    
+    void run() override;
+    const Gap* peekGap() const;
+    
+    juce::AbstractFifo sampleFifo;
+    std::vector<float> sampleRing;
+    std::vector<float> chunk;
+    
+    juce::AbstractFifo resultFifo;
+    std::vector<FrameResult> results;
+    
+    // Where dropped input ends: the ring position of the next sample that was kept,
+    // and that sample's position on the input timeline
+    struct Gap
+    {
+        juce::int64 ringPosition = 0;
+        juce::int64 inputPosition = 0;
+    };
+    
+    juce::AbstractFifo gapFifo;
+    std::vector<Gap> gaps;
+    
+    // Audio thread
+    juce::int64 samplesPushed = 0;      // Samples written to the ring
+    juce::int64 inputPosition = 0;      // Samples offered, including dropped ones
+    bool gapPending = false;
+    
+    // Worker thread
+    AnalysisCallback analysisCallback;
+    juce::int64 samplesRead = 0;        // Samples taken from the ring
+    juce::int64 samplesAnalysed = 0;    // Input timeline position of the next sample
+    
+    std::atomic<int> droppedSamples { 0 };
+    std::atomic<int> droppedResults { 0 };
+    
+    JUCE_DECLARE_NON_COPYABLE(AnalysisWorker)
+};
@@ -1,17 +1,26 @@
 #include "FFTProcessor.h"
+#include "../utils/RealtimeSafety.h"
 
 FFTProcessor::FFTProcessor(int fftSizeParam)
     : fftSize(fftSizeParam),
       spectrumSize(fftSizeParam / 2),
       overlapFactor(0.5f),
-      inputBufferPos(0),
+      hopSize(fftSizeParam / 2),
+      maxFramesPerBlock(0),
+      ringSize(fftSizeParam * 2),
+      totalSamplesWritten(0),
+      nextFrameEnd(fftSizeParam),
+      droppedFrameCount(0),
       fft(static_cast<int>(std::log2(static_cast<double>(fftSizeParam)))),
       window(static_cast<size_t>(fftSizeParam), juce::dsp::WindowingFunction<float>::hann)
 {
-    // Allocate memory for buffers
-    inputBuffer.resize(static_cast<size_t>(fftSize), 0.0f);
-    fftData.resize(static_cast<size_t>(fftSize * 2), 0.0f); // Complex data (real/imag pairs)
-    magnitudeSpectrum.resize(static_cast<size_t>(spectrumSize), 0.0f);
+    // The circular buffer is indexed with a mask, so the FFT size must be a power of 2
+    jassert(juce::isPowerOfTwo(fftSize));
+    
+    // Allocate memory for buffers; the ring holds two frames so that frames
+    // deferred by the per-block budget can still be analysed in the next block
+    ringBuffer.resize(static_cast<size_t>(ringSize), 0.0f);
+    fftData.resize(static_cast<size_t>(fftSize * 2), 0.0f); // performRealOnlyForwardTransform needs 2 * fftSize
 }
 
 FFTProcessor::~FFTProcessor()
@@ -20,87 +29,146 @@ FFTProcessor::~FFTProcessor()
 
 bool FFTProcessor::processBlock(const float* inBuffer, int numSamples)
 {
-    bool fftPerformed = false;
+    int framesThisBlock = 0;
+    auto budgetLeft = [this, &framesThisBlock] {
+        return maxFramesPerBlock <= 0 || framesThisBlock < maxFramesPerBlock;
+    };
     
-    // Calculate hop size based on overlap factor
-    int hopSize = static_cast<int>(fftSize * (1.0f - overlapFactor));
-    if (hopSize < 1) hopSize = 1;
+    // Gate on the raw input before any windowing or FFT work. Frames whose window
+    // reaches back into the last block that passed the gate are still analysed,
+    // so a decaying note is followed until it has fully left the window.
+    if (!inputGateEnabled || inputGate.process(inBuffer, numSamples))
+        gateOpenEnd = totalSamplesWritten + numSamples;
     
-    // Add samples to the input buffer
-    for (int i = 0; i < numSamples; ++i)
+    // Frames that were spilled by the budget in the previous block come first;
+    // they are already late, so they are reported at the start of this block
+    while (nextFrameEnd <= totalSamplesWritten && budgetLeft())
     {
-        inputBuffer[static_cast<size_t>(inputBufferPos)] = inBuffer[i];
-        inputBufferPos++;
+        if (performPendingFrame(0))
+            ++framesThisBlock;
+    }
+    
+    // Consume the block in chunks that end either at the block end or exactly on a hop boundary
+    int samplesConsumed = 0;
+    
+    while (samplesConsumed < numSamples)
+    {
+        int chunkSize = juce::jmin(numSamples - samplesConsumed, ringSize);
+        const juce::int64 samplesToFrameEnd = nextFrameEnd - totalSamplesWritten;
+        
+        if (samplesToFrameEnd > 0)
+            chunkSize = static_cast<int>(juce::jmin(static_cast<juce::int64>(chunkSize), samplesToFrameEnd));
         
-        // If we have enough samples, perform the FFT
-        if (inputBufferPos >= fftSize)
+        writeToRing(inBuffer + samplesConsumed, chunkSize);
+        samplesConsumed += chunkSize;
+        
+        // Frames that did not fit in this block's budget stay pending until the next one
+        if (nextFrameEnd == totalSamplesWritten && budgetLeft())
         {
-            performFFT();
-            
-            // Shift the buffer by the hop size
-            const int samplesToKeep = fftSize - hopSize;
-            if (samplesToKeep > 0)
-            {
-                std::copy(inputBuffer.begin() + hopSize, inputBuffer.end(), inputBuffer.begin());
-            }
-            
-            inputBufferPos = samplesToKeep;
-            fftPerformed = true;
+            if (performPendingFrame(samplesConsumed))
+                ++framesThisBlock;
         }
     }
     
-    return fftPerformed;
+    return framesThisBlock > 0;
 }
 
-// In FFTProcessor.cpp
-void FFTProcessor::performFFT()
+void FFTProcessor::writeToRing(const float* samples, int numSamples)
 {
-    // Apply window function
-    applyWindow();
+    // Chunks are limited to the ring size, so at most one wrap occurs
+    jassert(numSamples <= ringSize);
     
-    // Copy windowed input to FFT data array (real part)
-    for (int i = 0; i < fftSize; ++i)
-    {
-        fftData[static_cast<size_t>(i * 2)] = inputBuffer[static_cast<size_t>(i)];
-        fftData[static_cast<size_t>(i * 2 + 1)] = 0.0f; // Imaginary part is zero
-    }
+    const int writePos = static_cast<int>(totalSamplesWritten & (ringSize - 1));
+    const int firstPart = juce::jmin(numSamples, ringSize - writePos);
+    juce::FloatVectorOperations::copy(ringBuffer.data() + writePos, samples, firstPart);
+    juce::FloatVectorOperations::copy(ringBuffer.data(), samples + firstPart, numSamples - firstPart);
     
-    // Perform the FFT
-    fft.performRealOnlyForwardTransform(fftData.data(), true);
+    totalSamplesWritten += numSamples;
+}
+
+bool FFTProcessor::performPendingFrame(int sampleOffset)
+{
+    // If the ring has already overwritten the start of the pending frame, skip ahead
+    // to the oldest frame that is still complete and count the ones we lost
+    const juce::int64 oldestAvailable = totalSamplesWritten - ringSize;
     
-    // Calculate the magnitude spectrum
-    for (int i = 0; i < spectrumSize; ++i)
+    if (nextFrameEnd - fftSize < oldestAvailable)
     {
-        float real = fftData[static_cast<size_t>(i * 2)];
-        float imag = fftData[static_cast<size_t>(i * 2 + 1)];
+        const juce::int64 hopsBehind = (oldestAvailable - (nextFrameEnd - fftSize) + hopSize - 1) / hopSize;
+        nextFrameEnd += hopsBehind * hopSize;
+        droppedFrameCount += static_cast<int>(hopsBehind);
         
-        // Calculate magnitude (sqrt of real^2 + imag^2)
-        magnitudeSpectrum[static_cast<size_t>(i)] = std::sqrt(real * real + imag * imag);
+        if (nextFrameEnd > totalSamplesWritten)
+            return false;
     }
     
-    // Call the callback if registered - in a try/catch block
+    if (nextFrameEnd - fftSize >= gateOpenEnd)
+    {
+        // Nothing but gated input in this window: skip the FFT but keep the frame clock running
+        ++gatedFrameCount;
+        notifySpectrum(nullptr, sampleOffset);
+    }
+    else
+    {
+        StageTimings::Stopwatch stopwatch(stageTimings);
+        assembleFrame(nextFrameEnd - fftSize);
+        stopwatch.lap(StageTimings::Stage::windowing);
+        performFFT(stopwatch);
+        notifySpectrum(fftData.data(), sampleOffset);
+    }
+    
+    nextFrameEnd += hopSize;
+    return true;
+}
+
+void FFTProcessor::assembleFrame(juce::int64 frameStart)
+{
+    // Unroll the frame from the ring straight into the FFT work buffer
+    const int readPos = static_cast<int>(frameStart & (ringSize - 1));
+    const int firstPart = juce::jmin(fftSize, ringSize - readPos);
+    juce::FloatVectorOperations::copy(fftData.data(), ringBuffer.data() + readPos, firstPart);
+    juce::FloatVectorOperations::copy(fftData.data() + firstPart, ringBuffer.data(), fftSize - firstPart);
+    
+    window.multiplyWithWindowingTable(fftData.data(), static_cast<size_t>(fftSize));
+}
+
+void FFTProcessor::performFFT(StageTimings::Stopwatch& stopwatch)
+{
+    // Real-only transform followed by magnitude calculation, in place; the same steps
+    // as performFrequencyOnlyForwardTransform, split so each can be timed. The first
+    // spectrumSize values of fftData hold the magnitude spectrum afterwards.
+    fft.performRealOnlyForwardTransform(fftData.data(), true);
+    stopwatch.lap(StageTimings::Stage::fft);
+    
+    const int numBins = spectrumSize + 1;
+    const auto* bins = reinterpret_cast<const std::complex<float>*>(fftData.data());
+    
+    for (int i = 0; i < numBins; ++i)
+        fftData[static_cast<size_t>(i)] = std::abs(bins[i]);
+    
+    juce::FloatVectorOperations::clear(fftData.data() + numBins, static_cast<int>(fftData.size()) - numBins);
+    stopwatch.lap(StageTimings::Stage::magnitude);
+}
+
+void FFTProcessor::notifySpectrum(const float* spectrum, int sampleOffset)
+{
+    // Call the callback if registered - in a try/catch block. It is invoked directly
+    // rather than through a copy, since copying a std::function may allocate
     if (spectrumCallback)
     {
         try {
-            std::function<void(const float*, int)> callbackCopy = spectrumCallback;
-            if (callbackCopy) {
-                callbackCopy(magnitudeSpectrum.data(), spectrumSize);
-            }
+            spectrumCallback(spectrum, spectrumSize, sampleOffset);
         }
         catch (const std::exception& e) {
+            RealtimeSafety::noteBlockingCall("Logger::writeToLog");
             juce::Logger::writeToLog("Error in FFT callback: " + juce::String(e.what()));
         }
     }
 }
 
-void FFTProcessor::applyWindow()
-{
-    window.multiplyWithWindowingTable(inputBuffer.data(), static_cast<size_t>(fftSize));
-}
-
 const float* FFTProcessor::getMagnitudeSpectrum() const
 {
-    return magnitudeSpectrum.data();
+    return fftData.data();
 }
 
 int FFTProcessor::getSpectrumSize() const
@@ -116,17 +184,75 @@ int FFTProcessor::getFFTSize() const
 void FFTProcessor::setOverlapFactor(float newOverlap)
 {
     overlapFactor = juce::jlimit(0.0f, 0.95f, newOverlap);
+    
+    // Calculate hop size based on overlap factor
+    hopSize = juce::jmax(1, static_cast<int>(static_cast<float>(fftSize) * (1.0f - overlapFactor)));
+    nextFrameEnd = juce::jmin(nextFrameEnd, juce::jmax(static_cast<juce::int64>(fftSize), totalSamplesWritten + hopSize));
+}
+
+int FFTProcessor::getHopSize() const
+{
+    return hopSize;
+}
+
+void FFTProcessor::setMaxFramesPerBlock(int maxFrames)
+{
+    maxFramesPerBlock = juce::jmax(0, maxFrames);
+}
+
+int FFTProcessor::getMaxFramesPerBlock() const
+{
+    return maxFramesPerBlock;
+}
+
+int FFTProcessor::getNumPendingFrames() const
+{
+    if (nextFrameEnd > totalSamplesWritten)
+        return 0;
+    
+    // Only frames that still fit in the ring can be analysed
+    const int maxRetained = (ringSize - fftSize) / hopSize + 1;
+    return juce::jmin(maxRetained, static_cast<int>((totalSamplesWritten - nextFrameEnd) / hopSize) + 1);
+}
+
+int FFTProcessor::getNumDroppedFrames() const
+{
+    return droppedFrameCount;
+}
+
+void FFTProcessor::setInputGateEnabled(bool shouldBeEnabled)
+{
+    inputGateEnabled = shouldBeEnabled;
+}
+
+bool FFTProcessor::isInputGateEnabled() const
+{
+    return inputGateEnabled;
+}
+
+void FFTProcessor::setInputGateThresholds(float openThresholdDb, float closeThresholdDb)
+{
+    inputGate.setThresholds(openThresholdDb, closeThresholdDb);
+}
+
+int FFTProcessor::getNumGatedFrames() const
+{
+    return gatedFrameCount;
 }
 
 void FFTProcessor::reset()
 {
-    std::fill(inputBuffer.begin(), inputBuffer.end(), 0.0f);
+    std::fill(ringBuffer.begin(), ringBuffer.end(), 0.0f);
     std::fill(fftData.begin(), fftData.end(), 0.0f);
-    std::fill(magnitudeSpectrum.begin(), magnitudeSpectrum.end(), 0.0f);
-    inputBufferPos = 0;
+    totalSamplesWritten = 0;
+    nextFrameEnd = fftSize;
+    droppedFrameCount = 0;
+    inputGate.reset();
+    gateOpenEnd = 0;
+    gatedFrameCount = 0;
 }
 
-void FFTProcessor::setSpectrumDataCallback(std::function<void(const float*, int)> callback)
+void FFTProcessor::setSpectrumDataCallback(std::function<void(const float*, int, int)> callback)
 {
     spectrumCallback = callback;
 }
\ No newline at end of file
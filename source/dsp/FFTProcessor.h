@@ -2,6 +2,8 @@
 
 #include <juce_dsp/juce_dsp.h>
 #include <juce_audio_basics/juce_audio_basics.h>
+#include "InputGate.h"
+#include "../utils/StageTimings.h"
 
 /**
  * FFTProcessor handles the FFT analysis of incoming audio.
@@ -22,10 +24,15 @@ public:
     ~FFTProcessor();
     
     /**
-     * Processes a block of audio and updates the FFT if enough samples are collected
+     * Processes a block of audio and performs an FFT every time a hop completes.
+     * Samples are written into a circular buffer with bulk copies, so any host
+     * block size is supported and several frames may be produced per call.
+     * If a frame budget is set, frames beyond it are deferred to the next call.
+     * With the input gate enabled, frames whose whole window is gated skip the
+     * FFT and are reported to the callback without spectrum data.
      * @param inBuffer Audio input buffer
      * @param numSamples Number of samples in the buffer
-     * @return True if FFT was performed, false otherwise
+     * @return True if at least one frame was reported, false otherwise
      */
     bool processBlock(const float* inBuffer, int numSamples);
     
@@ -53,33 +60,121 @@ public:
      */
     void setOverlapFactor(float newOverlap);
     
+    /**
+     * Gets the number of samples between consecutive frames
+     * @return Hop size in samples
+     */
+    int getHopSize() const;
+    
+    /**
+     * Limits how many frames are analysed per processBlock call. Frames over
+     * the budget are spilled to the next call; if they fall too far behind,
+     * the oldest ones are dropped.
+     * @param maxFrames Maximum frames per call, or 0 for no limit
+     */
+    void setMaxFramesPerBlock(int maxFrames);
+    
+    /**
+     * Gets the per-call frame budget
+     * @return Maximum frames per call, or 0 for no limit
+     */
+    int getMaxFramesPerBlock() const;
+    
+    /**
+     * Gets the number of completed hops waiting for analysis
+     * @return Number of pending frames
+     */
+    int getNumPendingFrames() const;
+    
+    /**
+     * Gets the number of frames skipped because they were spilled for too long
+     * @return Number of dropped frames since the last reset
+     */
+    int getNumDroppedFrames() const;
+    
+    /**
+     * Enables the time-domain input gate. Each input block is measured before any
+     * FFT work; while the gate is closed, samples are still buffered and hops still
+     * counted, but frames that only contain gated input skip windowing and the FFT.
+     * @param shouldBeEnabled True to gate on input level (off by default)
+     */
+    void setInputGateEnabled(bool shouldBeEnabled);
+    
+    /**
+     * Checks if the input gate is enabled
+     * @return True if quiet input skips the FFT
+     */
+    bool isInputGateEnabled() const;
+    
+    /**
+     * Sets the input gate thresholds
+     * @param openThresholdDb Block peak (dBFS) that opens the gate
+     * @param closeThresholdDb Block RMS (dBFS) below which the gate closes again
+     */
+    void setInputGateThresholds(float openThresholdDb, float closeThresholdDb);
+    
+    /**
+     * Gets the number of frames that skipped the FFT because the input was gated
+     * @return Number of gated frames since the last reset
+     */
+    int getNumGatedFrames() const;
+    
     /**
      * Resets the FFT processor, clearing all buffers
      */
     void reset();
     
     /**
-     * Registers a callback function to be called when new FFT data is available
+     * Registers a callback function to be called when new FFT data is available.
+     * Besides the spectrum and its size, the callback receives the offset within
+     * the block passed to processBlock at which the frame's hop ended
+     * (0 for frames deferred from a previous block). A hop that ends on the block's
+     * last sample is reported at the block length, one past the end; listeners that
+     * stamp MIDI with the offset have to move such frames to the next block.
+     * Frames skipped by the input gate are reported with a null spectrum, so
+     * listeners can still advance their per-frame state.
      * @param callback Function to call with new spectrum data
      */
-    void setSpectrumDataCallback(std::function<void(const float*, int)> callback);
+    void setSpectrumDataCallback(std::function<void(const float*, int, int)> callback);
+    
+    /**
+     * Records the windowing, FFT and magnitude time of every analysed frame
+     * @param timings Shared timing statistics, or nullptr to stop timing
+     */
+    void setStageTimings(StageTimings* timings) { stageTimings = timings; }
     
 private:
     int fftSize;
     int spectrumSize;
     float overlapFactor;
+    int hopSize;
+    int maxFramesPerBlock;
+    
+    // Circular input buffer, addressed by absolute sample positions
+    std::vector<float> ringBuffer;
+    int ringSize;
+    juce::int64 totalSamplesWritten;
+    juce::int64 nextFrameEnd;       // Absolute position one past the last sample of the next frame
+    int droppedFrameCount;
     
-    std::vector<float> inputBuffer;
-    int inputBufferPos;
+    // Time-domain gate; frames starting at or after gateOpenEnd only contain gated input
+    InputGate inputGate;
+    bool inputGateEnabled = false;
+    juce::int64 gateOpenEnd = 0;    // Absolute position one past the last block the gate let through
+    int gatedFrameCount = 0;
     
     juce::dsp::FFT fft;
     juce::dsp::WindowingFunction<float> window;
     
+    // FFT work buffer: the windowed frame goes in, the magnitude spectrum comes out
     std::vector<float> fftData;
-    std::vector<float> magnitudeSpectrum;
     
-    std::function<void(const float*, int)> spectrumCallback;
+    std::function<void(const float*, int, int)> spectrumCallback;
+    StageTimings* stageTimings = nullptr;
     
-    void performFFT();
-    void applyWindow();
+    void writeToRing(const float* samples, int numSamples);
+    bool performPendingFrame(int sampleOffset);
+    void assembleFrame(juce::int64 frameStart);
+    void performFFT(StageTimings::Stopwatch& stopwatch);
+    void notifySpectrum(const float* spectrum, int sampleOffset);
 };
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "HarmonicSalience.h"
+
+HarmonicSalience::HarmonicSalience()
+{
+    for (int h = 0; h < numHarmonics; ++h)
+        harmonicWeights[static_cast<size_t>(h)] = std::pow(0.8f, static_cast<float>(h));
+}
+
+void HarmonicSalience::prepare(const std::function<float(float)>& frequencyToBin, int numBinsParam)
+{
+    numBins = juce::jmax(0, numBinsParam);
+    rankedNotes.reserve(static_cast<size_t>(numMidiNotes));
+    
+    for (int note = 0; note < numMidiNotes; ++note)
+    {
+        const float fundamental = 440.0f * std::pow(2.0f, static_cast<float>(note - 69) / 12.0f);
+        semitoneWidths[static_cast<size_t>(note)] = frequencyToBin(fundamental * std::pow(2.0f, 1.0f / 12.0f))
+                                                  - frequencyToBin(fundamental);
+        
+        for (int h = 0; h < numHarmonics; ++h)
+        {
+            const float position = frequencyToBin(fundamental * static_cast<float>(h + 1));
+            auto& harmonic = harmonics[static_cast<size_t>(note)][static_cast<size_t>(h)];
+            
+            if (position >= 0.0f && position < static_cast<float>(numBins - 1))
+            {
+                harmonic.bin = static_cast<int>(position);
+                harmonic.fraction = position - static_cast<float>(harmonic.bin);
+            }
+            else
+            {
+                harmonic.bin = -1;
+            }
+        }
+    }
+}
+
+void HarmonicSalience::release()
+{
+    numBins = 0;
+}
+
+float HarmonicSalience::getSalience(const float* spectrum, int midiNote) const
+{
+    if (midiNote < 0 || midiNote >= numMidiNotes)
+        return 0.0f;
+    
+    const auto& noteHarmonics = harmonics[static_cast<size_t>(midiNote)];
+    float salience = 0.0f;
+    
+    for (int h = 0; h < numHarmonics; ++h)
+    {
+        const auto& harmonic = noteHarmonics[static_cast<size_t>(h)];
+        
+        if (harmonic.bin < 0)
+            break;
+        
+        const float value = spectrum[harmonic.bin]
+                          + harmonic.fraction * (spectrum[harmonic.bin + 1] - spectrum[harmonic.bin]);
+        salience += harmonicWeights[static_cast<size_t>(h)] * value;
+    }
+    
+    return salience;
+}
+
+float HarmonicSalience::getPartialMagnitude(const float* spectrum, int midiNote) const
+{
+    if (midiNote < 0 || midiNote >= numMidiNotes)
+        return 0.0f;
+    
+    const auto& noteHarmonics = harmonics[static_cast<size_t>(midiNote)];
+    float sumSquares = 0.0f;
+    
+    for (const auto& harmonic : noteHarmonics)
+    {
+        if (harmonic.bin < 0)
+            break;
+        
+        const float value = spectrum[harmonic.bin]
+                          + harmonic.fraction * (spectrum[harmonic.bin + 1] - spectrum[harmonic.bin]);
+        sumSquares += value * value;
+    }
+    
+    return std::sqrt(sumSquares);
+}
+
+float HarmonicSalience::estimateTuning(const float* spectrum, int midiNote) const
+{
+    if (midiNote < 0 || midiNote >= numMidiNotes)
+        return 0.0f;
+    
+    const auto& fundamental = harmonics[static_cast<size_t>(midiNote)][0];
+    const float width = semitoneWidths[static_cast<size_t>(midiNote)];
+    
+    if (fundamental.bin < 0 || width <= 0.0f)
+        return 0.0f;
+    
+    // Strongest bin within half a semitone (and at least a bin) of the nominal position
+    const float position = static_cast<float>(fundamental.bin) + fundamental.fraction;
+    const float searchRadius = juce::jmax(1.0f, 0.5f * width);
+    const int first = juce::jmax(1, static_cast<int>(std::floor(position - searchRadius)));
+    const int last = juce::jmin(numBins - 2, static_cast<int>(std::ceil(position + searchRadius)));
+    
+    if (first > last)
+        return 0.0f;
+    
+    int peak = first;
+    for (int bin = first + 1; bin <= last; ++bin)
+        if (spectrum[bin] > spectrum[peak])
+            peak = bin;
+    
+    const float below = spectrum[peak - 1];
+    const float centre = spectrum[peak];
+    const float above = spectrum[peak + 1];
+    
+    // A window edge that is still rising is not a peak of this note
+    if (centre <= 0.0f || centre < below || centre < above)
+        return 0.0f;
+    
+    // Parabolic interpolation through the peak and its neighbours
+    const float curvature = below - 2.0f * centre + above;
+    const float offset = curvature < 0.0f ? 0.5f * (below - above) / curvature : 0.0f;
+    
+    return juce::jlimit(-50.0f, 50.0f, 100.0f * (static_cast<float>(peak) + offset - position) / width);
+}
+
+void HarmonicSalience::selectCandidates(const float* spectrum, const std::vector<int>& notes, int maxCandidates,
+                                        std::vector<int>& candidates)
+{
+    candidates.clear();
+    rankedNotes.clear();
+    float maxSalience = 0.0f;
+    
+    for (int note : notes)
+    {
+        const float salience = getSalience(spectrum, note);
+        
+        if (salience > 0.0f)
+        {
+            rankedNotes.emplace_back(salience, note);
+            maxSalience = juce::jmax(maxSalience, salience);
+        }
+    }
+    
+    const int numToKeep = juce::jmin(maxCandidates, static_cast<int>(rankedNotes.size()));
+    std::partial_sort(rankedNotes.begin(), rankedNotes.begin() + numToKeep, rankedNotes.end(),
+                      [](const auto& a, const auto& b) { return a.first > b.first; });
+    
+    for (int i = 0; i < numToKeep; ++i)
+    {
+        const auto& ranked = rankedNotes[static_cast<size_t>(i)];
+        
+        if (ranked.first < minimumRelativeSalience * maxSalience)
+            break;
+        
+        candidates.push_back(ranked.second);
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <array>
+#include <functional>
+#include <vector>
+
+/**
+ * HarmonicSalience is a cheap pre-pass that proposes which notes could be
+ * sounding in a frame, so that only their templates need to be scored.
+ *
+ * The salience of a note is a weighted harmonic sum: the spectrum interpolated
+ * at each of its first harmonics, weighted 0.8^(h - 1). Interpolating at the
+ * exact position, rather than taking the nearest bin, keeps neighbouring
+ * semitones apart where bins are wider than a semitone. The harmonic positions
+ * are precomputed per MIDI note for the current feature space, so a frame costs
+ * numHarmonics lookups per note. The same positions give the partial energy and
+ * tuning of the notes that were detected.
+ */
+class HarmonicSalience
+{
+public:
+    static constexpr int numHarmonics = 8;
+    static constexpr int numMidiNotes = 128;
+    
+    HarmonicSalience();
+    
+    /**
+     * Precomputes the harmonic bin positions. Not real-time safe.
+     * @param frequencyToBin Maps a frequency in Hz to a (fractional) bin of the analysed feature vectors
+     * @param numBins Size of the feature vectors
+     */
+    void prepare(const std::function<float(float)>& frequencyToBin, int numBins);
+    
+    /**
+     * Forgets the bin positions; isPrepared() returns false afterwards
+     */
+    void release();
+    
+    bool isPrepared() const { return numBins > 0; }
+    int getNumBins() const { return numBins; }
+    
+    /**
+     * Computes the salience of one note
+     * @param spectrum Magnitude feature vector of getNumBins() values
+     * @param midiNote MIDI note
+     * @return Weighted harmonic sum
+     */
+    float getSalience(const float* spectrum, int midiNote) const;
+    
+    /**
+     * Measures how much energy sits on a note's partials, for level estimation
+     * @param spectrum Magnitude feature vector of getNumBins() values
+     * @param midiNote MIDI note
+     * @return Root-sum-square of the interpolated partial magnitudes
+     */
+    float getPartialMagnitude(const float* spectrum, int midiNote) const;
+    
+    /**
+     * Estimates how far a note's fundamental is from equal temperament, by
+     * interpolating the spectral peak nearest its nominal position
+     * @param spectrum Magnitude feature vector of getNumBins() values
+     * @param midiNote MIDI note
+     * @return Deviation in cents (within +/-50), or 0 if there is no peak near the fundamental
+     */
+    float estimateTuning(const float* spectrum, int midiNote) const;
+    
+    /**
+     * Picks the most salient notes from a list. Doesn't allocate once prepared.
+     * @param spectrum Magnitude feature vector of getNumBins() values
+     * @param notes Notes to consider (e.g. the notes that have templates)
+     * @param maxCandidates Largest number of notes to return
+     * @param candidates Receives the chosen notes, most salient first
+     */
+    void selectCandidates(const float* spectrum, const std::vector<int>& notes, int maxCandidates,
+                          std::vector<int>& candidates);
+
+private:
+    struct HarmonicPosition
+    {
+        int bin = -1;           // Bin below the harmonic, -1 past the last bin
+        float fraction = 0.0f;  // Position between bin and bin + 1
+    };
+    
+    std::array<std::array<HarmonicPosition, numHarmonics>, numMidiNotes> harmonics;
+    std::array<float, numHarmonics> harmonicWeights;
+    std::array<float, numMidiNotes> semitoneWidths;     // Bins between each note's fundamental and the next note's
+    std::vector<std::pair<float, int>> rankedNotes;
+    int numBins = 0;
+    
+    // Notes below this share of the strongest salience are never candidates
+    static constexpr float minimumRelativeSalience = 0.1f;
+};
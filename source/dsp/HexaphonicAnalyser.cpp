@@ -0,0 +1,271 @@
+#include "HexaphonicAnalyser.h"
+#include "FFTProcessor.h"
+#include <limits>
+
+HexaphonicAnalyser::HexaphonicAnalyser()
+{
+    mergedEvents.reserve(static_cast<size_t>(maxStrings));
+}
+
+HexaphonicAnalyser::~HexaphonicAnalyser()
+{
+    release();
+}
+
+void HexaphonicAnalyser::prepare(const PitchDetector& source, const PitchDetector::GuitarSettings& guitarSettings,
+                                 int numChannels, double sampleRate, int fftSize, float overlapFactor,
+                                 bool useWorkerThreads, int schedulingDelayParam)
+{
+    release();
+    
+    useWorkers = useWorkerThreads;
+    schedulingDelay = useWorkers ? juce::jmax(0, schedulingDelayParam) : 0;
+    samplePosition = 0;
+    lateFrames = 0;
+    preparedSampleRate = sampleRate;
+    preparedFFTSize = fftSize;
+    
+    const int numStrings = juce::jmin(numChannels, maxStrings,
+                                      static_cast<int>(guitarSettings.openStringMidiNotes.size()));
+    
+    for (int i = 0; i < numStrings; ++i)
+    {
+        auto string = std::make_unique<StringChannel>();
+        StringChannel& channel = *string;
+        const bool isLowestString = (i == 0);
+        
+        channel.index = i;
+        getStringRange(guitarSettings, i, channel.lowestNote, channel.highestNote);
+        
+        // A string only ever sounds one note
+        channel.detector = std::make_unique<PitchDetector>(1);
+        channel.detector->copyProfilesFrom(source, channel.lowestNote, channel.highestNote);
+        channel.detector->prepare(sampleRate, fftSize);
+        channel.detector->setStageTimings(stageTimings);
+        
+        channel.fftProcessor = std::make_unique<FFTProcessor>(fftSize);
+        channel.fftProcessor->setOverlapFactor(overlapFactor);
+        channel.fftProcessor->setInputGateEnabled(inputGateEnabled);
+        channel.fftProcessor->setInputGateThresholds(gateOpenThresholdDb, gateCloseThresholdDb);
+        channel.fftProcessor->setStageTimings(stageTimings);
+        channel.fftProcessor->setSpectrumDataCallback([this, &channel, isLowestString](const float* spectrum, int size, int sampleOffset) {
+            handleStringFrame(channel, isLowestString, spectrum, size, sampleOffset);
+        });
+        
+        // Without worker threads the worker is only used as the string's result queue
+        if (useWorkers)
+        {
+            const int ringCapacity = juce::jmax(static_cast<int>(sampleRate * 2.0), fftSize * 4);
+            channel.worker = std::make_unique<AnalysisWorker>(ringCapacity, 1024);
+            channel.worker->setAnalysisCallback([&channel](const float* samples, int numSamples, juce::int64 firstSample, bool followsGap) {
+                if (followsGap)
+                    channel.fftProcessor->reset();
+                
+                channel.chunkStart = firstSample;
+                channel.fftProcessor->processBlock(samples, numSamples);
+            });
+        }
+        else
+        {
+            channel.worker = std::make_unique<AnalysisWorker>(1, 1);
+        }
+        
+        strings.push_back(std::move(string));
+    }
+    
+    startWorkers();
+}
+
+void HexaphonicAnalyser::release()
+{
+    stopWorkers();
+    strings.clear();
+}
+
+void HexaphonicAnalyser::updateProfiles(const PitchDetector& source)
+{
+    stopWorkers();
+    
+    for (auto& string : strings)
+    {
+        string->detector->copyProfilesFrom(source, string->lowestNote, string->highestNote);
+        string->detector->prepare(preparedSampleRate, preparedFFTSize);
+    }
+    
+    startWorkers();
+}
+
+void HexaphonicAnalyser::startWorkers()
+{
+    if (useWorkers)
+        for (auto& string : strings)
+            string->worker->start();
+}
+
+void HexaphonicAnalyser::stopWorkers()
+{
+    for (auto& string : strings)
+        if (string->worker != nullptr)
+            string->worker->stop();
+}
+
+void HexaphonicAnalyser::processBlock(const juce::AudioBuffer<float>& input, int numSamples)
+{
+    const int numChannels = juce::jmin(input.getNumChannels(), getNumStrings());
+    
+    for (int i = 0; i < numChannels; ++i)
+    {
+        auto& string = *strings[static_cast<size_t>(i)];
+        
+        if (useWorkers)
+        {
+            string.worker->pushSamples(input.getReadPointer(i), numSamples);
+        }
+        else
+        {
+            string.chunkStart = samplePosition;
+            string.fftProcessor->processBlock(input.getReadPointer(i), numSamples);
+        }
+    }
+    
+    mergeFrames(samplePosition, samplePosition + numSamples);
+    samplePosition += numSamples;
+}
+
+void HexaphonicAnalyser::handleStringFrame(StringChannel& string, bool isLowestString,
+                                           const float* spectrum, int size, int sampleOffset)
+{
+    AnalysisWorker::FrameResult result;
+    result.frameEndSample = string.chunkStart + sampleOffset;
+    
+    // A gated frame has no spectrum; an idle string would otherwise match whichever
+    // template its noise floor resembles
+    if (spectrum != nullptr && juce::FloatVectorOperations::findMaximum(spectrum, size) > silenceThreshold)
+    {
+        result.numNotes = string.detector->processSpectrum(spectrum, size, result.notes.data(),
+                                                           AnalysisWorker::maxNotesPerResult, result.frameEndSample);
+        
+        // The channel says which string played the note, whatever the templates recorded
+        for (int n = 0; n < result.numNotes; ++n)
+        {
+            auto& event = result.notes[static_cast<size_t>(n)];
+            event.guitarString = string.index;
+            event.guitarFret = event.midiNote - string.lowestNote;
+        }
+    }
+    
+    string.worker->pushResult(result);
+    
+    if (isLowestString && spectrumCallback && spectrum != nullptr)
+        spectrumCallback(spectrum, size);
+}
+
+void HexaphonicAnalyser::mergeFrames(juce::int64 blockStart, juce::int64 blockEnd)
+{
+    if (strings.empty())
+        return;
+    
+    for (;;)
+    {
+        // Merge the oldest frame once every string has reported it. A string that
+        // dropped the frame reports a later one, so take the earliest frame end.
+        juce::int64 frameEnd = std::numeric_limits<juce::int64>::max();
+        
+        for (auto& string : strings)
+        {
+            const auto* result = string->worker->peekResult();
+            
+            if (result == nullptr)
+                return;
+            
+            frameEnd = juce::jmin(frameEnd, result->frameEndSample);
+        }
+        
+        const juce::int64 due = frameEnd + schedulingDelay;
+        
+        if (due >= blockEnd)
+            return;
+        
+        if (due < blockStart)
+            lateFrames.fetch_add(1, std::memory_order_relaxed);
+        
+        mergedEvents.clear();
+        
+        for (auto& string : strings)
+        {
+            const auto* result = string->worker->peekResult();
+            
+            if (result->frameEndSample != frameEnd)
+                continue;
+            
+            for (int n = 0; n < result->numNotes; ++n)
+            {
+                const auto& event = result->notes[static_cast<size_t>(n)];
+                const auto existing = std::find_if(mergedEvents.begin(), mergedEvents.end(),
+                                                   [&event](const NoteEvent& e) { return e.midiNote == event.midiNote; });
+                
+                // Two strings can play the same pitch; MIDI only needs it once, so keep the
+                // more confident string's event at the louder level
+                if (existing != mergedEvents.end())
+                {
+                    const float level = juce::jmax(existing->levelDb, event.levelDb);
+                    
+                    if (event.confidence > existing->confidence)
+                        *existing = event;
+                    
+                    existing->levelDb = level;
+                }
+                else if (mergedEvents.size() < mergedEvents.capacity())
+                {
+                    mergedEvents.push_back(event);
+                }
+            }
+            
+            string->worker->popResult();
+        }
+        
+        if (frameCallback)
+            frameCallback(mergedEvents.data(), static_cast<int>(mergedEvents.size()), static_cast<int>(juce::jmax(juce::int64(0), due - blockStart)));
+    }
+}
+
+void HexaphonicAnalyser::setFrameCallback(std::function<void(const NoteEvent*, int, int)> callback)
+{
+    frameCallback = std::move(callback);
+}
+
+void HexaphonicAnalyser::setSpectrumCallback(std::function<void(const float*, int)> callback)
+{
+    spectrumCallback = std::move(callback);
+}
+
+void HexaphonicAnalyser::setInputGate(bool shouldBeEnabled, float openThresholdDb, float closeThresholdDb)
+{
+    inputGateEnabled = shouldBeEnabled;
+    gateOpenThresholdDb = openThresholdDb;
+    gateCloseThresholdDb = closeThresholdDb;
+    
+    for (auto& string : strings)
+    {
+        string->fftProcessor->setInputGateEnabled(inputGateEnabled);
+        string->fftProcessor->setInputGateThresholds(gateOpenThresholdDb, gateCloseThresholdDb);
+    }
+}
+
+void HexaphonicAnalyser::setStageTimings(StageTimings* timings)
+{
+    stageTimings = timings;
+    
+    for (auto& string : strings)
+    {
+        string->fftProcessor->setStageTimings(stageTimings);
+        string->detector->setStageTimings(stageTimings);
+    }
+}
+
+void HexaphonicAnalyser::getStringRange(const PitchDetector::GuitarSettings& settings, int stringIndex,
+                                        int& lowestNote, int& highestNote)
+{
+    lowestNote = settings.openStringMidiNotes[static_cast<size_t>(stringIndex)];
+    highestNote = juce::jmin(127, lowestNote + settings.numFrets);
+}
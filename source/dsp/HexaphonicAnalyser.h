@@ -0,0 +1,177 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "AnalysisWorker.h"
+#include "InputGate.h"
+#include "PitchDetector.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class FFTProcessor;
+
+/**
+ * HexaphonicAnalyser analyses each input channel of a hexaphonic (per-string)
+ * pickup separately. Every string gets its own FFTProcessor and a PitchDetector
+ * that only holds the templates of that string's fret range and detects one note
+ * at a time, which turns one hard polyphonic problem into several cheap
+ * monophonic ones.
+ *
+ * The strings' frames line up (same FFT size, hop and input timeline), so their
+ * notes are merged per frame and reported through the frame callback as a single
+ * note set. With worker threads enabled, every string runs on its own
+ * AnalysisWorker so strings are analysed in parallel across cores; merged
+ * frames are then reported a fixed scheduling delay after they ended.
+ */
+class HexaphonicAnalyser
+{
+public:
+    /** Largest number of strings (input channels) that are analysed */
+    static constexpr int maxStrings = 8;
+    
+    HexaphonicAnalyser();
+    ~HexaphonicAnalyser();
+    
+    /**
+     * Builds the per-string analysers. Not real-time safe; call from prepareToPlay.
+     * @param source Detector whose templates (and engine settings) are split across the strings
+     * @param guitarSettings Open string notes and fret count, giving each string's note range
+     * @param numChannels Number of input channels; one string per channel, up to maxStrings
+     * @param sampleRate Sample rate of the input
+     * @param fftSize FFT size of every string's analyser
+     * @param overlapFactor FFT overlap
+     * @param useWorkerThreads True to analyse each string on its own thread
+     * @param schedulingDelay Delay, in samples, between a frame ending and its notes being reported (worker threads only)
+     */
+    void prepare(const PitchDetector& source, const PitchDetector::GuitarSettings& guitarSettings,
+                 int numChannels, double sampleRate, int fftSize, float overlapFactor,
+                 bool useWorkerThreads, int schedulingDelay);
+    
+    /**
+     * Stops the worker threads and releases the per-string analysers
+     */
+    void release();
+    
+    /**
+     * Re-splits the source detector's templates across the strings, e.g. after a
+     * profile file was loaded. Pauses the worker threads while it runs; the caller
+     * must make sure processBlock is not running at the same time.
+     * @param source Detector to copy the templates from
+     */
+    void updateProfiles(const PitchDetector& source);
+    
+    /**
+     * Stops the string worker threads, e.g. while the strings aren't analysed. They
+     * finish the frame in progress first; prepare and updateProfiles start them again.
+     */
+    void stopWorkers();
+    
+    /**
+     * Starts the string worker threads again after stopWorkers (no-op without workers)
+     */
+    void startWorkers();
+    
+    /**
+     * Analyses one block. Each channel feeds the string with the same index; merged
+     * frames that fall inside the block are reported through the frame callback.
+     * @param input Per-string input
+     * @param numSamples Number of samples in the block
+     */
+    void processBlock(const juce::AudioBuffer<float>& input, int numSamples);
+    
+    /**
+     * Sets the callback that receives the merged note events of every frame (each
+     * tagged with the string that played it), their count, and the frame's sample
+     * offset within the block passed to processBlock
+     * @param callback Function called on the audio thread
+     */
+    void setFrameCallback(std::function<void(const NoteEvent*, int, int)> callback);
+    
+    /**
+     * Sets a callback that receives the lowest string's spectrum, for display
+     * @param callback Function called from the thread analysing the lowest string
+     *                 (its worker thread, or the audio thread without workers)
+     */
+    void setSpectrumCallback(std::function<void(const float*, int)> callback);
+    
+    /**
+     * Configures the time-domain input gate of every string, so idle strings skip
+     * their FFTs. Applies to the current strings and to those built by prepare.
+     * @param shouldBeEnabled True to gate each string on its input level
+     * @param openThresholdDb Block peak (dBFS) that opens a string's gate
+     * @param closeThresholdDb Block RMS (dBFS) below which it closes again
+     */
+    void setInputGate(bool shouldBeEnabled, float openThresholdDb, float closeThresholdDb);
+    
+    /**
+     * Records every string's per-frame stage times into one set of statistics.
+     * Applies to the current strings and to those built by prepare.
+     * @param timings Shared timing statistics, or nullptr to stop timing
+     */
+    void setStageTimings(StageTimings* timings);
+    
+    /**
+     * Gets the note range of a string
+     * @param settings Guitar settings
+     * @param stringIndex String index
+     * @param lowestNote Receives the open string note
+     * @param highestNote Receives the note at the highest fret
+     */
+    static void getStringRange(const PitchDetector::GuitarSettings& settings, int stringIndex,
+                               int& lowestNote, int& highestNote);
+    
+    int getNumStrings() const { return static_cast<int>(strings.size()); }
+    bool isUsingWorkerThreads() const { return useWorkers; }
+    
+    /**
+     * Gets the delay added to the output, in samples (0 without worker threads)
+     * @return Scheduling delay
+     */
+    int getLatencySamples() const { return useWorkers ? schedulingDelay : 0; }
+    
+    /**
+     * Gets the number of frames reported after their scheduled time
+     * @return Late frame count since prepare
+     */
+    int getNumLateFrames() const { return lateFrames.load(std::memory_order_relaxed); }
+
+private:
+    struct StringChannel
+    {
+        int index = 0;                              // String (and input channel) number
+        int lowestNote = 0;
+        int highestNote = 0;
+        std::unique_ptr<FFTProcessor> fftProcessor;
+        std::unique_ptr<PitchDetector> detector;
+        std::unique_ptr<AnalysisWorker> worker;     // Result queue, and the analysis thread if enabled
+        juce::int64 chunkStart = 0;                 // Position of the chunk being analysed
+    };
+    
+    void handleStringFrame(StringChannel& string, bool isLowestString,
+                           const float* spectrum, int size, int sampleOffset);
+    void mergeFrames(juce::int64 blockStart, juce::int64 blockEnd);
+    
+    std::vector<std::unique_ptr<StringChannel>> strings;
+    bool useWorkers = false;
+    int schedulingDelay = 0;
+    juce::int64 samplePosition = 0;
+    std::atomic<int> lateFrames { 0 };
+    double preparedSampleRate = 0.0;
+    int preparedFFTSize = 0;
+    
+    bool inputGateEnabled = false;
+    float gateOpenThresholdDb = InputGate::defaultOpenThresholdDb;
+    float gateCloseThresholdDb = InputGate::defaultCloseThresholdDb;
+    
+    StageTimings* stageTimings = nullptr;
+    
+    std::vector<NoteEvent> mergedEvents;
+    std::function<void(const NoteEvent*, int, int)> frameCallback;
+    std::function<void(const float*, int)> spectrumCallback;
+    
+    // Spectra whose loudest bin is below this are treated as a silent string
+    const float silenceThreshold = 1.0e-3f;
+    
+    JUCE_DECLARE_NON_COPYABLE(HexaphonicAnalyser)
+};
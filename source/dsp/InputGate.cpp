@@ -0,0 +1,41 @@
+#include "InputGate.h"
+
+InputGate::InputGate()
+{
+    setThresholds(defaultOpenThresholdDb, defaultCloseThresholdDb);
+}
+
+void InputGate::setThresholds(float openThresholdDbParam, float closeThresholdDbParam)
+{
+    openThresholdDb = openThresholdDbParam;
+    closeThresholdDb = juce::jmin(closeThresholdDbParam, openThresholdDbParam);
+    openLevel = juce::Decibels::decibelsToGain(openThresholdDb);
+    closeLevel = juce::Decibels::decibelsToGain(closeThresholdDb);
+}
+
+void InputGate::reset()
+{
+    open = false;
+}
+
+bool InputGate::process(const float* samples, int numSamples)
+{
+    if (numSamples <= 0)
+        return open;
+    
+    if (!open)
+    {
+        // Closed: only the peak is needed, which is a single vectorised pass
+        const auto range = juce::FloatVectorOperations::findMinAndMax(samples, numSamples);
+        open = juce::jmax(-range.getStart(), range.getEnd()) >= openLevel;
+        return open;
+    }
+    
+    float sumSquares = 0.0f;
+    
+    for (int i = 0; i < numSamples; ++i)
+        sumSquares += samples[i] * samples[i];
+    
+    open = sumSquares >= closeLevel * closeLevel * static_cast<float>(numSamples);
+    return open;
+}
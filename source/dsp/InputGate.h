@@ -0,0 +1,53 @@
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+
+/**
+ * InputGate decides, block by block, whether the raw input is loud enough to be
+ * worth analysing.
+ *
+ * The gate opens when a block's peak reaches the open threshold, so attacks are
+ * caught on their first block, and stays open while the block RMS stays above
+ * the (lower) close threshold. The gap between the two thresholds is the
+ * hysteresis that keeps a decaying note from chattering around a single level.
+ */
+class InputGate
+{
+public:
+    static constexpr float defaultOpenThresholdDb = -50.0f;
+    static constexpr float defaultCloseThresholdDb = -60.0f;
+    
+    InputGate();
+    
+    /**
+     * Sets the gate thresholds
+     * @param openThresholdDb Peak level (dBFS) that opens the gate
+     * @param closeThresholdDb RMS level (dBFS) below which an open gate closes; clamped to the open threshold
+     */
+    void setThresholds(float openThresholdDb, float closeThresholdDb);
+    
+    float getOpenThresholdDb() const { return openThresholdDb; }
+    float getCloseThresholdDb() const { return closeThresholdDb; }
+    
+    /**
+     * Closes the gate
+     */
+    void reset();
+    
+    /**
+     * Measures a block and updates the gate state
+     * @param samples Input samples
+     * @param numSamples Number of samples
+     * @return True if the gate is open after this block
+     */
+    bool process(const float* samples, int numSamples);
+    
+    bool isOpen() const { return open; }
+
+private:
+    float openThresholdDb = defaultOpenThresholdDb;
+    float closeThresholdDb = defaultCloseThresholdDb;
+    float openLevel;
+    float closeLevel;
+    bool open = false;
+};
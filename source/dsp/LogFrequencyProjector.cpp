@@ -0,0 +1,110 @@
+#include "LogFrequencyProjector.h"
+
+LogFrequencyProjector::LogFrequencyProjector()
+{
+}
+
+int LogFrequencyProjector::calculateNumBins(int binsPerSemitone, float minFrequency, float maxFrequency)
+{
+    if (binsPerSemitone <= 0 || minFrequency <= 0.0f || maxFrequency <= minFrequency)
+        return 0;
+    
+    const double binsPerOctave = 12.0 * binsPerSemitone;
+    return static_cast<int>(std::floor(binsPerOctave * std::log2(static_cast<double>(maxFrequency) / minFrequency))) + 1;
+}
+
+float LogFrequencyProjector::getBinFrequency(int bin) const
+{
+    return minFrequency * std::pow(2.0f, static_cast<float>(bin) / (12.0f * static_cast<float>(binsPerSemitone)));
+}
+
+void LogFrequencyProjector::prepare(double sampleRate, int fftSize, int binsPerSemitoneParam,
+                                    float minFrequencyParam, float maxFrequencyParam)
+{
+    binsPerSemitone = binsPerSemitoneParam;
+    minFrequency = minFrequencyParam;
+    maxFrequency = maxFrequencyParam;
+    numBins = calculateNumBins(binsPerSemitone, minFrequency, maxFrequency);
+    requiredLinearSize = 0;
+    
+    weights.clear();
+    binStarts.assign(static_cast<size_t>(numBins + 1), 0);
+    
+    if (numBins == 0 || sampleRate <= 0.0 || fftSize <= 0)
+        return;
+    
+    const int linearSize = fftSize / 2;
+    const double binWidth = sampleRate / fftSize;
+    const double nyquist = sampleRate / 2.0;
+    const double binsPerOctave = 12.0 * binsPerSemitone;
+    
+    for (int b = 0; b < numBins; ++b)
+    {
+        binStarts[static_cast<size_t>(b)] = static_cast<int>(weights.size());
+        
+        const double centre = getBinFrequency(b);
+        const double lower = centre * std::pow(2.0, -1.0 / binsPerOctave);
+        const double upper = centre * std::pow(2.0, 1.0 / binsPerOctave);
+        
+        if (centre >= nyquist)
+            continue;
+        
+        if (upper - centre < binWidth)
+        {
+            // FFT bins are sparser than log bins here: interpolate at the centre frequency
+            const double position = centre / binWidth;
+            const int k = static_cast<int>(position);
+            const float fraction = static_cast<float>(position - k);
+            
+            if (k < linearSize)
+                weights.push_back({ k, 1.0f - fraction });
+            
+            if (k + 1 < linearSize && fraction > 0.0f)
+                weights.push_back({ k + 1, fraction });
+        }
+        else
+        {
+            // Triangle in log frequency, peaking at the centre and reaching zero at the neighbours' centres
+            const int first = juce::jmax(1, static_cast<int>(std::ceil(lower / binWidth)));
+            const int last = juce::jmin(linearSize - 1, static_cast<int>(std::floor(upper / binWidth)));
+            
+            for (int k = first; k <= last; ++k)
+            {
+                const double distance = std::abs(std::log2(k * binWidth / centre)) * binsPerOctave;
+                const float weight = static_cast<float>(1.0 - distance);
+                
+                if (weight > 0.0f)
+                    weights.push_back({ k, weight });
+            }
+        }
+    }
+    
+    binStarts[static_cast<size_t>(numBins)] = static_cast<int>(weights.size());
+    
+    for (const auto& w : weights)
+        requiredLinearSize = juce::jmax(requiredLinearSize, w.linearBin + 1);
+}
+
+void LogFrequencyProjector::project(const float* linearSpectrum, int linearSize, float* output) const
+{
+    // A spectrum from a different FFT size can't be mapped with these weights
+    if (linearSize < requiredLinearSize)
+    {
+        jassertfalse;
+        std::fill(output, output + numBins, 0.0f);
+        return;
+    }
+    
+    for (int b = 0; b < numBins; ++b)
+    {
+        float sum = 0.0f;
+        
+        for (int i = binStarts[static_cast<size_t>(b)]; i < binStarts[static_cast<size_t>(b + 1)]; ++i)
+        {
+            const auto& w = weights[static_cast<size_t>(i)];
+            sum += w.weight * linearSpectrum[w.linearBin];
+        }
+        
+        output[b] = sum;
+    }
+}
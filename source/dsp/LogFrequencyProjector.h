@@ -0,0 +1,81 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <vector>
+
+/**
+ * LogFrequencyProjector maps a linear FFT magnitude spectrum onto a compact
+ * log-frequency axis with a fixed number of bins per semitone.
+ *
+ * Bin b is centred at minFrequency * 2^(b / (12 * binsPerSemitone)). Where FFT
+ * bins are denser than the log bins (high frequencies), each log bin is a
+ * triangular-weighted sum of the FFT bins between its neighbours' centres; where
+ * they are sparser (low frequencies), it is interpolated at its centre. The
+ * weights are precomputed as a sparse matrix, so projecting a frame costs one
+ * multiply-add per FFT bin.
+ *
+ * The number of bins depends only on the frequency range and resolution, not on
+ * the sample rate or FFT size, so templates stored in this space can be matched
+ * against spectra from any FFT configuration.
+ */
+class LogFrequencyProjector
+{
+public:
+    static constexpr float defaultMinFrequency = 27.5f;     // A0, the lowest piano key
+    static constexpr float defaultMaxFrequency = 8000.0f;
+    
+    LogFrequencyProjector();
+    
+    /**
+     * Computes the projection weights. Not real-time safe.
+     * @param sampleRate Sample rate of the analysed audio
+     * @param fftSize FFT size; the input spectra have fftSize / 2 bins
+     * @param binsPerSemitone Frequency resolution (e.g. 3 or 5)
+     * @param minFrequency Centre frequency of the first bin
+     * @param maxFrequency Highest centre frequency; bins above Nyquist stay zero
+     */
+    void prepare(double sampleRate, int fftSize, int binsPerSemitone,
+                 float minFrequency = defaultMinFrequency, float maxFrequency = defaultMaxFrequency);
+    
+    /**
+     * Projects a linear magnitude spectrum
+     * @param linearSpectrum FFT magnitudes
+     * @param linearSize Number of magnitudes (fftSize / 2)
+     * @param output Receives getNumBins() values
+     */
+    void project(const float* linearSpectrum, int linearSize, float* output) const;
+    
+    /**
+     * Gets the number of log-frequency bins for a frequency range and resolution
+     * @return Bin count
+     */
+    static int calculateNumBins(int binsPerSemitone, float minFrequency, float maxFrequency);
+    
+    bool isPrepared() const { return numBins > 0; }
+    int getNumBins() const { return numBins; }
+    int getBinsPerSemitone() const { return binsPerSemitone; }
+    float getMinFrequency() const { return minFrequency; }
+    float getMaxFrequency() const { return maxFrequency; }
+    
+    /**
+     * Gets the centre frequency of a bin
+     * @param bin Bin index
+     * @return Frequency in Hz
+     */
+    float getBinFrequency(int bin) const;
+
+private:
+    struct Weight
+    {
+        int linearBin;
+        float weight;
+    };
+    
+    std::vector<Weight> weights;        // Non-zero weights, grouped by output bin
+    std::vector<int> binStarts;         // Index of each output bin's first weight; numBins + 1 entries
+    int numBins = 0;
+    int requiredLinearSize = 0;
+    int binsPerSemitone = 0;
+    float minFrequency = defaultMinFrequency;
+    float maxFrequency = defaultMaxFrequency;
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <type_traits>
+
+/**
+ * NoteEvent describes one note detected in an analysis frame.
+ *
+ * It is plain data, so detectors write events straight into buffers owned by the
+ * caller (a stack array, a queue slot) and downstream stages such as debouncing,
+ * velocity mapping or tablature read what the detector already measured instead
+ * of deriving it again.
+ */
+struct NoteEvent
+{
+    int midiNote = -1;
+    float confidence = 0.0f;        // Template score (cosine similarity or sparse activation)
+    float levelDb = -100.0f;        // Estimated level in dBFS; a full-scale sine is about 0 dB
+    int onsetSampleOffset = 0;      // Onset position relative to the end of this frame: 0 for a new note, negative while it sustains
+    float frequency = 0.0f;         // Estimated fundamental in Hz
+    float cents = 0.0f;             // Deviation of the fundamental from the equal-tempered note
+    int guitarString = -1;          // String of the matched template, or -1 if unknown
+    int guitarFret = -1;            // Fret of the matched template, or -1 if unknown
+};
+
+static_assert(std::is_trivially_copyable<NoteEvent>::value, "NoteEvent must stay plain data");
@@ -0,0 +1,47 @@
+#include "OnsetDetector.h"
+
+OnsetDetector::OnsetDetector()
+{
+}
+
+void OnsetDetector::prepare(int numBins)
+{
+    previousSpectrum.assign(static_cast<size_t>(juce::jmax(0, numBins)), 0.0f);
+    reset();
+}
+
+void OnsetDetector::reset()
+{
+    hasPreviousFrame = false;
+    lastFlux = 0.0f;
+}
+
+void OnsetDetector::setThreshold(float newThreshold)
+{
+    threshold = juce::jmax(0.0f, newThreshold);
+}
+
+bool OnsetDetector::process(const float* spectrum, int size)
+{
+    if (static_cast<int>(previousSpectrum.size()) != size)
+        prepare(size);
+    
+    float rise = 0.0f;
+    float total = 0.0f;
+    
+    for (int i = 0; i < size; ++i)
+    {
+        const float magnitude = spectrum[i];
+        rise += juce::jmax(0.0f, magnitude - previousSpectrum[static_cast<size_t>(i)]);
+        total += magnitude;
+        previousSpectrum[static_cast<size_t>(i)] = magnitude;
+    }
+    
+    // Relative to the frame's own level, so quiet and loud playing share one threshold
+    lastFlux = total > 1.0e-9f ? rise / total : 0.0f;
+    
+    const bool isFirstFrame = !hasPreviousFrame;
+    hasPreviousFrame = true;
+    
+    return isFirstFrame || lastFlux > threshold;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <vector>
+
+/**
+ * OnsetDetector measures spectral flux between consecutive magnitude frames and
+ * flags frames where new energy appears.
+ *
+ * The flux is the half-wave rectified bin-by-bin increase, divided by the total
+ * magnitude of the frame, so the threshold does not depend on the input level:
+ * a steady or decaying note scores close to zero, a new note scores roughly the
+ * fraction of the frame's energy it contributes.
+ */
+class OnsetDetector
+{
+public:
+    static constexpr float defaultThreshold = 0.15f;
+    
+    OnsetDetector();
+    
+    /**
+     * Allocates the previous-frame buffer and forgets any earlier frame
+     * @param numBins Size of the frames passed to process()
+     */
+    void prepare(int numBins);
+    
+    /**
+     * Forgets the previous frame, so the next one is reported as an onset
+     */
+    void reset();
+    
+    /**
+     * Sets the relative flux above which a frame counts as an onset
+     * @param newThreshold Threshold (0 flags every frame with any increase)
+     */
+    void setThreshold(float newThreshold);
+    
+    float getThreshold() const { return threshold; }
+    
+    /**
+     * Compares a frame with the previous one and remembers it for the next call.
+     * Doesn't allocate if the frame size matches prepare().
+     * @param spectrum Magnitude frame
+     * @param size Number of bins
+     * @return True if the frame is an onset (or the first frame after a reset)
+     */
+    bool process(const float* spectrum, int size);
+    
+    /**
+     * Gets the relative flux of the last frame
+     * @return Flux, 0 .. 1 for typical input
+     */
+    float getLastFlux() const { return lastFlux; }
+
+private:
+    std::vector<float> previousSpectrum;
+    bool hasPreviousFrame = false;
+    float threshold = defaultThreshold;
+    float lastFlux = 0.0f;
+};
@@ -3,11 +3,11 @@
 PitchDetector::PitchDetector(int maxNotes)
     : learningModeActive(false),
       currentLearningNote(-1),
-      maxPolyphony(maxNotes),
+      maxPolyphony(juce::jlimit(1, maxSupportedPolyphony, maxNotes)),
       requiredSpectraForLearning(10),
       instrumentType(InstrumentType::Generic),
-      currentGuitarString(0),
-      currentGuitarFret(0)
+      currentGuitarString(-1),
+      currentGuitarFret(-1)
 {
     // Set default guitar settings
     guitarSettings.openStringMidiNotes = {40, 45, 50, 55, 59, 64}; // E2, A2, D3, G3, B3, E4
@@ -20,6 +20,9 @@ PitchDetector::~PitchDetector()
 
 void PitchDetector::setLearningModeActive(bool shouldBeActive)
 {
+    if (shouldBeActive)
+        reserveLearningCapacity();
+    
     learningModeActive = shouldBeActive;
 }
 
@@ -30,6 +33,8 @@ bool PitchDetector::isLearningModeActive() const
 
 void PitchDetector::setCurrentLearningNote(int midiNote)
 {
+    // The statistics are in place before the note is, so the first frame doesn't allocate
+    profileLearner.prepareNote(midiNote);
     currentLearningNote = midiNote;
 }
 
@@ -58,240 +63,1013 @@ PitchDetector::InstrumentType PitchDetector::getInstrumentType() const
     return instrumentType;
 }
 
-std::vector<int> PitchDetector::processSpectrum(const float* spectrum, int spectrumSize)
+void PitchDetector::prepare(int spectrumSize)
 {
-    std::vector<int> detectedNotes;
+    // Size the per-frame scratch up front so detection never allocates on the audio thread
+    preparedSpectrumSize = spectrumSize;
+    normalizedInput.setSize(juce::jmax(spectrumSize, profileMatrix.getRowStride()));
+    rankedProfiles.reserve(static_cast<size_t>(maxSupportedPolyphony));
+    detectedNotes.reserve(static_cast<size_t>(maxSupportedPolyphony));
+    detectedEvents.reserve(static_cast<size_t>(maxSupportedPolyphony));
+    previousEvents.reserve(static_cast<size_t>(maxSupportedPolyphony));
+    verifiedProfiles.reserve(static_cast<size_t>(maxSupportedPolyphony));
+    onsetDetector.prepare(spectrumSize);
+    profileLearner.prepare(spectrumSize);
+    profileLearner.prepareNote(currentLearningNote);
     
-    // Convert input spectrum to vector
-    std::vector<float> spectrumVec(spectrum, spectrum + spectrumSize);
-    normalizeVector(spectrumVec);
+    if (learningModeActive)
+        reserveLearningCapacity();
+}
+
+void PitchDetector::prepare(double sampleRate, int fftSize)
+{
+    preparedSampleRate = sampleRate;
+    preparedFFTSize = fftSize;
     
-    if (learningModeActive && currentLearningNote >= 0)
+    if (logBinsPerSemitone > 0)
     {
-        // Learning mode: store the spectrum for the current note
-        addLearnedSpectrum(spectrum, spectrumSize, currentLearningNote);
-        return detectedNotes; // Return empty vector in learning mode
+        logProjector.prepare(sampleRate, fftSize, logBinsPerSemitone, logMinFrequency, logMaxFrequency);
+        projectedSpectrum.assign(static_cast<size_t>(logProjector.getNumBins()), 0.0f);
     }
-    else if (isReadyForDetection())
+    
+    prepareSalience();
+    prepare(getFeatureSize());
+}
+
+void PitchDetector::prepareSalience()
+{
+    if (preparedSampleRate <= 0.0 || preparedFFTSize <= 0)
     {
-        // Detection mode: perform polyphonic pitch detection
-        detectedNotes = detectPolyphonicPitches(spectrum, spectrumSize);
-        
-        // Call the callback if registered
-        if (noteCallback && !detectedNotes.empty())
-        {
-            noteCallback(detectedNotes);
-        }
+        salience.release();
+        return;
     }
     
+    // Harmonic positions in whichever feature space the templates use
+    if (logBinsPerSemitone > 0)
+    {
+        const float binsPerOctave = 12.0f * static_cast<float>(logBinsPerSemitone);
+        const float minFrequency = logMinFrequency;
+        salience.prepare([binsPerOctave, minFrequency](float frequency) {
+            return binsPerOctave * std::log2(frequency / minFrequency);
+        }, getFeatureSize());
+    }
+    else
+    {
+        const float binsPerHz = static_cast<float>(preparedFFTSize / preparedSampleRate);
+        salience.prepare([binsPerHz](float frequency) { return frequency * binsPerHz; }, getFeatureSize());
+    }
+}
+
+void PitchDetector::setLogFrequencyResolution(int binsPerSemitone, float maxFrequency)
+{
+    binsPerSemitone = juce::jmax(0, binsPerSemitone);
+    
+    if (binsPerSemitone == logBinsPerSemitone && (binsPerSemitone == 0 || maxFrequency == logMaxFrequency))
+        return;
+    
+    // Templates from one feature space can't be matched in another
+    clearInstrumentData();
+    logBinsPerSemitone = binsPerSemitone;
+    logMinFrequency = LogFrequencyProjector::defaultMinFrequency;
+    logMaxFrequency = maxFrequency;
+    
+    if (preparedSampleRate > 0.0)
+        prepare(preparedSampleRate, preparedFFTSize);
+}
+
+int PitchDetector::getLogFrequencyResolution() const
+{
+    return logBinsPerSemitone;
+}
+
+int PitchDetector::getFeatureSize() const
+{
+    if (logBinsPerSemitone > 0)
+        return LogFrequencyProjector::calculateNumBins(logBinsPerSemitone, logMinFrequency, logMaxFrequency);
+    
+    return preparedFFTSize / 2;
+}
+
+const float* PitchDetector::projectSpectrum(const float* spectrum, int& spectrumSize)
+{
+    if (logBinsPerSemitone <= 0)
+        return spectrum;
+    
+    // The projection weights depend on the sample rate and FFT size given to prepare()
+    if (preparedSampleRate <= 0.0 || !logProjector.isPrepared())
+        return nullptr;
+    
+    logProjector.project(spectrum, spectrumSize, projectedSpectrum.data());
+    spectrumSize = logProjector.getNumBins();
+    return projectedSpectrum.data();
+}
+
+void PitchDetector::setDetectionEngine(DetectionEngine engine)
+{
+    detectionEngine = engine;
+}
+
+PitchDetector::DetectionEngine PitchDetector::getDetectionEngine() const
+{
+    return detectionEngine;
+}
+
+void PitchDetector::setSolverIterationLimit(int maxIterations)
+{
+    solverIterationLimit = juce::jmax(1, maxIterations);
+}
+
+void PitchDetector::setSolverTolerance(float tolerance)
+{
+    solverTolerance = juce::jmax(0.0f, tolerance);
+}
+
+void PitchDetector::setSparsityPenalty(float penalty)
+{
+    sparsityPenalty = juce::jmax(0.0f, penalty);
+}
+
+int PitchDetector::getLastSolverIterations() const
+{
+    return lastSolverIterations;
+}
+
+void PitchDetector::reset()
+{
+    std::fill(previousActivations.begin(), previousActivations.end(), 0.0f);
+    hasPreviousActivations = false;
+    resetOnsetGating();
+}
+
+void PitchDetector::setOnsetGatingEnabled(bool shouldBeEnabled)
+{
+    onsetGatingEnabled = shouldBeEnabled;
+    resetOnsetGating();
+}
+
+bool PitchDetector::isOnsetGatingEnabled() const
+{
+    return onsetGatingEnabled;
+}
+
+void PitchDetector::setOnsetThreshold(float threshold)
+{
+    onsetDetector.setThreshold(threshold);
+}
+
+void PitchDetector::setMaxReusedFrames(int maxFrames)
+{
+    maxReusedFrames = juce::jmax(0, maxFrames);
+}
+
+int PitchDetector::getNumFullDetections() const
+{
+    return numFullDetections;
+}
+
+int PitchDetector::getNumReusedFrames() const
+{
+    return numReusedFrames;
+}
+
+void PitchDetector::setCandidatePruningEnabled(bool shouldBeEnabled)
+{
+    candidatePruningEnabled = shouldBeEnabled;
+}
+
+bool PitchDetector::isCandidatePruningEnabled() const
+{
+    return candidatePruningEnabled;
+}
+
+void PitchDetector::setMaxCandidateNotes(int maxNotes)
+{
+    maxCandidateNotes = juce::jmax(0, maxNotes);
+}
+
+int PitchDetector::getNumScoredProfiles() const
+{
+    return numScoredProfiles;
+}
+
+void PitchDetector::setLearningReservoirSize(int maxFramesPerNote)
+{
+    profileLearner.setReservoirCapacity(maxFramesPerNote);
+}
+
+const ProfileLearner& PitchDetector::getProfileLearner() const
+{
+    return profileLearner;
+}
+
+const std::vector<int>& PitchDetector::processSpectrum(const float* spectrum, int spectrumSize)
+{
+    processSpectrum(spectrum, spectrumSize, nullptr, 0);
     return detectedNotes;
 }
 
-void PitchDetector::addLearnedSpectrum(const float* spectrumData, int spectrumSize, int midiNote)
+int PitchDetector::processSpectrum(const float* spectrum, int spectrumSize, NoteEvent* events, int maxEvents,
+                                   juce::int64 frameEndSample)
 {
-    // Create a vector from the spectrum data
-    std::vector<float> spectrumVec(spectrumData, spectrumData + spectrumSize);
-    normalizeVector(spectrumVec);
+    detectedNotes.clear();
+    detectedEvents.clear();
+    
+    // Only detection frames are timed; the projection counts as template matching
+    const bool isLearning = learningModeActive && currentLearningNote >= 0;
+    const bool isDetecting = !isLearning && isReadyForDetection();
+    StageTimings::Stopwatch stopwatch(isDetecting ? stageTimings : nullptr);
     
-    // Add to the learned spectra for this note
-    learnedSpectraPerNote[midiNote].push_back(spectrumVec);
+    // Everything below works in the template feature space
+    const float* features = projectSpectrum(spectrum, spectrumSize);
     
-    // If we have enough spectra for this note, create an average profile
-    if (static_cast<int>(learnedSpectraPerNote[midiNote].size()) >= requiredSpectraForLearning)
+    if (features != nullptr)
     {
-        // Calculate the average spectrum for this note
-        std::vector<float> avgSpectrum(static_cast<size_t>(spectrumSize), 0.0f);        
-        for (const auto& learnedSpectrum : learnedSpectraPerNote[midiNote])
+        if (isLearning)
         {
-            for (int i = 0; i < spectrumSize; ++i)
-            {
-                avgSpectrum[static_cast<size_t>(i)] += learnedSpectrum[static_cast<size_t>(i)];            }
+            // Learning mode: store the spectrum for the current note; nothing is detected
+            addLearnedSpectrum(features, spectrumSize, currentLearningNote, getLearningPosition(currentLearningNote));
         }
-        
-        // Normalize the average
-        for (float& value : avgSpectrum)
+        else if (isDetecting)
         {
-            value /= learnedSpectraPerNote[midiNote].size();
+            // Detection mode: perform polyphonic pitch detection
+            detectPolyphonicPitches(features, spectrumSize, stopwatch);
         }
+    }
+    
+    trackNoteOnsets(frameEndSample);
+    
+    for (const auto& event : detectedEvents)
+        detectedNotes.push_back(event.midiNote);
+    
+    if (features != nullptr)
+        stopwatch.lap(StageTimings::Stage::decision);
+    
+    // Call the callbacks if registered
+    if (!detectedEvents.empty())
+    {
+        if (noteCallback)
+            noteCallback(detectedNotes);
         
-        normalizeVector(avgSpectrum);
+        if (noteEventCallback)
+            noteEventCallback(detectedEvents.data(), static_cast<int>(detectedEvents.size()));
+    }
+    
+    const int numEvents = juce::jmin(static_cast<int>(detectedEvents.size()), juce::jmax(0, maxEvents));
+    
+    if (events != nullptr)
+        std::copy(detectedEvents.begin(), detectedEvents.begin() + numEvents, events);
+    
+    return numEvents;
+}
+
+void PitchDetector::trackNoteOnsets(juce::int64 frameEndSample)
+{
+    // A note's onset is the end of the first frame it was detected in, so a sustained
+    // note reports how long ago it started
+    for (auto& event : detectedEvents)
+    {
+        if (!juce::isPositiveAndBelow(event.midiNote, HarmonicSalience::numMidiNotes))
+            continue;
         
-        // Store as a learned profile
-        SpectralProfile profile;
-        profile.midiNote = midiNote;
-        profile.spectrum = avgSpectrum;
-        profile.noteName = midiNoteToName(midiNote);
+        const auto index = static_cast<size_t>(event.midiNote);
         
-        // Remove any existing profile for this note
-        learnedProfiles.erase(
-            std::remove_if(learnedProfiles.begin(), learnedProfiles.end(),
-                          [midiNote](const SpectralProfile& p) { return p.midiNote == midiNote; }),
-            learnedProfiles.end());
+        if (!noteWasDetected[index])
+            noteOnsetSamples[index] = frameEndSample;
         
-        // Add the new profile
-        learnedProfiles.push_back(profile);
+        const juce::int64 age = juce::jmax(juce::int64(0), frameEndSample - noteOnsetSamples[index]);
+        event.onsetSampleOffset = -static_cast<int>(juce::jmin(age, juce::int64(std::numeric_limits<int>::max())));
+    }
+    
+    noteWasDetected.fill(false);
+    
+    for (const auto& event : detectedEvents)
+        if (juce::isPositiveAndBelow(event.midiNote, HarmonicSalience::numMidiNotes))
+            noteWasDetected[static_cast<size_t>(event.midiNote)] = true;
+}
+
+void PitchDetector::addLearnedSpectrum(const float* spectrumData, int spectrumSize, int midiNote, GuitarPosition position)
+{
+    if (spectrumSize != preparedSpectrumSize || normalizedInput.getSize() < spectrumSize)
+        prepare(spectrumSize);
+    
+    if (!juce::isPositiveAndBelow(midiNote, ProfileLearner::numMidiNotes))
+        return;
+    
+    // The statistics are kept per note, so playing the note somewhere else starts them afresh
+    auto& learnerPosition = learnerPositions[static_cast<size_t>(midiNote)];
+    
+    if (learnerPosition != position)
+    {
+        profileLearner.restartNote(midiNote);
+        learnerPosition = position;
+    }
+    
+    // Normalize the frame in the scratch buffer and fold it into the running statistics
+    float* frame = normalizedInput.data();
+    std::copy(spectrumData, spectrumData + spectrumSize, frame);
+    normalizeBuffer(frame, spectrumSize);
+    profileLearner.addFrame(midiNote, frame, spectrumSize);
+    
+    // Once we have enough frames for this note, its profile tracks the running mean
+    if (profileLearner.getNumFrames(midiNote) >= requiredSpectraForLearning)
+    {
+        const int numBins = profileLearner.getNumBins();
+        std::copy(profileLearner.getMean(midiNote), profileLearner.getMean(midiNote) + numBins, frame);
+        normalizeBuffer(frame, numBins);
+        
+        // Store as a learned profile, replacing any existing profile for this note at this position
+        auto existing = std::find_if(learnedProfiles.begin(), learnedProfiles.end(),
+                                     [midiNote, position](const SpectralProfile& p) {
+                                         return p.midiNote == midiNote && p.guitarString == position.string
+                                             && p.guitarFret == position.fret;
+                                     });
+        
+        if (existing != learnedProfiles.end())
+        {
+            // Only this template changed, so the set of profiles and the scratch sizes stay as they are
+            const int row = static_cast<int>(existing - learnedProfiles.begin());
+            profileMatrix.setRow(row, frame, numBins);
+            updateGramMatrix(row);
+            hasPreviousActivations = false;
+            resetOnsetGating();
+        }
+        else if (getNumProfiles() < learningCapacity)
+        {
+            addProfileRow(midiNote, frame, numBins, position.string, position.fret);
+        }
     }
 }
 
-std::vector<int> PitchDetector::detectPolyphonicPitches(const float* spectrum, int spectrumSize)
+PitchDetector::GuitarPosition PitchDetector::getLearningPosition(int midiNote) const
 {
+    // A position only describes the note if that string and fret actually play it
+    const auto& openStrings = guitarSettings.openStringMidiNotes;
+    
+    if (juce::isPositiveAndBelow(currentGuitarString, static_cast<int>(openStrings.size())) && currentGuitarFret >= 0
+        && openStrings[static_cast<size_t>(currentGuitarString)] + currentGuitarFret == midiNote)
+        return { currentGuitarString, currentGuitarFret };
+    
+    return {};
+}
+
+void PitchDetector::detectPolyphonicPitches(const float* spectrum, int spectrumSize, StageTimings::Stopwatch& stopwatch)
+{
+    detectedEvents.clear();
+    
     if (learnedProfiles.empty())
     {
-        return {};
+        stopwatch.lap(StageTimings::Stage::templateMatching);
+        return;
     }
     
-    // Convert input spectrum to vector
-    std::vector<float> inputSpectrum(spectrum, spectrum + spectrumSize);
-    normalizeVector(inputSpectrum);
+    if (spectrumSize != preparedSpectrumSize || normalizedInput.getSize() < profileMatrix.getRowStride())
+        prepare(spectrumSize);
     
-    // Perform sparse encoding to find the most similar learned profiles
-    std::vector<float> coefficients = sparseEncode(inputSpectrum);
+    // Flux is measured on the raw magnitudes, since normalizing would hide new energy
+    const bool isOnset = onsetGatingEnabled && onsetDetector.process(spectrum, spectrumSize);
     
-    // Sort the coefficients and find the indices of the top values
-    std::vector<std::pair<float, int>> coefPairs;
-    for (size_t i = 0; i < coefficients.size(); ++i)
+    // Normalize a copy of the input spectrum into the preallocated, SIMD-aligned scratch
+    // buffer; bins beyond the template width stay zero so they don't affect the products
+    std::copy(spectrum, spectrum + spectrumSize, normalizedInput.data());
+    const float frameMagnitude = normalizeBuffer(normalizedInput.data(), spectrumSize);
+    
+    // No onset: keep the previous notes if each still matches its template. Their
+    // levels are re-estimated, so a decaying note is followed down.
+    if (onsetGatingEnabled && !isOnset && canReusePreviousResult())
     {
-        coefPairs.emplace_back(coefficients[i], static_cast<int>(i));
+        stopwatch.lap(StageTimings::Stage::templateMatching);
+        detectedEvents = previousEvents;
+        measureNotes(spectrum, spectrumSize, frameMagnitude);
+        ++framesSinceFullDetection;
+        ++numReusedFrames;
+        return;
     }
     
-    // Sort in descending order of coefficient values
-    std::sort(coefPairs.begin(), coefPairs.end(),
-              [](const auto& a, const auto& b) { return a.first > b.first; });
+    // Perform sparse encoding to find the most similar learned profiles, restricted to
+    // the shortlisted templates when the salience pre-pass could rule most notes out
+    candidatesActive = selectCandidateProfiles(spectrumSize);
     
-    // Select the top notes, up to maxPolyphony
-    std::vector<int> detectedNotes;
+    if (candidatesActive)
+    {
+        std::fill(coefficients.begin(), coefficients.end(), 0.0f);
+        
+        for (int row : candidateRows)
+            coefficients[static_cast<size_t>(row)] = profileMatrix.dotRow(row, normalizedInput.data());
+        
+        numScoredProfiles = static_cast<int>(candidateRows.size());
+    }
+    else
+    {
+        sparseEncode(normalizedInput.data());
+        numScoredProfiles = static_cast<int>(coefficients.size());
+    }
+    
+    if (detectionEngine == DetectionEngine::SparseActivations)
+        solveActivations();
     
-    for (int i = 0; i < std::min(maxPolyphony, static_cast<int>(coefPairs.size())); ++i)
+    stopwatch.lap(StageTimings::Stage::templateMatching);
+    
+    // Keep the strongest coefficients above the threshold, up to maxPolyphony, in
+    // descending order. Only a handful are kept, so an insertion pass is cheaper than sorting
+    rankedProfiles.clear();
+    
+    for (size_t i = 0; i < coefficients.size(); ++i)
     {
-        // Only include notes with coefficients above the threshold
-        if (coefPairs[static_cast<size_t>(i)].first >= minimumCoefficient)
+        const float coefficient = coefficients[i];
+        
+        if (coefficient < minimumCoefficient)
+            continue;
+        
+        if (static_cast<int>(rankedProfiles.size()) < maxPolyphony)
+            rankedProfiles.emplace_back(coefficient, static_cast<int>(i));
+        else if (coefficient > rankedProfiles.back().first)
+            rankedProfiles.back() = { coefficient, static_cast<int>(i) };
+        else
+            continue;
+        
+        for (size_t j = rankedProfiles.size() - 1; j > 0 && rankedProfiles[j].first > rankedProfiles[j - 1].first; --j)
+            std::swap(rankedProfiles[j], rankedProfiles[j - 1]);
+    }
+    
+    verifiedProfiles.clear();
+    
+    for (const auto& ranked : rankedProfiles)
+    {
+        int midiNote = learnedProfiles[static_cast<size_t>(ranked.second)].midiNote;
+        
+        // Check for octave errors or close notes (avoid duplicates)
+        bool tooClose = false;
+        for (const auto& existing : detectedEvents)
         {
-            int profileIndex = coefPairs[static_cast<size_t>(i)].second;
-            int midiNote = learnedProfiles[static_cast<size_t>(profileIndex)].midiNote;
-            
-            // Check for octave errors or close notes (avoid duplicates)
-            bool tooClose = false;
-            for (int existingNote : detectedNotes)
+            int semitoneDistance = std::abs(existing.midiNote - midiNote);
+            if (semitoneDistance < maximumSemitoneDistance)
             {
-                int semitoneDistance = std::abs(existingNote - midiNote);
-                if (semitoneDistance < maximumSemitoneDistance)
-                {
-                    tooClose = true;
-                    break;
-                }
+                tooClose = true;
+                break;
             }
+        }
+        
+        if (!tooClose)
+        {
+            const auto& profile = learnedProfiles[static_cast<size_t>(ranked.second)];
             
-            if (!tooClose)
-            {
-                detectedNotes.push_back(midiNote);
-            }
+            NoteEvent event;
+            event.midiNote = midiNote;
+            event.confidence = ranked.first;
+            event.guitarString = profile.guitarString;
+            event.guitarFret = profile.guitarFret;
+            detectedEvents.push_back(event);
+            verifiedProfiles.emplace_back(ranked.second, 0.0f);
         }
     }
     
-    return detectedNotes;
+    measureNotes(spectrum, spectrumSize, frameMagnitude);
+    rememberDetectionResult();
+}
+
+void PitchDetector::measureNotes(const float* spectrum, int spectrumSize, float frameMagnitude)
+{
+    // An unnormalized Hann-windowed FFT puts a full-scale sine at fftSize / 4
+    const int fftSize = preparedFFTSize > 0 ? preparedFFTSize : 2 * spectrumSize;
+    const float fullScaleMagnitude = juce::jmax(1.0f, 0.25f * static_cast<float>(fftSize));
+    const bool hasPartials = salience.isPrepared() && salience.getNumBins() == spectrumSize;
+    
+    for (auto& event : detectedEvents)
+    {
+        // Templates are unit length, so the activation times the frame's length is the
+        // magnitude of the note's share of the frame
+        float magnitude = event.confidence * frameMagnitude;
+        
+        // The activation is shared between overlapping templates; the partials say how
+        // much energy is actually at this note's frequencies
+        if (hasPartials)
+        {
+            magnitude = std::sqrt(magnitude * salience.getPartialMagnitude(spectrum, event.midiNote));
+            event.cents = salience.estimateTuning(spectrum, event.midiNote);
+        }
+        
+        event.levelDb = juce::Decibels::gainToDecibels(magnitude / fullScaleMagnitude);
+        event.frequency = 440.0f * std::pow(2.0f, (static_cast<float>(event.midiNote - 69) + 0.01f * event.cents) / 12.0f);
+    }
+}
+
+bool PitchDetector::canReusePreviousResult() const
+{
+    if (!hasDetectionResult || framesSinceFullDetection >= maxReusedFrames)
+        return false;
+    
+    // Cheap check: one dot product per held note instead of one per template
+    for (const auto& verified : verifiedProfiles)
+    {
+        if (profileMatrix.dotRow(verified.first, normalizedInput.data()) < verificationRatio * verified.second)
+            return false;
+    }
+    
+    return true;
+}
+
+void PitchDetector::rememberDetectionResult()
+{
+    // Cosine scores for the verification pass; the sparse engine's activations aren't comparable
+    for (auto& verified : verifiedProfiles)
+        verified.second = profileMatrix.dotRow(verified.first, normalizedInput.data());
+    
+    previousEvents = detectedEvents;
+    hasDetectionResult = true;
+    framesSinceFullDetection = 0;
+    ++numFullDetections;
+}
+
+void PitchDetector::resetOnsetGating()
+{
+    onsetDetector.reset();
+    hasDetectionResult = false;
+    framesSinceFullDetection = 0;
+    verifiedProfiles.clear();
+    previousEvents.clear();
+    noteWasDetected.fill(false);
+    numFullDetections = 0;
+    numReusedFrames = 0;
 }
 
 void PitchDetector::normalizeVector(std::vector<float>& vec)
+{
+    normalizeBuffer(vec.data(), static_cast<int>(vec.size()));
+}
+
+float PitchDetector::normalizeBuffer(float* data, int size)
 {
     // Calculate the L2 norm (Euclidean length) of the vector
     float sumSquares = 0.0f;
-    for (float val : vec)
+    for (int i = 0; i < size; ++i)
     {
-        sumSquares += val * val;
+        sumSquares += data[i] * data[i];
     }
     
+    const float norm = std::sqrt(sumSquares);
+    
     if (sumSquares > 0.0f)
     {
-        float norm = std::sqrt(sumSquares);
-        for (float& val : vec)
+        for (int i = 0; i < size; ++i)
         {
-            val /= norm;
+            data[i] /= norm;
         }
     }
+    
+    return norm;
 }
 
-std::vector<float> PitchDetector::sparseEncode(const std::vector<float>& input)
+bool PitchDetector::selectCandidateProfiles(int spectrumSize)
 {
-    // Simple implementation of sparse encoding using cosine similarity
-    // In a more advanced implementation, this would use an L1-regularized solver
+    if (!candidatePruningEnabled || !salience.isPrepared() || salience.getNumBins() != spectrumSize)
+        return false;
     
-    std::vector<float> coefficients;
+    // With only a few distinct notes there is nothing worth pruning
+    const int limit = maxCandidateNotes > 0 ? maxCandidateNotes : juce::jmax(minimumCandidateNotes, 2 * maxPolyphony);
     
-    for (const auto& profile : learnedProfiles)
+    if (limit >= static_cast<int>(profileNotes.size()))
+        return false;
+    
+    salience.selectCandidates(normalizedInput.data(), profileNotes, limit, candidateNotes);
+    
+    // Harmonic sums also favour the octave below (and confuse the octave above), so
+    // the octave neighbours of every candidate are scored as well
+    noteIsCandidate.fill(false);
+    candidateRows.clear();
+    
+    for (int note : candidateNotes)
+    {
+        for (int neighbour : { note - 12, note, note + 12 })
+        {
+            if (neighbour < 0 || neighbour >= HarmonicSalience::numMidiNotes || noteIsCandidate[static_cast<size_t>(neighbour)])
+                continue;
+            
+            noteIsCandidate[static_cast<size_t>(neighbour)] = true;
+            
+            for (int k = noteRowOffsets[static_cast<size_t>(neighbour)]; k < noteRowOffsets[static_cast<size_t>(neighbour) + 1]; ++k)
+                candidateRows.push_back(profileRowsByNote[static_cast<size_t>(k)]);
+        }
+    }
+    
+    return true;
+}
+
+void PitchDetector::sparseEncode(const float* input)
+{
+    // Cosine similarity against every template; the sparse engine refines it in solveActivations
+    profileMatrix.multiply(input, coefficients.data());
+}
+
+void PitchDetector::solveActivations()
+{
+    // Non-negative least squares for x ~ W h with an L1 penalty, solved with
+    // multiplicative updates: h <- h * (W'x) / (W'W h + lambda).
+    // On entry coefficients holds W'x; on exit it holds the activations h.
+    // Working with the Gram matrix W'W keeps each iteration at profiles^2
+    // operations, independent of the number of spectrum bins. When the frame has
+    // been pruned, only the candidate templates take part and the rest stay zero.
+    const int numProfiles = static_cast<int>(coefficients.size());
+    jassert(gramMatrix.getNumRows() == numProfiles);
+    const int numActive = candidatesActive ? static_cast<int>(candidateRows.size()) : numProfiles;
+    auto activeRow = [this](int k) { return candidatesActive ? candidateRows[static_cast<size_t>(k)] : k; };
+    float* h = activations.data();
+    
+    if (candidatesActive)
+        std::fill(h, h + numProfiles, 0.0f);
+    
+    // Warm start from the previous frame's activations; the floor lets notes
+    // that were silent in the last frame grow again
+    for (int k = 0; k < numActive; ++k)
+    {
+        const int i = activeRow(k);
+        const float start = hasPreviousActivations ? previousActivations[static_cast<size_t>(i)]
+                                                   : coefficients[static_cast<size_t>(i)];
+        h[i] = juce::jmax(start, activationFloor);
+    }
+    
+    lastSolverIterations = 0;
+    
+    while (lastSolverIterations < solverIterationLimit)
     {
-        // Calculate the dot product (cosine similarity for normalized vectors)
-        float similarity = 0.0f;
-        for (size_t i = 0; i < std::min(input.size(), profile.spectrum.size()); ++i)
+        ++lastSolverIterations;
+        
+        if (candidatesActive)
+        {
+            // Gram product over the candidates only: numActive^2 instead of profiles^2
+            for (int k = 0; k < numActive; ++k)
+            {
+                const float* gramRow = gramMatrix.getRow(activeRow(k));
+                float sum = 0.0f;
+                
+                for (int j = 0; j < numActive; ++j)
+                    sum += gramRow[activeRow(j)] * h[activeRow(j)];
+                
+                gramProduct[static_cast<size_t>(activeRow(k))] = sum;
+            }
+        }
+        else
+        {
+            gramMatrix.multiply(h, gramProduct.data());
+        }
+        
+        float maxChange = 0.0f;
+        float maxActivation = 0.0f;
+        
+        for (int k = 0; k < numActive; ++k)
         {
-            similarity += input[i] * profile.spectrum[i];
+            const int i = activeRow(k);
+            const float numerator = juce::jmax(coefficients[static_cast<size_t>(i)], 0.0f);
+            const float updated = h[i] * numerator / (gramProduct[static_cast<size_t>(i)] + sparsityPenalty + 1.0e-9f);
+            
+            maxChange = juce::jmax(maxChange, std::abs(updated - h[i]));
+            maxActivation = juce::jmax(maxActivation, updated);
+            h[i] = updated;
         }
         
-        coefficients.push_back(similarity);
+        // Stop early once the largest update is small relative to the strongest activation
+        if (maxChange <= solverTolerance * maxActivation)
+            break;
     }
     
-    return coefficients;
+    std::copy(h, h + numProfiles, previousActivations.begin());
+    std::copy(h, h + numProfiles, coefficients.begin());
+    hasPreviousActivations = true;
+}
+
+void PitchDetector::rebuildGramMatrix()
+{
+    // Gram matrix of the templates: entry (i, j) is the dot product of profiles i and j.
+    // Template rows are already aligned and zero-padded, so each can be used as the input
+    const int numProfiles = profileMatrix.getNumRows();
+    gramProduct.resize(static_cast<size_t>(numProfiles));
+    
+    gramMatrix.clear();
+    gramMatrix.reserve(numProfiles, numProfiles);
+    
+    for (int i = 0; i < numProfiles; ++i)
+    {
+        profileMatrix.multiply(profileMatrix.getRow(i), gramProduct.data());
+        gramMatrix.addRow(gramProduct.data(), numProfiles);
+    }
+}
+
+void PitchDetector::updateGramMatrix(int changedRow)
+{
+    // Changing or appending one template only changes its row and column of the Gram
+    // matrix: one matrix-vector product instead of a rebuild. Learning calls this on the
+    // audio thread for every frame, so detection never finds the matrix out of date.
+    const int numProfiles = profileMatrix.getNumRows();
+    gramProduct.resize(static_cast<size_t>(numProfiles));
+    
+    if (gramMatrix.getNumRows() < numProfiles)
+    {
+        gramMatrix.setNumBins(numProfiles);
+        
+        while (gramMatrix.getNumRows() < numProfiles)
+            gramMatrix.addRow(gramProduct.data(), 0);
+    }
+    
+    profileMatrix.multiply(profileMatrix.getRow(changedRow), gramProduct.data());
+    gramMatrix.setRow(changedRow, gramProduct.data(), numProfiles);
+    
+    for (int i = 0; i < numProfiles; ++i)
+        gramMatrix.setValue(i, changedRow, gramProduct[static_cast<size_t>(i)]);
+}
+
+void PitchDetector::profilesChanged()
+{
+    // Learning calls this on the audio thread when it adds a template; within the
+    // capacity reserveLearningCapacity set aside, none of the resizes below allocate
+    const size_t numProfiles = learnedProfiles.size();
+    
+    coefficients.resize(numProfiles);
+    gramProduct.resize(numProfiles);
+    previousActivations.assign(numProfiles, 0.0f);
+    activations.setSize(static_cast<int>(numProfiles));
+    hasPreviousActivations = false;
+    resetOnsetGating();
+    
+    // Index the templates by note for the candidate shortlist: count each note's
+    // rows, turn the counts into offsets, then place the rows
+    noteRowOffsets.fill(0);
+    
+    for (const auto& profile : learnedProfiles)
+        if (juce::isPositiveAndBelow(profile.midiNote, HarmonicSalience::numMidiNotes))
+            ++noteRowOffsets[static_cast<size_t>(profile.midiNote) + 1];
+    
+    profileNotes.clear();
+    
+    for (size_t note = 0; note < static_cast<size_t>(HarmonicSalience::numMidiNotes); ++note)
+    {
+        if (noteRowOffsets[note + 1] > 0)
+            profileNotes.push_back(static_cast<int>(note));
+        
+        noteRowOffsets[note + 1] += noteRowOffsets[note];
+    }
+    
+    std::array<int, HarmonicSalience::numMidiNotes> nextRow;
+    std::copy(noteRowOffsets.begin(), noteRowOffsets.end() - 1, nextRow.begin());
+    profileRowsByNote.resize(static_cast<size_t>(noteRowOffsets.back()));
+    
+    for (size_t i = 0; i < numProfiles; ++i)
+    {
+        const int note = learnedProfiles[i].midiNote;
+        
+        if (juce::isPositiveAndBelow(note, HarmonicSalience::numMidiNotes))
+            profileRowsByNote[static_cast<size_t>(nextRow[static_cast<size_t>(note)]++)] = static_cast<int>(i);
+    }
+    
+    candidateNotes.reserve(static_cast<size_t>(HarmonicSalience::numMidiNotes));
+    candidateRows.reserve(numProfiles);
+    
+    if (normalizedInput.getSize() < profileMatrix.getRowStride())
+        normalizedInput.setSize(profileMatrix.getRowStride());
+}
+
+int PitchDetector::addProfile(int midiNote, const float* spectrum, int spectrumSize, int guitarString, int guitarFret)
+{
+    const float* features = projectSpectrum(spectrum, spectrumSize);
+    
+    if (features == nullptr)
+        return -1;
+    
+    std::vector<float> normalized(features, features + spectrumSize);
+    normalizeVector(normalized);
+    
+    return addProfileRow(midiNote, normalized.data(), spectrumSize, guitarString, guitarFret);
+}
+
+int PitchDetector::addProfileRow(int midiNote, const float* spectrum, int spectrumSize, int guitarString, int guitarFret)
+{
+    SpectralProfile profile;
+    profile.midiNote = midiNote;
+    profile.guitarString = guitarString;
+    profile.guitarFret = guitarFret;
+    
+    learnedProfiles.push_back(profile);
+    const int row = profileMatrix.addRow(spectrum, spectrumSize);
+    profilesChanged();
+    updateGramMatrix(row);
+    
+    return row;
+}
+
+void PitchDetector::reserveLearningCapacity()
+{
+    // Everything a new template grows is sized here, on the caller's thread, so
+    // learning on the audio thread doesn't allocate until learningHeadroom templates
+    // were added. Capacities round up to a power of two, so turning learning on again
+    // after a few new templates rarely reallocates.
+    learningCapacity = juce::nextPowerOfTwo(getNumProfiles() + learningHeadroom);
+    const auto capacity = static_cast<size_t>(learningCapacity);
+    
+    learnedProfiles.reserve(capacity);
+    profileMatrix.reserve(learningCapacity, getFeatureSize());
+    gramMatrix.reserve(learningCapacity, learningCapacity);
+    coefficients.reserve(capacity);
+    gramProduct.reserve(capacity);
+    previousActivations.reserve(capacity);
+    activations.reserve(learningCapacity);
+    profileRowsByNote.reserve(capacity);
+    profileNotes.reserve(static_cast<size_t>(HarmonicSalience::numMidiNotes));
+    candidateNotes.reserve(static_cast<size_t>(HarmonicSalience::numMidiNotes));
+    candidateRows.reserve(capacity);
+}
+
+int PitchDetector::copyProfilesFrom(const PitchDetector& source, int lowestNote, int highestNote)
+{
+    clearInstrumentData();
+    
+    detectionEngine = source.detectionEngine;
+    solverIterationLimit = source.solverIterationLimit;
+    solverTolerance = source.solverTolerance;
+    sparsityPenalty = source.sparsityPenalty;
+    onsetGatingEnabled = source.onsetGatingEnabled;
+    onsetDetector.setThreshold(source.onsetDetector.getThreshold());
+    maxReusedFrames = source.maxReusedFrames;
+    preparedSampleRate = source.preparedSampleRate;
+    preparedFFTSize = source.preparedFFTSize;
+    logBinsPerSemitone = source.logBinsPerSemitone;
+    logMinFrequency = source.logMinFrequency;
+    logMaxFrequency = source.logMaxFrequency;
+    logProjector = source.logProjector;
+    salience = source.salience;
+    candidatePruningEnabled = source.candidatePruningEnabled;
+    maxCandidateNotes = source.maxCandidateNotes;
+    projectedSpectrum.assign(source.projectedSpectrum.size(), 0.0f);
+    
+    const int numBins = source.profileMatrix.getNumBins();
+    
+    for (size_t i = 0; i < source.learnedProfiles.size(); ++i)
+    {
+        const auto& profile = source.learnedProfiles[i];
+        
+        if (profile.midiNote < lowestNote || profile.midiNote > highestNote)
+            continue;
+        
+        // Source rows are already normalized
+        addProfileRow(profile.midiNote, source.profileMatrix.getRow(static_cast<int>(i)), numBins,
+                      profile.guitarString, profile.guitarFret);
+    }
+    
+    return getNumProfiles();
+}
+
+int PitchDetector::getNumProfiles() const
+{
+    return static_cast<int>(learnedProfiles.size());
 }
 
 bool PitchDetector::saveInstrumentData(const juce::String& filePath)
 {
-    // Use simpler file-based approach for now
+    std::vector<ProfileFile::ProfileInfo> profiles;
+    profiles.reserve(learnedProfiles.size());
+    
+    for (const auto& profile : learnedProfiles)
+    {
+        ProfileFile::ProfileInfo info;
+        info.midiNote = profile.midiNote;
+        info.guitarString = profile.guitarString;
+        info.guitarFret = profile.guitarFret;
+        profiles.push_back(info);
+    }
+    
+    ProfileFile::LogFrequencyAxis logAxis;
+    
+    if (logBinsPerSemitone > 0)
+    {
+        logAxis.minFrequency = logMinFrequency;
+        logAxis.maxFrequency = logMaxFrequency;
+        logAxis.binsPerSemitone = static_cast<juce::uint32>(logBinsPerSemitone);
+    }
+    
+    // The whole file is built in memory and written in one go, replacing any previous file
+    const auto fileData = ProfileFile::createFileData(preparedSampleRate, preparedFFTSize,
+                                                      logBinsPerSemitone > 0 ? ProfileFile::BinLayout::LogFrequency
+                                                                             : ProfileFile::BinLayout::LinearMagnitude,
+                                                      profiles, profileMatrix, logAxis);
+    
+    return juce::File(filePath).replaceWithData(fileData.getData(), fileData.getSize());
+}
+
+bool PitchDetector::loadInstrumentData(const juce::String& filePath)
+{
     juce::File file(filePath);
-    juce::FileOutputStream outStream(file);
     
-    if (!outStream.openedOk())
+    if (!file.existsAsFile())
         return false;
     
-    // Write the number of profiles
-    outStream.writeInt(static_cast<int>(learnedProfiles.size()));
+    // Files written before the versioned format have no header
+    {
+        juce::FileInputStream inStream(file);
+        juce::uint32 magic = 0;
+        
+        if (!inStream.openedOk())
+            return false;
+        
+        if (inStream.read(&magic, sizeof(magic)) != sizeof(magic) || !ProfileFile::hasMagicNumber(&magic, sizeof(magic)))
+            return loadLegacyInstrumentData(file);
+    }
     
-    for (const auto& profile : learnedProfiles)
+    auto profileFile = std::make_unique<ProfileFile>();
+    auto result = profileFile->open(file);
+    
+    // Log-frequency templates work with any FFT configuration; linear ones need the same bins
+    const bool isLogFrequency = result.wasOk() && profileFile->getBinLayout() == ProfileFile::BinLayout::LogFrequency;
+    
+    if (result.wasOk() && !isLogFrequency && preparedFFTSize > 0 && profileFile->getFFTSize() > 0
+        && (profileFile->getFFTSize() != preparedFFTSize
+            || std::abs(profileFile->getSampleRate() - preparedSampleRate) > 0.5))
+    {
+        result = juce::Result::fail("Profiles were learned at " + juce::String(profileFile->getSampleRate()) + " Hz, FFT size "
+                                    + juce::String(profileFile->getFFTSize()));
+    }
+    
+    if (result.failed())
+    {
+        juce::Logger::writeToLog("Could not load instrument data: " + result.getErrorMessage());
+        return false;
+    }
+    
+    clearInstrumentData();
+    
+    // The file decides the feature space
+    const auto& logAxis = profileFile->getLogFrequencyAxis();
+    logBinsPerSemitone = isLogFrequency ? static_cast<int>(logAxis.binsPerSemitone) : 0;
+    
+    if (isLogFrequency)
+    {
+        logMinFrequency = logAxis.minFrequency;
+        logMaxFrequency = logAxis.maxFrequency;
+    }
+    
+    if (preparedSampleRate > 0.0)
+        prepare(preparedSampleRate, preparedFFTSize);
+    
+    for (int i = 0; i < profileFile->getNumProfiles(); ++i)
     {
-        // Write MIDI note
-        outStream.writeInt(profile.midiNote);
+        const auto& info = profileFile->getProfileInfo(i);
         
-        // Write note name length and string
-        outStream.writeInt(static_cast<int>(profile.noteName.length()));        
-        // Write spectrum size and data
-        outStream.writeInt(static_cast<int>(profile.spectrum.size()));
-        for (float val : profile.spectrum)
-        {
-            outStream.writeFloat(val);
-        }
+        SpectralProfile profile;
+        profile.midiNote = info.midiNote;
+        profile.guitarString = info.guitarString;
+        profile.guitarFret = info.guitarFret;
+        learnedProfiles.push_back(profile);
     }
     
+    // Use the mapped templates directly; the matrix copies them if it is ever modified
+    profileMatrix.useExternalData(profileFile->getMatrixData(), profileFile->getNumProfiles(),
+                                  profileFile->getNumBins(), profileFile->getRowStride());
+    loadedProfileFile = std::move(profileFile);
+    
+    profilesChanged();
+    rebuildGramMatrix();
+    
+    // Learning more templates copies the mapped ones; better here than on the audio thread
+    if (learningModeActive)
+        reserveLearningCapacity();
+    
     return true;
 }
 
-bool PitchDetector::loadInstrumentData(const juce::String& filePath)
+bool PitchDetector::loadLegacyInstrumentData(const juce::File& file)
 {
-    juce::File file(filePath);
+    // Legacy layout: count, then per profile the MIDI note, the note name length
+    // (the name itself was never written), the spectrum size and the spectrum
     juce::FileInputStream inStream(file);
     
     if (!inStream.openedOk())
         return false;
     
-    clearInstrumentData();
+    const int numProfiles = inStream.readInt();
+    const juce::int64 bytesPerValue = 4;
+    
+    if (numProfiles < 0 || numProfiles > inStream.getNumBytesRemaining() / (3 * bytesPerValue))
+        return false;
     
-    // Read number of profiles
-    int numProfiles = inStream.readInt();
+    clearInstrumentData();
+    logBinsPerSemitone = 0;
+    prepareSalience();
+    std::vector<float> spectrum;
     
     for (int i = 0; i < numProfiles; ++i)
     {
-        SpectralProfile profile;
+        const int midiNote = inStream.readInt();
+        inStream.readInt(); // Note name length
+        const int spectrumSize = inStream.readInt();
         
-        // Read MIDI note
-        profile.midiNote = inStream.readInt();
-        
-        // Read note name
-        
-        // Read spectrum
-        int spectrumSize = inStream.readInt();
-        profile.spectrum.resize(static_cast<size_t>(spectrumSize));        
-        for (int j = 0; j < spectrumSize; ++j)
+        if (!juce::isPositiveAndBelow(midiNote, 128)
+            || spectrumSize <= 0 || spectrumSize > inStream.getNumBytesRemaining() / bytesPerValue)
         {
-            profile.spectrum[static_cast<size_t>(j)] = inStream.readFloat();        }
+            clearInstrumentData();
+            return false;
+        }
         
-        learnedProfiles.push_back(profile);
+        spectrum.resize(static_cast<size_t>(spectrumSize));
+        for (auto& value : spectrum)
+            value = inStream.readFloat();
+        
+        addProfileRow(midiNote, spectrum.data(), spectrumSize, -1, -1);
     }
     
     return true;
@@ -324,12 +1102,20 @@ void PitchDetector::getCurrentGuitarPosition(int& stringIndex, int& fretNumber)
 void PitchDetector::clearInstrumentData()
 {
     learnedProfiles.clear();
-    learnedSpectraPerNote.clear();
+    profileLearner.clear();
+    learnerPositions.fill({});
+    profileMatrix.clear();
+    gramMatrix.clear();
+    loadedProfileFile.reset();
+    profilesChanged();
+    
+    if (learningModeActive)
+        reserveLearningCapacity();
 }
 
 void PitchDetector::setMaxPolyphony(int maxNotes)
 {
-    maxPolyphony = maxNotes;
+    maxPolyphony = juce::jlimit(1, maxSupportedPolyphony, maxNotes);
 }
 
 int PitchDetector::getMaxPolyphony() const
@@ -347,12 +1133,7 @@ void PitchDetector::setNoteDetectionCallback(std::function<void(const std::vecto
     noteCallback = callback;
 }
 
-std::string PitchDetector::midiNoteToName(int midiNote)
+void PitchDetector::setNoteEventCallback(std::function<void(const NoteEvent*, int)> callback)
 {
-    static const char* noteNames[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
-    
-    int octave = (midiNote / 12) - 1;
-    int noteIndex = midiNote % 12;
-    
-    return std::string(noteNames[noteIndex]) + std::to_string(octave);
+    noteEventCallback = std::move(callback);
 }
\ No newline at end of file
@@ -2,9 +2,16 @@
 
 #include <juce_core/juce_core.h>
 #include <juce_audio_basics/juce_audio_basics.h>
+#include "HarmonicSalience.h"
+#include "LogFrequencyProjector.h"
+#include "NoteEvent.h"
+#include "OnsetDetector.h"
+#include "ProfileMatrix.h"
+#include "ProfileLearner.h"
+#include "ProfileFile.h"
+#include "../utils/StageTimings.h"
+#include <array>
 #include <vector>
-#include <map>
-#include <string>
 
 /**
  * PitchDetector class implements polyphonic pitch detection using
@@ -13,6 +20,12 @@
 class PitchDetector
 {
 public:
+    /** Upper limit for setMaxPolyphony, used to size the per-frame buffers */
+    static constexpr int maxSupportedPolyphony = 16;
+    
+    /** New templates a learning session has room for; further positions aren't stored */
+    static constexpr int learningHeadroom = 256;
+    
     /**
      * Constructor
      * @param maxNotes Maximum number of notes to detect at once
@@ -24,7 +37,7 @@ public:
      */
     ~PitchDetector();
     
-
+    
     /**
      * Enum for learning mode instrument types
      */
@@ -34,6 +47,15 @@ public:
         Piano,
         Bass
     };
+    
+    /**
+     * How template scores are computed for each frame
+     */
+    enum class DetectionEngine {
+        CosineSimilarity,   // Independent cosine similarity against every template
+        SparseActivations   // Non-negative sparse decomposition of the frame over all templates
+    };
+    
     /**
      * Struct for guitar settings
      */
@@ -43,7 +65,9 @@ public:
         int numFrets = 24;  // Maximum number of frets to learn
     };
     /**
-     * Activates or deactivates learning mode
+     * Activates or deactivates learning mode. Activating it allocates room for
+     * learningHeadroom new templates, so learning itself doesn't allocate; call it
+     * while processSpectrum isn't running.
      * @param shouldBeActive True to enable learning mode, false to disable
      */
     void setLearningModeActive(bool shouldBeActive);
@@ -64,21 +88,22 @@ public:
      * @return Current instrument type
      */
     InstrumentType getInstrumentType() const;
-
+    
     /**
      * Gets the current guitar settings
      * @return Current guitar settings
      */
     const GuitarSettings& getGuitarSettings() const;
-
+    
     /**
      * Sets the guitar settings for guitar mode
      * @param settings Guitar configuration settings
      */
     void setGuitarSettings(const GuitarSettings& settings);
-
+    
     /**
-     * Sets the current monophonic note being learned (when in learning mode)
+     * Sets the current monophonic note being learned (when in learning mode).
+     * Allocates the note's learning statistics if it hasn't been learned before.
      * @param midiNote MIDI note number being learned
      */
     void setCurrentLearningNote(int midiNote);
@@ -88,28 +113,100 @@ public:
      * @return Current MIDI note number, or -1 if not set
      */
     int getCurrentLearningNote() const;
-
+    
     /**
      * Gets the current guitar position
      * @param stringIndex Output parameter for string index
      * @param fretNumber Output parameter for fret number
      */
     void getCurrentGuitarPosition(int& stringIndex, int& fretNumber) const;
-
+    
     /**
-     * Sets the current guitar string and fret for learning (guitar mode only)
-     * @param stringIndex String index (0-5, where 0 is the low E string)
+     * Sets the current guitar string and fret for learning (guitar mode only).
+     * Templates learned while the learning note is the one this position plays
+     * are stored with the string and fret, so the same pitch can be learned on
+     * several strings.
+     * @param stringIndex String index (0-5, where 0 is the low E string), or -1 for no position
      * @param fret Fret number (0 for open string)
      * @return The corresponding MIDI note number
      */
     int setCurrentGuitarPosition(int stringIndex, int fret);
     /**
-     * Process a new spectrum for pitch detection or learning
-     * @param spectrum Pointer to the magnitude spectrum data
+     * Preallocates the per-frame working buffers. Call before processing starts
+     * (e.g. from prepareToPlay) so detection does not allocate on the audio thread.
+     * @param spectrumSize Size of the feature vectors (the spectrum size, or the log-frequency bin count)
+     */
+    void prepare(int spectrumSize);
+    
+    /**
+     * Prepares for spectra from an FFT of the given size. The sample rate and FFT
+     * size are also recorded in saved profile files.
+     * @param sampleRate Sample rate of the analysed audio
+     * @param fftSize FFT size; spectra have fftSize / 2 bins
+     */
+    void prepare(double sampleRate, int fftSize);
+    
+    /**
+     * Stores templates and matches spectra on a log-frequency axis instead of linear
+     * FFT bins. Templates shrink to a few hundred bins and no longer depend on the
+     * FFT size or sample rate. Changing the feature space clears the learned data,
+     * and spectra are only projected once prepare(sampleRate, fftSize) has been called.
+     * @param binsPerSemitone Resolution (e.g. 3 or 5), or 0 for linear FFT bins
+     * @param maxFrequency Centre frequency of the highest bin
+     */
+    void setLogFrequencyResolution(int binsPerSemitone, float maxFrequency = LogFrequencyProjector::defaultMaxFrequency);
+    
+    /**
+     * Gets the log-frequency resolution
+     * @return Bins per semitone, or 0 if templates use linear FFT bins
+     */
+    int getLogFrequencyResolution() const;
+    
+    /**
+     * Gets the number of bins in each template
+     * @return Template size in the current feature space
+     */
+    int getFeatureSize() const;
+    
+    /**
+     * Process a new spectrum for pitch detection or learning, writing one event per
+     * detected note into a buffer owned by the caller. Never allocates once prepared.
+     *
+     * Each event carries the note's template score, its level (the activation scaled
+     * back to the frame's magnitude, combined with the energy on its partials), its
+     * tuning, the string and fret of the matched template, and where its onset was.
+     * @param spectrum Pointer to the (linear) magnitude spectrum data
+     * @param spectrumSize Size of the spectrum data
+     * @param events Receives the detected notes, strongest first (may be null)
+     * @param maxEvents Capacity of the events buffer
+     * @param frameEndSample Position of the end of this frame on the caller's timeline,
+     *                       used to place note onsets
+     * @return Number of events written (none in learning mode)
+     */
+    int processSpectrum(const float* spectrum, int spectrumSize, NoteEvent* events, int maxEvents,
+                        juce::int64 frameEndSample = 0);
+    
+    /**
+     * Process a new spectrum for pitch detection or learning, for callers that only
+     * need the note numbers
+     * @param spectrum Pointer to the (linear) magnitude spectrum data
      * @param spectrumSize Size of the spectrum data
-     * @return Vector of detected MIDI notes (when not in learning mode)
+     * @return Detected MIDI notes (empty in learning mode); valid until the next call
      */
-    std::vector<int> processSpectrum(const float* spectrum, int spectrumSize);
+    const std::vector<int>& processSpectrum(const float* spectrum, int spectrumSize);
+    
+    /**
+     * Forgets the state carried from one frame to the next (onset gating, the
+     * solver's warm start, note onsets), e.g. before analysing another recording.
+     * The templates and settings are kept.
+     */
+    void reset();
+    
+    /**
+     * Records the template matching and decision time of every detection frame
+     * @param timings Shared timing statistics, or nullptr to stop timing
+     */
+    void setStageTimings(StageTimings* timings) { stageTimings = timings; }
     
     /**
      * Saves learned instrument data to a file
@@ -119,7 +216,11 @@ public:
     bool saveInstrumentData(const juce::String& filePath);
     
     /**
-     * Loads instrument data from a file
+     * Loads instrument data from a file. Profile files are memory-mapped and their
+     * templates used in place; files from older versions (no header) are still read.
+     * Files recorded at a different sample rate or FFT size are rejected once the
+     * detector has been prepared. The previous templates are released (and their
+     * file unmapped), so processSpectrum must not run on another thread meanwhile.
      * @param filePath Path to the data file
      * @return True if successful, false otherwise
      */
@@ -130,9 +231,37 @@ public:
      */
     void clearInstrumentData();
     
+    /**
+     * Adds a spectral template directly, without going through learning mode
+     * @param midiNote MIDI note the template represents
+     * @param spectrum Linear magnitude spectrum of the note (projected and normalized internally)
+     * @param spectrumSize Size of the spectrum data
+     * @param guitarString Guitar string index, or -1 if not applicable
+     * @param guitarFret Guitar fret number, or -1 if not applicable
+     * @return Index of the new profile
+     */
+    int addProfile(int midiNote, const float* spectrum, int spectrumSize, int guitarString = -1, int guitarFret = -1);
+    
+    /**
+     * Replaces this detector's templates with those of another detector that fall in a
+     * note range, and copies its detection engine settings. Used to give each string of
+     * a hexaphonic pickup a small detector that only knows that string's notes.
+     * @param source Detector to copy from
+     * @param lowestNote Lowest MIDI note to copy
+     * @param highestNote Highest MIDI note to copy
+     * @return Number of templates copied
+     */
+    int copyProfilesFrom(const PitchDetector& source, int lowestNote, int highestNote);
+    
+    /**
+     * Gets the number of learned profiles
+     * @return Number of profiles
+     */
+    int getNumProfiles() const;
+    
     /**
      * Sets the maximum number of simultaneous notes to detect
-     * @param maxNotes New maximum number of notes
+     * @param maxNotes New maximum number of notes (1 to maxSupportedPolyphony)
      */
     void setMaxPolyphony(int maxNotes);
     
@@ -142,6 +271,120 @@ public:
      */
     int getMaxPolyphony() const;
     
+    /**
+     * Selects how template scores are computed
+     * @param engine Cosine similarity, or sparse non-negative activations
+     */
+    void setDetectionEngine(DetectionEngine engine);
+    
+    /**
+     * Gets the current detection engine
+     * @return Current detection engine
+     */
+    DetectionEngine getDetectionEngine() const;
+    
+    /**
+     * Sets the maximum number of solver iterations per frame (sparse activations only)
+     * @param maxIterations Iteration cap, bounding the per-frame cost
+     */
+    void setSolverIterationLimit(int maxIterations);
+    
+    /**
+     * Sets the early-exit tolerance of the solver (sparse activations only)
+     * @param tolerance Largest per-iteration change, relative to the strongest activation
+     */
+    void setSolverTolerance(float tolerance);
+    
+    /**
+     * Sets the L1 penalty that pushes weak activations to zero (sparse activations only)
+     * @param penalty Penalty weight (0 for plain non-negative least squares)
+     */
+    void setSparsityPenalty(float penalty);
+    
+    /**
+     * Gets the number of iterations the solver used for the last frame
+     * @return Iteration count
+     */
+    int getLastSolverIterations() const;
+    
+    /**
+     * Enables onset gating. Between spectral-flux onsets the previous frame's notes
+     * are only re-verified against their templates, and the full template search
+     * runs again when an onset is detected, a verified note loses most of its
+     * score, or setMaxReusedFrames frames have passed.
+     * @param shouldBeEnabled True to gate detection on onsets (the default)
+     */
+    void setOnsetGatingEnabled(bool shouldBeEnabled);
+    
+    /**
+     * Checks if onset gating is enabled
+     * @return True if detection is gated on onsets
+     */
+    bool isOnsetGatingEnabled() const;
+    
+    /**
+     * Sets the spectral flux, relative to the frame level, that counts as an onset
+     * @param threshold Relative flux threshold
+     */
+    void setOnsetThreshold(float threshold);
+    
+    /**
+     * Limits how many frames in a row may reuse the previous result
+     * @param maxFrames Frames between forced full detections (0 disables reuse)
+     */
+    void setMaxReusedFrames(int maxFrames);
+    
+    /**
+     * Gets how many frames ran the full template search
+     * @return Frame count since the profiles last changed
+     */
+    int getNumFullDetections() const;
+    
+    /**
+     * Gets how many frames reused the previous result after verifying it
+     * @return Frame count since the profiles last changed
+     */
+    int getNumReusedFrames() const;
+    
+    /**
+     * Enables candidate pruning. A harmonic-sum pre-pass shortlists the most salient
+     * notes, and only the templates of those notes and their octave neighbours are
+     * scored. Needs prepare(sampleRate, fftSize); otherwise every template is scored.
+     * @param shouldBeEnabled True to prune (the default)
+     */
+    void setCandidatePruningEnabled(bool shouldBeEnabled);
+    
+    /**
+     * Checks if candidate pruning is enabled
+     * @return True if only shortlisted templates are scored
+     */
+    bool isCandidatePruningEnabled() const;
+    
+    /**
+     * Sets how many notes the pre-pass may shortlist, before adding octave neighbours
+     * @param maxNotes Shortlist size, or 0 for twice the maximum polyphony (at least 8)
+     */
+    void setMaxCandidateNotes(int maxNotes);
+    
+    /**
+     * Gets how many templates were scored for the last fully detected frame
+     * @return Number of templates scored
+     */
+    int getNumScoredProfiles() const;
+    
+    /**
+     * Sets how many raw learning frames are kept per note for later re-clustering.
+     * Profiles are built from running statistics, so this is optional (0 keeps none).
+     * @param maxFramesPerNote Reservoir capacity per note
+     */
+    void setLearningReservoirSize(int maxFramesPerNote);
+    
+    /**
+     * Gets the running learning statistics (mean, variance and reservoir per note)
+     * @return The profile learner
+     */
+    const ProfileLearner& getProfileLearner() const;
+    
     /**
      * Checks if enough data is available for pitch detection
      * @return True if enough data is learned
@@ -154,22 +397,35 @@ public:
      */
     void setNoteDetectionCallback(std::function<void(const std::vector<int>&)> callback);
     
+    /**
+     * Registers a callback that receives the full event of every detected note
+     * @param callback Function to call with the events and their count
+     */
+    void setNoteEventCallback(std::function<void(const NoteEvent*, int)> callback);
+
 private:
+    // Profile metadata; the spectrum of profile i is row i of profileMatrix
     struct SpectralProfile {
         int midiNote;
-        std::vector<float> spectrum;
-        std::string noteName;
-
+        
         // Guitar-specific information (if applicable)
         int guitarString = -1;
         int guitarFret = -1;
     };
     
+    struct GuitarPosition {
+        int string = -1;
+        int fret = -1;
+        
+        bool operator== (const GuitarPosition& other) const { return string == other.string && fret == other.fret; }
+        bool operator!= (const GuitarPosition& other) const { return !(*this == other); }
+    };
+    
     bool learningModeActive;
     int currentLearningNote;
     int maxPolyphony;
     int requiredSpectraForLearning;
-
+    
     // Instrument type and settings
     InstrumentType instrumentType;
     GuitarSettings guitarSettings;
@@ -179,18 +435,98 @@ private:
     int currentGuitarFret;
     
     std::vector<SpectralProfile> learnedProfiles;
-    std::map<int, std::vector<std::vector<float>>> learnedSpectraPerNote;
+    ProfileMatrix profileMatrix;
+    int learningCapacity = 0;               // Templates learning can grow to without allocating
+    ProfileLearner profileLearner;          // Running statistics of the learning-mode frames
+    std::array<GuitarPosition, ProfileLearner::numMidiNotes> learnerPositions; // Where each note's statistics were played
+    std::unique_ptr<ProfileFile> loadedProfileFile; // Backs profileMatrix while it uses the mapped templates
+    double preparedSampleRate = 0.0;
+    int preparedFFTSize = 0;
+    
+    // Optional log-frequency feature space
+    LogFrequencyProjector logProjector;
+    int logBinsPerSemitone = 0;
+    float logMinFrequency = LogFrequencyProjector::defaultMinFrequency;
+    float logMaxFrequency = LogFrequencyProjector::defaultMaxFrequency;
+    std::vector<float> projectedSpectrum;
     
     std::function<void(const std::vector<int>&)> noteCallback;
+    std::function<void(const NoteEvent*, int)> noteEventCallback;
+    StageTimings* stageTimings = nullptr;
+    
+    // Per-frame scratch buffers, sized in prepare() and reused for every frame
+    AlignedFloatBuffer normalizedInput;
+    int preparedSpectrumSize = 0;
+    std::vector<float> coefficients;
+    std::vector<std::pair<float, int>> rankedProfiles;
+    std::vector<int> detectedNotes;
+    std::vector<NoteEvent> detectedEvents;
+    std::array<juce::int64, HarmonicSalience::numMidiNotes> noteOnsetSamples {};
+    std::array<bool, HarmonicSalience::numMidiNotes> noteWasDetected {};
+    
+    // Sparse activation solver state
+    DetectionEngine detectionEngine = DetectionEngine::CosineSimilarity;
+    ProfileMatrix gramMatrix;               // Template dot products, kept current whenever a template changes
+    AlignedFloatBuffer activations;
+    std::vector<float> gramProduct;
+    std::vector<float> previousActivations; // Warm start for the next frame
+    bool hasPreviousActivations = false;
+    int solverIterationLimit = 30;
+    float solverTolerance = 1.0e-3f;
+    float sparsityPenalty = 0.02f;
+    int lastSolverIterations = 0;
+    
+    // Onset gating: between onsets the previous notes are verified instead of re-detected
+    OnsetDetector onsetDetector;
+    bool onsetGatingEnabled = true;
+    int maxReusedFrames = 8;
+    int framesSinceFullDetection = 0;
+    bool hasDetectionResult = false;
+    std::vector<NoteEvent> previousEvents;
+    std::vector<std::pair<int, float>> verifiedProfiles; // Row and cosine score of each note at the last full detection
+    int numFullDetections = 0;
+    int numReusedFrames = 0;
+    
+    // Candidate pruning: only the templates of salient notes (and their octaves) are scored
+    HarmonicSalience salience;
+    bool candidatePruningEnabled = true;
+    int maxCandidateNotes = 0;
+    std::vector<int> profileNotes;                  // Distinct notes that have templates
+    std::vector<int> profileRowsByNote;             // Template rows, grouped by MIDI note
+    std::array<int, HarmonicSalience::numMidiNotes + 1> noteRowOffsets {}; // Note n's rows start at noteRowOffsets[n]
+    std::vector<int> candidateNotes;
+    std::vector<int> candidateRows;
+    std::array<bool, HarmonicSalience::numMidiNotes> noteIsCandidate;
+    bool candidatesActive = false;                  // candidateRows restricts the current frame
+    int numScoredProfiles = 0;
     
     // Methods for spectrum processing and analysis
-    std::vector<int> detectPolyphonicPitches(const float* spectrum, int spectrumSize);
-    void addLearnedSpectrum(const float* spectrum, int spectrumSize, int midiNote);
+    void detectPolyphonicPitches(const float* spectrum, int spectrumSize, StageTimings::Stopwatch& stopwatch);
+    void addLearnedSpectrum(const float* spectrum, int spectrumSize, int midiNote, GuitarPosition position);
+    GuitarPosition getLearningPosition(int midiNote) const;
     void normalizeVector(std::vector<float>& vec);
-    std::vector<float> sparseEncode(const std::vector<float>& input);
-    std::string midiNoteToName(int midiNote);
+    float normalizeBuffer(float* data, int size);
+    const float* projectSpectrum(const float* spectrum, int& spectrumSize);
+    bool canReusePreviousResult() const;
+    void rememberDetectionResult();
+    void measureNotes(const float* spectrum, int spectrumSize, float frameMagnitude);
+    void trackNoteOnsets(juce::int64 frameEndSample);
+    void resetOnsetGating();
+    void prepareSalience();
+    bool selectCandidateProfiles(int spectrumSize);
+    void sparseEncode(const float* input);
+    void solveActivations();
+    void rebuildGramMatrix();
+    void updateGramMatrix(int changedRow);
+    void profilesChanged();
+    int addProfileRow(int midiNote, const float* spectrum, int spectrumSize, int guitarString, int guitarFret);
+    void reserveLearningCapacity();
+    bool loadLegacyInstrumentData(const juce::File& file);
     
     // Constants for pitch detection
     const float minimumCoefficient = 0.1f;   // Minimum coefficient for a note to be detected
+    const float activationFloor = 1.0e-3f;   // Lowest starting activation for the solver
     const int maximumSemitoneDistance = 2;   // Maximum semitone distance for note filtering
+    const float verificationRatio = 0.7f;    // Share of its score a reused note must keep
+    const int minimumCandidateNotes = 8;     // Smallest automatic shortlist, before octave neighbours
 };
\ No newline at end of file
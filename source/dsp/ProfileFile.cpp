@@ -0,0 +1,218 @@
+#include "ProfileFile.h"
+
+namespace
+{
+    constexpr size_t floatsPerAlignedBlock = static_cast<size_t>(ProfileFile::dataAlignment) / sizeof(float);
+    
+    size_t roundUpToAlignment(size_t size)
+    {
+        const auto alignment = static_cast<size_t>(ProfileFile::dataAlignment);
+        return ((size + alignment - 1) / alignment) * alignment;
+    }
+}
+
+ProfileFile::ProfileFile()
+    : header(),
+      logAxis(),
+      profileInfo(nullptr),
+      matrixData(nullptr)
+{
+}
+
+ProfileFile::~ProfileFile()
+{
+}
+
+juce::Result ProfileFile::open(const juce::File& file)
+{
+    if (!file.existsAsFile())
+        return juce::Result::fail("File not found: " + file.getFullPathName());
+    
+    auto mapped = std::make_unique<juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readOnly);
+    
+    if (mapped->getData() == nullptr)
+        return juce::Result::fail("Could not map " + file.getFullPathName());
+    
+    auto result = openFromMemory(mapped->getData(), mapped->getSize());
+    
+    if (result.wasOk())
+        mappedFile = std::move(mapped);
+    
+    return result;
+}
+
+juce::Result ProfileFile::openFromMemory(const void* data, size_t size)
+{
+    mappedFile.reset();
+    header = Header();
+    logAxis = LogFrequencyAxis();
+    profileInfo = nullptr;
+    matrixData = nullptr;
+    
+    if (!hasMagicNumber(data, size) || size < sizeof(Header))
+        return juce::Result::fail("Not a profile file");
+    
+    Header fileHeader;
+    std::memcpy(&fileHeader, data, sizeof(Header));
+    
+    if (fileHeader.version > currentVersion)
+        return juce::Result::fail("Profile file version " + juce::String(fileHeader.version) + " is newer than supported");
+    
+    if (fileHeader.headerSize < sizeof(Header) || fileHeader.headerSize > size)
+        return juce::Result::fail("Invalid header size");
+    
+    if ((fileHeader.numBins == 0 && fileHeader.profileCount > 0) || fileHeader.rowStride < fileHeader.numBins
+        || fileHeader.rowStride == 0 || fileHeader.rowStride % floatsPerAlignedBlock != 0)
+        return juce::Result::fail("Invalid matrix dimensions");
+    
+    if (!(fileHeader.sampleRate >= 0.0))
+        return juce::Result::fail("Invalid sample rate");
+    
+    // Version 1 headers end before the extension
+    LogFrequencyAxis fileAxis;
+    
+    if (fileHeader.headerSize >= sizeof(Header) + sizeof(LogFrequencyAxis))
+        std::memcpy(&fileAxis, static_cast<const char*>(data) + sizeof(Header), sizeof(LogFrequencyAxis));
+    
+    if (fileHeader.binLayout == static_cast<juce::uint32>(BinLayout::LogFrequency))
+    {
+        if (fileHeader.numBins != static_cast<juce::uint32>(LogFrequencyProjector::calculateNumBins(static_cast<int>(fileAxis.binsPerSemitone),
+                                                                                                   fileAxis.minFrequency,
+                                                                                                   fileAxis.maxFrequency))
+            && fileHeader.profileCount > 0)
+            return juce::Result::fail("Invalid log-frequency axis");
+    }
+    else if (fileHeader.binLayout == static_cast<juce::uint32>(BinLayout::LinearMagnitude))
+    {
+        // Linear templates hold every bin of the FFT they were learned with (if it's known)
+        if (fileHeader.fftSize > 0 && fileHeader.numBins != fileHeader.fftSize / 2 && fileHeader.profileCount > 0)
+            return juce::Result::fail("Bin count doesn't match the FFT size");
+    }
+    else
+    {
+        return juce::Result::fail("Unknown bin layout " + juce::String(fileHeader.binLayout));
+    }
+    
+    // Every size is checked in 64-bit arithmetic against the real file size, so a
+    // corrupt count can't make us read past the end
+    const juce::uint64 infoEnd = static_cast<juce::uint64>(fileHeader.headerSize)
+                               + static_cast<juce::uint64>(fileHeader.profileCount) * sizeof(ProfileInfo);
+    const juce::uint64 expectedDataSize = static_cast<juce::uint64>(fileHeader.profileCount)
+                                        * fileHeader.rowStride * sizeof(float);
+    
+    if (fileHeader.dataOffset % static_cast<juce::uint64>(dataAlignment) != 0
+        || fileHeader.dataOffset < infoEnd
+        || fileHeader.dataSize != expectedDataSize
+        || fileHeader.dataOffset > size
+        || fileHeader.dataSize > size - fileHeader.dataOffset)
+        return juce::Result::fail("Profile file is truncated or has an invalid layout");
+    
+    const auto* bytes = static_cast<const char*>(data);
+    
+    if (calculateFileChecksum(fileHeader, bytes) != fileHeader.checksum)
+        return juce::Result::fail("Profile file checksum mismatch");
+    
+    // Notes index per-note tables, so a bad one must not get past here
+    const auto* fileProfileInfo = reinterpret_cast<const ProfileInfo*>(bytes + fileHeader.headerSize);
+    
+    for (juce::uint32 i = 0; i < fileHeader.profileCount; ++i)
+        if (!juce::isPositiveAndBelow(fileProfileInfo[i].midiNote, 128))
+            return juce::Result::fail("Invalid MIDI note " + juce::String(fileProfileInfo[i].midiNote));
+    
+    header = fileHeader;
+    logAxis = fileAxis;
+    profileInfo = fileProfileInfo;
+    matrixData = reinterpret_cast<const float*>(bytes + header.dataOffset);
+    return juce::Result::ok();
+}
+
+bool ProfileFile::hasMagicNumber(const void* data, size_t size)
+{
+    if (data == nullptr || size < sizeof(juce::uint32))
+        return false;
+    
+    juce::uint32 magic;
+    std::memcpy(&magic, data, sizeof(magic));
+    return magic == magicNumber;
+}
+
+juce::MemoryBlock ProfileFile::createFileData(double sampleRate, int fftSize, BinLayout binLayout,
+                                              const std::vector<ProfileInfo>& profiles,
+                                              const ProfileMatrix& matrix,
+                                              const LogFrequencyAxis& logAxis)
+{
+    jassert(static_cast<int>(profiles.size()) == matrix.getNumRows());
+    
+    const size_t numProfiles = profiles.size();
+    const size_t numBins = static_cast<size_t>(matrix.getNumBins());
+    const size_t rowStride = ((juce::jmax(numBins, size_t(1)) + floatsPerAlignedBlock - 1) / floatsPerAlignedBlock) * floatsPerAlignedBlock;
+    const size_t headerSize = sizeof(Header) + sizeof(LogFrequencyAxis);
+    const size_t dataOffset = roundUpToAlignment(headerSize + numProfiles * sizeof(ProfileInfo));
+    const size_t dataSize = numProfiles * rowStride * sizeof(float);
+    
+    juce::MemoryBlock block(dataOffset + dataSize, true);
+    auto* bytes = static_cast<char*>(block.getData());
+    
+    if (numProfiles > 0)
+        std::memcpy(bytes + headerSize, profiles.data(), numProfiles * sizeof(ProfileInfo));
+    
+    auto* rows = reinterpret_cast<float*>(bytes + dataOffset);
+    for (size_t row = 0; row < numProfiles; ++row)
+    {
+        const float* source = matrix.getRow(static_cast<int>(row));
+        std::copy(source, source + numBins, rows + row * rowStride);
+    }
+    
+    Header fileHeader = {};
+    fileHeader.magic = magicNumber;
+    fileHeader.version = currentVersion;
+    fileHeader.headerSize = static_cast<juce::uint32>(headerSize);
+    fileHeader.binLayout = static_cast<juce::uint32>(binLayout);
+    fileHeader.sampleRate = sampleRate;
+    fileHeader.fftSize = static_cast<juce::uint32>(fftSize);
+    fileHeader.numBins = static_cast<juce::uint32>(numBins);
+    fileHeader.rowStride = static_cast<juce::uint32>(rowStride);
+    fileHeader.profileCount = static_cast<juce::uint32>(numProfiles);
+    fileHeader.dataOffset = dataOffset;
+    fileHeader.dataSize = dataSize;
+    
+    std::memcpy(bytes + sizeof(Header), &logAxis, sizeof(LogFrequencyAxis));
+    fileHeader.checksum = calculateFileChecksum(fileHeader, bytes);
+    std::memcpy(bytes, &fileHeader, sizeof(Header));
+    return block;
+}
+
+const ProfileFile::ProfileInfo& ProfileFile::getProfileInfo(int index) const
+{
+    jassert(index >= 0 && index < getNumProfiles());
+    return profileInfo[index];
+}
+
+juce::uint64 ProfileFile::calculateFileChecksum(const Header& fileHeader, const char* bytes)
+{
+    const size_t fileSize = static_cast<size_t>(fileHeader.dataOffset + fileHeader.dataSize);
+    
+    // Older versions left the header (and its extension) unprotected
+    if (fileHeader.version < 3)
+        return calculateChecksum(bytes + fileHeader.headerSize, fileSize - fileHeader.headerSize);
+    
+    Header hashedHeader = fileHeader;
+    hashedHeader.checksum = 0;
+    
+    const auto hash = calculateChecksum(&hashedHeader, sizeof(Header));
+    return calculateChecksum(bytes + sizeof(Header), fileSize - sizeof(Header), hash);
+}
+
+juce::uint64 ProfileFile::calculateChecksum(const void* data, size_t size, juce::uint64 hash)
+{
+    // 64-bit FNV-1a, continuing from hash
+    const auto* bytes = static_cast<const juce::uint8*>(data);
+    
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    
+    return hash;
+}
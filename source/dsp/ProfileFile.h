@@ -0,0 +1,151 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include "LogFrequencyProjector.h"
+#include "ProfileMatrix.h"
+#include <memory>
+#include <vector>
+
+/**
+ * ProfileFile reads and writes the binary instrument profile format.
+ *
+ * Layout (native byte order, little-endian on every supported platform):
+ *   Header        64 bytes: magic, version, sample rate, FFT size, bin layout,
+ *                 bin count, row stride, profile count, data offset/size, checksum
+ *   Extension     16 bytes (version 2+): log-frequency axis of the templates
+ *   ProfileInfo   16 bytes per profile: MIDI note, guitar string, guitar fret
+ *   padding       zeros up to the data offset (a multiple of 64 bytes)
+ *   matrix        profileCount x rowStride floats, each row zero-padded
+ *
+ * Rows are 64-byte aligned, so a memory-mapped file can be handed straight to
+ * ProfileMatrix::useExternalData. The checksum is 64-bit FNV-1a over the
+ * whole file, reading its own field as zero (versions 1 and 2 only covered
+ * everything after the header).
+ */
+class ProfileFile
+{
+public:
+    static constexpr juce::uint32 magicNumber = 0x46505450; // "PTPF"
+    static constexpr juce::uint32 currentVersion = 3;
+    static constexpr int dataAlignment = 64;                // Bytes; covers every SIMD register width
+    
+    /**
+     * What the bins of each template represent
+     */
+    enum class BinLayout : juce::uint32 {
+        LinearMagnitude = 0,    // FFT magnitude bins 0 .. fftSize / 2 - 1
+        LogFrequency = 1        // LogFrequencyProjector bins, described by LogFrequencyAxis
+    };
+    
+    /**
+     * Frequency axis of LogFrequency templates, stored in the header extension
+     */
+    struct LogFrequencyAxis
+    {
+        float minFrequency = 0.0f;
+        float maxFrequency = 0.0f;
+        juce::uint32 binsPerSemitone = 0;
+        juce::uint32 reserved = 0;
+    };
+    
+    /**
+     * Per-profile metadata, stored in the file as-is
+     */
+    struct ProfileInfo
+    {
+        juce::int32 midiNote = -1;
+        juce::int32 guitarString = -1;
+        juce::int32 guitarFret = -1;
+        juce::int32 reserved = 0;
+    };
+    
+    ProfileFile();
+    ~ProfileFile();
+    
+    /**
+     * Maps a profile file into memory and validates it
+     * @param file File to open
+     * @return Error description if the file is missing, truncated, corrupt or not in this format
+     */
+    juce::Result open(const juce::File& file);
+    
+    /**
+     * Validates a profile file that is already in memory. The data isn't copied
+     * and must stay valid while this object is used.
+     * @param data Start of the file contents
+     * @param size Size in bytes
+     * @return Error description if the data is truncated, corrupt or not in this format
+     */
+    juce::Result openFromMemory(const void* data, size_t size);
+    
+    /**
+     * Checks whether data starts with the profile file magic number
+     * @param data Start of the file contents
+     * @param size Size in bytes
+     * @return True if this looks like a profile file (older files have no header)
+     */
+    static bool hasMagicNumber(const void* data, size_t size);
+    
+    /**
+     * Serialises a set of profiles
+     * @param sampleRate Sample rate the templates were learned at
+     * @param fftSize FFT size the templates were learned with
+     * @param binLayout What the template bins represent
+     * @param profiles Metadata for each row of the matrix
+     * @param matrix Template spectra, one row per profile
+     * @param logAxis Frequency axis of the bins (ignored for the LinearMagnitude layout)
+     * @return File contents
+     */
+    static juce::MemoryBlock createFileData(double sampleRate, int fftSize, BinLayout binLayout,
+                                            const std::vector<ProfileInfo>& profiles,
+                                            const ProfileMatrix& matrix,
+                                            const LogFrequencyAxis& logAxis);
+    
+    double getSampleRate() const { return header.sampleRate; }
+    int getFFTSize() const { return static_cast<int>(header.fftSize); } // 0 if unknown
+    BinLayout getBinLayout() const { return static_cast<BinLayout>(header.binLayout); }
+    const LogFrequencyAxis& getLogFrequencyAxis() const { return logAxis; }
+    int getNumBins() const { return static_cast<int>(header.numBins); }
+    int getRowStride() const { return static_cast<int>(header.rowStride); }
+    int getNumProfiles() const { return static_cast<int>(header.profileCount); }
+    
+    const ProfileInfo& getProfileInfo(int index) const;
+    
+    /**
+     * Gets the template matrix, getNumProfiles() rows of getRowStride() floats
+     * @return First row, 64-byte aligned relative to the start of the file
+     */
+    const float* getMatrixData() const { return matrixData; }
+
+private:
+    struct Header
+    {
+        juce::uint32 magic;
+        juce::uint32 version;
+        juce::uint32 headerSize;
+        juce::uint32 binLayout;
+        double sampleRate;
+        juce::uint32 fftSize;
+        juce::uint32 numBins;
+        juce::uint32 rowStride;
+        juce::uint32 profileCount;
+        juce::uint64 dataOffset;
+        juce::uint64 dataSize;
+        juce::uint64 checksum;
+    };
+    
+    static_assert(sizeof(Header) == 64, "Header layout must not change");
+    static_assert(sizeof(LogFrequencyAxis) == 16, "Header extension layout must not change");
+    static_assert(sizeof(ProfileInfo) == 16, "ProfileInfo layout must not change");
+    
+    std::unique_ptr<juce::MemoryMappedFile> mappedFile;
+    Header header;
+    LogFrequencyAxis logAxis;
+    const ProfileInfo* profileInfo;
+    const float* matrixData;
+    
+    static constexpr juce::uint64 checksumSeed = 14695981039346656037ull;
+    
+    static juce::uint64 calculateChecksum(const void* data, size_t size, juce::uint64 hash = checksumSeed);
+    static juce::uint64 calculateFileChecksum(const Header& fileHeader, const char* bytes);
+};
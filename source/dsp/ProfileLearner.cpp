@@ -0,0 +1,175 @@
+#include "ProfileLearner.h"
+
+ProfileLearner::ProfileLearner()
+    : numBins(0),
+      reservoirCapacity(0)
+{
+}
+
+void ProfileLearner::prepare(int numBinsPerFrame)
+{
+    if (numBinsPerFrame != numBins)
+    {
+        clear();
+        numBins = numBinsPerFrame;
+    }
+}
+
+void ProfileLearner::clear()
+{
+    for (int note = 0; note < numMidiNotes; ++note)
+        clearNote(note);
+}
+
+void ProfileLearner::clearNote(int midiNote)
+{
+    if (!isValidNote(midiNote))
+        return;
+    
+    // Release the memory too, so a cleared session doesn't keep its footprint
+    auto& stats = notes[static_cast<size_t>(midiNote)];
+    stats.count = 0;
+    std::vector<float>().swap(stats.mean);
+    std::vector<float>().swap(stats.sumOfSquaredDeviations);
+    std::vector<float>().swap(stats.reservoir);
+    stats.reservoirSize = 0;
+}
+
+void ProfileLearner::restartNote(int midiNote)
+{
+    if (!isValidNote(midiNote))
+        return;
+    
+    // The first frame overwrites the mean; the deviations accumulate, so they are zeroed
+    auto& stats = notes[static_cast<size_t>(midiNote)];
+    stats.count = 0;
+    std::fill(stats.sumOfSquaredDeviations.begin(), stats.sumOfSquaredDeviations.end(), 0.0f);
+    stats.reservoirSize = 0;
+}
+
+void ProfileLearner::prepareNote(int midiNote)
+{
+    if (isValidNote(midiNote) && numBins > 0)
+        allocate(notes[static_cast<size_t>(midiNote)]);
+}
+
+void ProfileLearner::allocate(NoteStatistics& stats)
+{
+    const auto numValues = static_cast<size_t>(numBins);
+    
+    if (stats.mean.size() != numValues)
+    {
+        stats.mean.assign(numValues, 0.0f);
+        stats.sumOfSquaredDeviations.assign(numValues, 0.0f);
+    }
+    
+    if (stats.reservoir.size() < numValues * static_cast<size_t>(reservoirCapacity))
+        stats.reservoir.resize(numValues * static_cast<size_t>(reservoirCapacity), 0.0f);
+}
+
+void ProfileLearner::addFrame(int midiNote, const float* spectrum, int size)
+{
+    if (!isValidNote(midiNote) || numBins <= 0)
+        return;
+    
+    auto& stats = notes[static_cast<size_t>(midiNote)];
+    
+    // Unless prepareNote allocated them, a note's statistics are allocated on its first frame
+    if (stats.mean.empty())
+        allocate(stats);
+    
+    ++stats.count;
+    const float weight = 1.0f / static_cast<float>(stats.count);
+    const int numToAdd = juce::jmin(size, numBins);
+    float* mean = stats.mean.data();
+    float* squaredDeviations = stats.sumOfSquaredDeviations.data();
+    
+    // Welford's update: numerically stable mean and variance in one pass
+    for (int i = 0; i < numBins; ++i)
+    {
+        const float value = i < numToAdd ? spectrum[i] : 0.0f;
+        const float delta = value - mean[i];
+        mean[i] += delta * weight;
+        squaredDeviations[i] += delta * (value - mean[i]);
+    }
+    
+    if (reservoirCapacity > 0)
+        addToReservoir(stats, spectrum, numToAdd);
+}
+
+void ProfileLearner::addToReservoir(NoteStatistics& stats, const float* spectrum, int size)
+{
+    // Reservoir sampling (Algorithm R): frame n replaces a random slot with
+    // probability capacity / n, keeping a uniform sample of the whole session.
+    // allocate() made room for reservoirCapacity frames.
+    size_t slot;
+    
+    if (stats.reservoirSize < reservoirCapacity)
+    {
+        slot = static_cast<size_t>(stats.reservoirSize++);
+    }
+    else
+    {
+        const auto index = static_cast<juce::int64>(random.nextDouble() * static_cast<double>(stats.count));
+        if (index >= reservoirCapacity)
+            return;
+        
+        slot = static_cast<size_t>(index);
+    }
+    
+    float* frame = stats.reservoir.data() + slot * static_cast<size_t>(numBins);
+    std::copy(spectrum, spectrum + size, frame);
+    std::fill(frame + size, frame + numBins, 0.0f);
+}
+
+juce::int64 ProfileLearner::getNumFrames(int midiNote) const
+{
+    return isValidNote(midiNote) ? notes[static_cast<size_t>(midiNote)].count : 0;
+}
+
+const float* ProfileLearner::getMean(int midiNote) const
+{
+    if (!isValidNote(midiNote) || notes[static_cast<size_t>(midiNote)].count == 0)
+        return nullptr;
+    
+    return notes[static_cast<size_t>(midiNote)].mean.data();
+}
+
+bool ProfileLearner::getVariance(int midiNote, float* destination) const
+{
+    if (!isValidNote(midiNote) || notes[static_cast<size_t>(midiNote)].count < 2)
+        return false;
+    
+    const auto& stats = notes[static_cast<size_t>(midiNote)];
+    const float scale = 1.0f / static_cast<float>(stats.count - 1);
+    
+    for (int i = 0; i < numBins; ++i)
+        destination[i] = stats.sumOfSquaredDeviations[static_cast<size_t>(i)] * scale;
+    
+    return true;
+}
+
+void ProfileLearner::setReservoirCapacity(int maxFramesPerNote)
+{
+    reservoirCapacity = juce::jmax(0, maxFramesPerNote);
+    
+    // Prepared notes get room for the larger reservoir here rather than on their next frame
+    for (auto& stats : notes)
+    {
+        stats.reservoirSize = juce::jmin(stats.reservoirSize, reservoirCapacity);
+        
+        if (!stats.mean.empty())
+            allocate(stats);
+    }
+}
+
+int ProfileLearner::getReservoirSize(int midiNote) const
+{
+    return isValidNote(midiNote) ? notes[static_cast<size_t>(midiNote)].reservoirSize : 0;
+}
+
+const float* ProfileLearner::getReservoirFrame(int midiNote, int index) const
+{
+    jassert(index >= 0 && index < getReservoirSize(midiNote));
+    return notes[static_cast<size_t>(midiNote)].reservoir.data() + static_cast<size_t>(index) * static_cast<size_t>(numBins);
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <array>
+#include <vector>
+
+/**
+ * ProfileLearner accumulates learning-mode spectra per MIDI note as running
+ * statistics (Welford mean and variance), so memory is constant and each
+ * frame costs O(bins) however long a note is held.
+ * Optionally a bounded reservoir sample of the raw frames is kept per note
+ * for later re-clustering.
+ *
+ * A note's storage is allocated by prepareNote, or by its first frame
+ * otherwise; after that, adding frames and restarting the note never allocate.
+ */
+class ProfileLearner
+{
+public:
+    static constexpr int numMidiNotes = 128;
+    
+    ProfileLearner();
+    
+    /**
+     * Sets the number of bins per frame, discarding everything learned so far
+     * @param numBinsPerFrame Spectrum size
+     */
+    void prepare(int numBinsPerFrame);
+    
+    /**
+     * Forgets the statistics and reservoirs of every note
+     */
+    void clear();
+    
+    /**
+     * Forgets the statistics and reservoir of one note
+     * @param midiNote MIDI note number
+     */
+    void clearNote(int midiNote);
+    
+    /**
+     * Starts a note's statistics and reservoir afresh, keeping their memory
+     * @param midiNote MIDI note number
+     */
+    void restartNote(int midiNote);
+    
+    /**
+     * Allocates a note's statistics and reservoir ahead of its first frame, so
+     * addFrame can be called where allocating isn't allowed
+     * @param midiNote MIDI note number
+     */
+    void prepareNote(int midiNote);
+    
+    /**
+     * Adds one frame to a note's running statistics
+     * @param midiNote MIDI note number
+     * @param spectrum Frame to add (truncated or zero-padded to the bin count)
+     * @param size Number of values in spectrum
+     */
+    void addFrame(int midiNote, const float* spectrum, int size);
+    
+    /**
+     * Gets the number of frames accumulated for a note
+     * @param midiNote MIDI note number
+     * @return Frame count
+     */
+    juce::int64 getNumFrames(int midiNote) const;
+    
+    /**
+     * Gets the running mean spectrum of a note
+     * @param midiNote MIDI note number
+     * @return getNumBins() values, or nullptr if nothing has been learned for the note
+     */
+    const float* getMean(int midiNote) const;
+    
+    /**
+     * Computes the per-bin sample variance of a note
+     * @param midiNote MIDI note number
+     * @param destination Destination for getNumBins() values
+     * @return False if fewer than two frames have been learned for the note
+     */
+    bool getVariance(int midiNote, float* destination) const;
+    
+    /**
+     * Sets how many raw frames are kept per note (reservoir sampling).
+     * Reducing the capacity drops the excess frames; 0 disables the reservoir.
+     * @param maxFramesPerNote Reservoir capacity per note
+     */
+    void setReservoirCapacity(int maxFramesPerNote);
+    int getReservoirCapacity() const { return reservoirCapacity; }
+    
+    /**
+     * Gets the number of frames in a note's reservoir: a uniform random sample of
+     * the frames added so far, at most getReservoirCapacity() frames
+     * @param midiNote MIDI note number
+     * @return Stored frame count
+     */
+    int getReservoirSize(int midiNote) const;
+    
+    /**
+     * Gets one frame of a note's reservoir
+     * @param midiNote MIDI note number
+     * @param index Frame index, below getReservoirSize(midiNote)
+     * @return getNumBins() values
+     */
+    const float* getReservoirFrame(int midiNote, int index) const;
+    
+    int getNumBins() const { return numBins; }
+
+private:
+    struct NoteStatistics
+    {
+        juce::int64 count = 0;
+        std::vector<float> mean;
+        std::vector<float> sumOfSquaredDeviations;
+        std::vector<float> reservoir;       // reservoirCapacity frames of numBins values
+        int reservoirSize = 0;
+    };
+    
+    std::array<NoteStatistics, numMidiNotes> notes;
+    int numBins;
+    int reservoirCapacity;
+    juce::Random random;
+    
+    void allocate(NoteStatistics& stats);
+    void addToReservoir(NoteStatistics& stats, const float* spectrum, int size);
+    static bool isValidNote(int midiNote) { return midiNote >= 0 && midiNote < numMidiNotes; }
+};
@@ -0,0 +1,340 @@
+#include "ProfileMatrix.h"
+
+namespace
+{
+#if JUCE_USE_SIMD
+    using FloatRegister = juce::dsp::SIMDRegister<float>;
+    constexpr int simdWidth = static_cast<int>(FloatRegister::SIMDNumElements);
+    constexpr int simdAlignmentFloats = static_cast<int>(FloatRegister::SIMDRegisterSize / sizeof(float));
+#else
+    constexpr int simdWidth = 4;
+    constexpr int simdAlignmentFloats = 1;
+#endif
+    
+    float* alignForSIMD(float* ptr)
+    {
+#if JUCE_USE_SIMD
+        return FloatRegister::getNextSIMDAlignedPtr(ptr);
+#else
+        return ptr;
+#endif
+    }
+}
+
+//==============================================================================
+int AlignedFloatBuffer::padToSIMDWidth(int size)
+{
+    return ((size + simdWidth - 1) / simdWidth) * simdWidth;
+}
+
+void AlignedFloatBuffer::setSize(int newSize)
+{
+    // assign() keeps the existing allocation when it is big enough
+    paddedSize = padToSIMDWidth(juce::jmax(0, newSize));
+    storage.assign(static_cast<size_t>(paddedSize + simdAlignmentFloats), 0.0f);
+    alignedData = alignForSIMD(storage.data());
+}
+
+void AlignedFloatBuffer::reserve(int sizeToReserve)
+{
+    const auto capacity = static_cast<size_t>(padToSIMDWidth(juce::jmax(0, sizeToReserve)) + simdAlignmentFloats);
+    
+    if (capacity > storage.capacity())
+    {
+        // The contents are kept; the data pointer moves with the new allocation
+        const int oldSize = paddedSize;
+        std::vector<float> oldValues(alignedData, alignedData + oldSize);
+        storage.reserve(capacity);
+        setSize(oldSize);
+        std::copy(oldValues.begin(), oldValues.end(), alignedData);
+    }
+}
+
+//==============================================================================
+ProfileMatrix::ProfileMatrix()
+    : alignedData(nullptr),
+      externalData(nullptr),
+      numRows(0),
+      numBins(0),
+      rowStride(0),
+      rowCapacity(0)
+{
+}
+
+void ProfileMatrix::clear()
+{
+    storage.clear();
+    alignedData = nullptr;
+    externalData = nullptr;
+    numRows = 0;
+    numBins = 0;
+    rowStride = 0;
+    rowCapacity = 0;
+}
+
+bool ProfileMatrix::useExternalData(const float* data, int numRowsInData, int numBinsPerRow, int rowStrideInData)
+{
+    clear();
+    numBins = numBinsPerRow;
+    rowStride = rowStrideInData;
+    
+    // The rows can only be used in place if every row starts on a SIMD boundary
+    if (isSIMDCompatible(data, rowStrideInData))
+    {
+        externalData = data;
+        numRows = numRowsInData;
+        rowCapacity = numRowsInData;
+        return true;
+    }
+    
+    rowStride = AlignedFloatBuffer::padToSIMDWidth(numBins);
+    reallocate(numRowsInData, rowStride);
+    
+    for (int row = 0; row < numRowsInData; ++row)
+        setRow(row, data + static_cast<size_t>(row) * static_cast<size_t>(rowStrideInData), numBins);
+    
+    numRows = numRowsInData;
+    return false;
+}
+
+bool ProfileMatrix::isSIMDCompatible(const float* data, int stride)
+{
+#if JUCE_USE_SIMD
+    return FloatRegister::isSIMDAligned(data) && stride % simdWidth == 0;
+#else
+    juce::ignoreUnused(data);
+    return stride % simdWidth == 0;
+#endif
+}
+
+void ProfileMatrix::makeWritable()
+{
+    // Copy-on-write: external rows are read-only (e.g. a mapped file), so take a copy before changing anything
+    if (externalData != nullptr)
+        reallocate(juce::jmax(16, numRows), rowStride);
+}
+
+void ProfileMatrix::reserve(int numRowsToReserve, int numBinsPerRow)
+{
+    makeWritable();
+    
+    if (numRows == 0)
+        setNumBins(numBinsPerRow);
+    
+    if (rowStride == 0)
+        return;
+    
+    // Enough floats for the rows at the wider of the two widths, counted in current rows
+    const int widestStride = juce::jmax(rowStride, AlignedFloatBuffer::padToSIMDWidth(numBinsPerRow));
+    const int numRowsNeeded = static_cast<int>((static_cast<juce::int64>(numRowsToReserve) * widestStride + rowStride - 1) / rowStride);
+    
+    if (numRowsNeeded > rowCapacity)
+        reallocate(numRowsNeeded, rowStride);
+}
+
+int ProfileMatrix::addRow(const float* data, int size)
+{
+    makeWritable();
+    
+    if (numRows == 0 && numBins == 0)
+    {
+        numBins = size;
+        rowStride = AlignedFloatBuffer::padToSIMDWidth(numBins);
+    }
+    
+    // Grow geometrically so learning a full instrument only reallocates a few times
+    if (numRows >= rowCapacity)
+        reallocate(juce::jmax(16, rowCapacity * 2), rowStride);
+    
+    setRow(numRows++, data, size);
+    return numRows - 1;
+}
+
+void ProfileMatrix::setRow(int row, const float* data, int size)
+{
+    jassert(row >= 0 && row < rowCapacity);
+    makeWritable();
+    
+    float* dest = getRowPointer(row);
+    const int numToCopy = juce::jmin(size, numBins);
+    
+    juce::FloatVectorOperations::copy(dest, data, numToCopy);
+    juce::FloatVectorOperations::clear(dest + numToCopy, rowStride - numToCopy);
+}
+
+void ProfileMatrix::setValue(int row, int bin, float value)
+{
+    jassert(row >= 0 && row < numRows && bin >= 0 && bin < numBins);
+    makeWritable();
+    
+    getRowPointer(row)[bin] = value;
+}
+
+void ProfileMatrix::setNumBins(int newNumBins)
+{
+    makeWritable();
+    
+    const int newRowStride = AlignedFloatBuffer::padToSIMDWidth(newNumBins);
+    const int numToKeep = juce::jmin(numBins, newNumBins);
+    
+    const size_t availableFloats = storage.empty() ? 0 : storage.size() - static_cast<size_t>(alignedData - storage.data());
+    
+    if (newRowStride != rowStride && rowCapacity > 0
+        && static_cast<size_t>(numRows) * static_cast<size_t>(newRowStride) <= availableFloats)
+    {
+        // The storage holds the rows at the new width too: move them in place, last row
+        // first when they widen so no row is overwritten before it has moved
+        auto moveRow = [this, newRowStride, numToKeep](int row) {
+            float* source = getRowPointer(row);
+            float* dest = alignedData + static_cast<size_t>(row) * static_cast<size_t>(newRowStride);
+            std::memmove(dest, source, static_cast<size_t>(numToKeep) * sizeof(float));
+            std::fill(dest + numToKeep, dest + newRowStride, 0.0f);
+        };
+        
+        if (newRowStride > rowStride)
+            for (int row = numRows - 1; row >= 0; --row)
+                moveRow(row);
+        else
+            for (int row = 0; row < numRows; ++row)
+                moveRow(row);
+        
+        rowCapacity = static_cast<int>(availableFloats / static_cast<size_t>(newRowStride));
+    }
+    else if (newRowStride != rowStride && rowCapacity > 0)
+    {
+        // Lay the rows out again at the new width
+        std::vector<float> newStorage(static_cast<size_t>(rowCapacity) * static_cast<size_t>(newRowStride)
+                                      + static_cast<size_t>(simdAlignmentFloats), 0.0f);
+        float* newData = alignForSIMD(newStorage.data());
+        
+        for (int row = 0; row < numRows; ++row)
+            std::copy(getRow(row), getRow(row) + numToKeep, newData + static_cast<size_t>(row) * static_cast<size_t>(newRowStride));
+        
+        storage.swap(newStorage);
+        alignedData = newData;
+    }
+    else
+    {
+        // Same width: dropped bins become padding, which has to be zero
+        for (int row = 0; row < numRows; ++row)
+            juce::FloatVectorOperations::clear(getRowPointer(row) + numToKeep, rowStride - numToKeep);
+    }
+    
+    numBins = newNumBins;
+    rowStride = newRowStride;
+}
+
+void ProfileMatrix::removeRow(int row)
+{
+    jassert(row >= 0 && row < numRows);
+    makeWritable();
+    
+    const size_t stride = static_cast<size_t>(rowStride);
+    std::copy(alignedData + static_cast<size_t>(row + 1) * stride,
+              alignedData + static_cast<size_t>(numRows) * stride,
+              alignedData + static_cast<size_t>(row) * stride);
+    --numRows;
+}
+
+const float* ProfileMatrix::getRow(int row) const
+{
+    jassert(row >= 0 && row < numRows);
+    return getData() + static_cast<size_t>(row) * static_cast<size_t>(rowStride);
+}
+
+void ProfileMatrix::reallocate(int newRowCapacity, int newRowStride)
+{
+    std::vector<float> newStorage(static_cast<size_t>(newRowCapacity) * static_cast<size_t>(newRowStride)
+                                  + static_cast<size_t>(simdAlignmentFloats), 0.0f);
+    float* newData = alignForSIMD(newStorage.data());
+    
+    if (const float* oldData = getData())
+        std::copy(oldData, oldData + static_cast<size_t>(numRows) * static_cast<size_t>(rowStride), newData);
+    
+    storage.swap(newStorage);
+    alignedData = newData;
+    externalData = nullptr;
+    rowCapacity = newRowCapacity;
+    rowStride = newRowStride;
+}
+
+void ProfileMatrix::multiply(const float* input, float* output) const
+{
+#if JUCE_USE_SIMD
+    jassert(FloatRegister::isSIMDAligned(input));
+    
+    int row = 0;
+    
+    // Four rows at a time, so every input register load is shared by four templates
+    for (; row + 4 <= numRows; row += 4)
+    {
+        const float* row0 = getRow(row);
+        const float* row1 = row0 + rowStride;
+        const float* row2 = row1 + rowStride;
+        const float* row3 = row2 + rowStride;
+        
+        auto sum0 = FloatRegister::expand(0.0f);
+        auto sum1 = FloatRegister::expand(0.0f);
+        auto sum2 = FloatRegister::expand(0.0f);
+        auto sum3 = FloatRegister::expand(0.0f);
+        
+        for (int i = 0; i < rowStride; i += simdWidth)
+        {
+            const auto x = FloatRegister::fromRawArray(input + i);
+            sum0 = FloatRegister::multiplyAdd(sum0, x, FloatRegister::fromRawArray(row0 + i));
+            sum1 = FloatRegister::multiplyAdd(sum1, x, FloatRegister::fromRawArray(row1 + i));
+            sum2 = FloatRegister::multiplyAdd(sum2, x, FloatRegister::fromRawArray(row2 + i));
+            sum3 = FloatRegister::multiplyAdd(sum3, x, FloatRegister::fromRawArray(row3 + i));
+        }
+        
+        output[row]     = sum0.sum();
+        output[row + 1] = sum1.sum();
+        output[row + 2] = sum2.sum();
+        output[row + 3] = sum3.sum();
+    }
+    
+    for (; row < numRows; ++row)
+    {
+        const float* rowData = getRow(row);
+        auto sum = FloatRegister::expand(0.0f);
+        
+        for (int i = 0; i < rowStride; i += simdWidth)
+            sum = FloatRegister::multiplyAdd(sum, FloatRegister::fromRawArray(input + i), FloatRegister::fromRawArray(rowData + i));
+        
+        output[row] = sum.sum();
+    }
+#else
+    for (int row = 0; row < numRows; ++row)
+    {
+        const float* rowData = getRow(row);
+        float sum = 0.0f;
+        
+        for (int i = 0; i < rowStride; ++i)
+            sum += input[i] * rowData[i];
+        
+        output[row] = sum;
+    }
+#endif
+}
+
+float ProfileMatrix::dotRow(int row, const float* input) const
+{
+    const float* rowData = getRow(row);
+
+#if JUCE_USE_SIMD
+    jassert(FloatRegister::isSIMDAligned(input));
+    auto sum = FloatRegister::expand(0.0f);
+    
+    for (int i = 0; i < rowStride; i += simdWidth)
+        sum = FloatRegister::multiplyAdd(sum, FloatRegister::fromRawArray(input + i), FloatRegister::fromRawArray(rowData + i));
+    
+    return sum.sum();
+#else
+    float sum = 0.0f;
+    
+    for (int i = 0; i < rowStride; ++i)
+        sum += input[i] * rowData[i];
+    
+    return sum;
+#endif
+}
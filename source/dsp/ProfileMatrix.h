@@ -0,0 +1,175 @@
+#pragma once
+
+#include <juce_dsp/juce_dsp.h>
+#include <vector>
+
+/**
+ * Float buffer whose data pointer is aligned for SIMD loads.
+ * The size is rounded up to a whole number of SIMD registers and the
+ * padding is kept at zero, so it can be fed straight to ProfileMatrix.
+ */
+class AlignedFloatBuffer
+{
+public:
+    /**
+     * Resizes the buffer, clearing its contents. Only allocates if the size
+     * exceeds what was reserved or used before.
+     * @param newSize Number of usable floats
+     */
+    void setSize(int newSize);
+    
+    /**
+     * Preallocates room for a size, so later setSize calls up to it don't allocate
+     * @param sizeToReserve Number of usable floats
+     */
+    void reserve(int sizeToReserve);
+    
+    /**
+     * Gets the number of usable floats (including padding)
+     * @return Padded size of the buffer
+     */
+    int getSize() const { return paddedSize; }
+    
+    float* data() { return alignedData; }
+    const float* data() const { return alignedData; }
+    
+    /**
+     * Rounds a size up to a whole number of SIMD registers
+     * @param size Size in floats
+     * @return Padded size in floats
+     */
+    static int padToSIMDWidth(int size);
+
+private:
+    std::vector<float> storage;
+    float* alignedData = nullptr;
+    int paddedSize = 0;
+};
+
+/**
+ * ProfileMatrix stores learned spectral templates as one contiguous,
+ * SIMD-aligned, row-major matrix (profiles x bins). Each row is padded
+ * with zeros to a whole number of SIMD registers so the similarity of an
+ * input spectrum against every template is a single vectorised
+ * matrix-vector product.
+ */
+class ProfileMatrix
+{
+public:
+    ProfileMatrix();
+    
+    /**
+     * Removes all rows and forgets the bin count
+     */
+    void clear();
+    
+    /**
+     * Appends a row. The first row added fixes the number of bins; later rows
+     * are truncated or zero-padded to match.
+     * @param data Row values
+     * @param size Number of values in data
+     * @return Index of the new row
+     */
+    int addRow(const float* data, int size);
+    
+    /**
+     * Overwrites an existing row (truncated or zero-padded to the bin count)
+     * @param row Row index
+     * @param data Row values
+     * @param size Number of values in data
+     */
+    void setRow(int row, const float* data, int size);
+    
+    /**
+     * Overwrites a single value
+     * @param row Row index
+     * @param bin Bin index
+     * @param value New value
+     */
+    void setValue(int row, int bin, float value);
+    
+    /**
+     * Changes the number of bins, keeping each row's existing values; added bins are zero.
+     * Rows are laid out again in place when the storage is big enough for the new
+     * width (see reserve), and reallocated otherwise.
+     * @param newNumBins Number of bins per row
+     */
+    void setNumBins(int newNumBins);
+    
+    /**
+     * Removes a row, shifting the following rows up
+     * @param row Row index
+     */
+    void removeRow(int row);
+    
+    /**
+     * Preallocates storage for a number of rows of up to numBinsPerRow bins, so
+     * neither adding those rows nor widening them with setNumBins allocates.
+     * Also takes the matrix's own copy of external rows.
+     * @param numRowsToReserve Number of rows
+     * @param numBinsPerRow Number of bins; also the bin count if the matrix has no rows yet
+     */
+    void reserve(int numRowsToReserve, int numBinsPerRow);
+    
+    /**
+     * Uses rows stored elsewhere (e.g. a memory-mapped profile file) without copying.
+     * The data must stay valid while the matrix refers to it; the first change
+     * to the matrix copies the rows into its own storage. If the rows aren't
+     * SIMD-aligned they are copied straight away.
+     * @param data First row
+     * @param numRowsInData Number of rows
+     * @param numBinsPerRow Number of bins per row
+     * @param rowStrideInData Distance between rows in floats; padding must be zero
+     * @return True if the data is used in place, false if it was copied
+     */
+    bool useExternalData(const float* data, int numRowsInData, int numBinsPerRow, int rowStrideInData);
+    
+    /**
+     * Checks whether rows at this address and stride can be used in place
+     * @param data First row
+     * @param stride Distance between rows in floats
+     * @return True if every row starts on a SIMD boundary
+     */
+    static bool isSIMDCompatible(const float* data, int stride);
+    
+    const float* getRow(int row) const;
+    
+    /**
+     * Checks whether the rows live in external storage (see useExternalData)
+     * @return True until the matrix is first changed
+     */
+    bool isUsingExternalData() const { return externalData != nullptr; }
+    
+    int getNumRows() const { return numRows; }
+    int getNumBins() const { return numBins; }
+    int getRowStride() const { return rowStride; }
+    
+    /**
+     * Computes output[r] = dot(row r, input) for every row
+     * @param input SIMD-aligned input, at least getRowStride() floats with zero padding
+     * @param output Destination for getNumRows() values
+     */
+    void multiply(const float* input, float* output) const;
+    
+    /**
+     * Computes dot(row, input) for a single row
+     * @param row Row index
+     * @param input SIMD-aligned input, at least getRowStride() floats with zero padding
+     * @return Dot product
+     */
+    float dotRow(int row, const float* input) const;
+
+private:
+    std::vector<float> storage;
+    float* alignedData;
+    const float* externalData;
+    int numRows;
+    int numBins;
+    int rowStride;
+    int rowCapacity;
+    
+    void reallocate(int newRowCapacity, int newRowStride);
+    void makeWritable();
+    const float* getData() const { return externalData != nullptr ? externalData : alignedData; }
+    float* getRowPointer(int row) { return alignedData + static_cast<size_t>(row) * static_cast<size_t>(rowStride); }
+};
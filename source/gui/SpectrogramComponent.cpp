@@ -11,6 +11,7 @@ SpectrogramComponent::SpectrogramComponent()
     // Initialize FFT data
     fftData.resize(kMaxFFTSize, 0.0f);
     peakData.resize(kMaxFFTSize, 0.0f);
+    pulledSpectrum.resize(kMaxFFTSize, 0.0f);
     
     // Initialize frequency scale
     for (size_t i = 0; i < frequencyScale.size(); ++i)
@@ -387,8 +388,25 @@ void SpectrogramComponent::setColours(juce::Colour background, juce::Colour fore
     repaint();
 }
 
+void SpectrogramComponent::setSpectrumSource(SpectrumFifo* source)
+{
+    spectrumSource = source;
+}
+
 void SpectrogramComponent::timerCallback()
 {
+    // Draw only the newest spectrum; frames that arrived in between are skipped
+    if (spectrumSource != nullptr)
+    {
+        const int size = spectrumSource->pullLatest(pulledSpectrum.data(), kMaxFFTSize);
+        
+        if (size > 0)
+        {
+            updateFFT(pulledSpectrum.data(), size);
+            return;
+        }
+    }
+    
     // Trigger a repaint to update any animations
     repaint();
 }
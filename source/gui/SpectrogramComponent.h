@@ -2,6 +2,7 @@
 
 #include <juce_gui_basics/juce_gui_basics.h>
 #include <juce_audio_basics/juce_audio_basics.h>
+#include "../utils/SpectrumFifo.h"
 #include <vector>
 #include <array>
 #include <deque>
@@ -22,6 +23,9 @@ public:
     // Update the component with new FFT data
     void updateFFT(const float* fftData, int size);
     
+    // Set the FIFO the timer pulls new spectra from (must outlive this component, or be reset to nullptr)
+    void setSpectrumSource(SpectrumFifo* source);
+    
     // Get the callback lock for thread safety
     juce::CriticalSection& getCallbackLock() { return callbackLock; }
     
@@ -92,6 +96,10 @@ private:
     // Thread safety
     juce::CriticalSection callbackLock;
     
+    // Spectrum source and the buffer its frames are pulled into
+    SpectrumFifo* spectrumSource = nullptr;
+    std::vector<float> pulledSpectrum;
+    
     // Custom colors
     juce::Colour backgroundColour;
     juce::Colour foregroundColour;
@@ -3,127 +3,148 @@
 MIDIManager::MIDIManager()
     : midiChannel(1),
       midiVelocity(100),
+      noteOnDelayMs(0),
+      noteOffDelayMs(0),
       noteOnDelaySamples(0),
       noteOffDelaySamples(0),
       sampleRate(44100.0)
 {
     setNoteOnDelayMs(50);   // 50ms delay before sending note-on
     setNoteOffDelayMs(100); // 100ms delay before sending note-off
+    
+    noteOnElapsed.fill(0);
+    noteOffElapsed.fill(0);
+    noteLevels.fill(0.0f);
+    noteOnPeakLevels.fill(0.0f);
 }
 
 MIDIManager::~MIDIManager()
 {
 }
 
-void MIDIManager::processNotes(const std::vector<int>& detectedNotes, juce::MidiBuffer& midiBuffer, int sampleNumber)
+int MIDIManager::VelocityCurve::getVelocity(float levelDb) const
 {
-    // Convert detected notes to a set for easier comparison
-    std::set<int> currentNotes(detectedNotes.begin(), detectedNotes.end());
+    const float range = maxLevelDb - minLevelDb;
+    const float position = range > 0.0f ? juce::jlimit(0.0f, 1.0f, (levelDb - minLevelDb) / range)
+                                        : (levelDb >= maxLevelDb ? 1.0f : 0.0f);
+    const float shaped = std::pow(position, juce::jmax(0.01f, exponent));
     
-    // Process pending note-offs
-    std::vector<int> notesToRemove;
+    return juce::jlimit(1, 127, minVelocity + juce::roundToInt(shaped * static_cast<float>(maxVelocity - minVelocity)));
+}
+
+void MIDIManager::processNotes(const std::vector<int>& detectedNotes, juce::MidiBuffer& midiBuffer,
+                               int sampleNumber, int elapsedSamples)
+{
+    NoteSet notes;
+    for (int note : detectedNotes)
+        notes.set(note);
     
-    for (auto& pair : pendingNoteOffs)
+    processFrame(notes, notes, false, midiBuffer, sampleNumber, elapsedSamples);
+}
+
+void MIDIManager::processNotes(const NoteEvent* events, int numEvents, juce::MidiBuffer& midiBuffer,
+                               int sampleNumber, int elapsedSamples)
+{
+    // Split the detections by the two confidence thresholds
+    NoteSet strongNotes, weakNotes;
+    
+    for (int i = 0; i < numEvents; ++i)
     {
-        int note = pair.first;
-        int& samplesRemaining = pair.second;
+        const auto& event = events[i];
         
-        // If the note is detected again, remove it from pending note-offs
-        if (currentNotes.find(note) != currentNotes.end())
-        {
-            notesToRemove.push_back(note);
+        if (!juce::isPositiveAndBelow(event.midiNote, numMidiNotes))
             continue;
-        }
         
-        // Decrement counter
-        samplesRemaining--;
+        noteLevels[static_cast<size_t>(event.midiNote)] = event.levelDb;
         
-        // If countdown is complete, send note-off
-        if (samplesRemaining <= 0)
-        {
-            if (activeNotes.find(note) != activeNotes.end())
-            {
-                juce::MidiMessage noteOff = juce::MidiMessage::noteOff(midiChannel, note, 0.0f);
-                midiBuffer.addEvent(noteOff, sampleNumber);
-                activeNotes.erase(note);
-            }
-            notesToRemove.push_back(note);
-        }
+        if (event.confidence >= onConfidence)
+            strongNotes.set(event.midiNote);
+        
+        if (event.confidence >= offConfidence)
+            weakNotes.set(event.midiNote);
     }
     
-    // Remove processed note-offs
-    for (int note : notesToRemove)
-    {
-        pendingNoteOffs.erase(note);
-    }
+    processFrame(strongNotes, weakNotes, true, midiBuffer, sampleNumber, elapsedSamples);
+}
+
+void MIDIManager::processFrame(const NoteSet& strongNotes, const NoteSet& weakNotes, bool hasLevels,
+                               juce::MidiBuffer& midiBuffer, int sampleNumber, int elapsedSamples)
+{
+    const int elapsed = juce::jmax(0, elapsedSamples);
     
-    // Find notes to turn off (notes that were active but are no longer detected)
-    for (int note : activeNotes)
-    {
-        if (currentNotes.find(note) == currentNotes.end() && 
-            pendingNoteOffs.find(note) == pendingNoteOffs.end())
-        {
-            // Add to pending note-offs
-            pendingNoteOffs[note] = noteOffDelaySamples;
-        }
-    }
+    // Sounding notes only need the off-threshold to stay present; new notes need the on-threshold
+    const NoteSet presentNotes = (activeNotes & weakNotes) | (~activeNotes & strongNotes);
     
-    // Process pending note-ons
-    std::vector<int> notesToSend;
+    // Note-offs: notes that are present again are no longer pending. The rest accumulate
+    // absent time, starting from zero in the frame they first went missing.
+    pendingNoteOffs &= ~presentNotes;
     
-    for (int note : currentNotes)
-    {
-        // If the note is already active, skip it
-        if (activeNotes.find(note) != activeNotes.end())
-            continue;
-        
-        // If the note is not in pending note-ons yet, add it
-        if (pendingNoteOns.find(note) == pendingNoteOns.end())
+    pendingNoteOffs.forEach([this, elapsed](int note) {
+        noteOffElapsed[static_cast<size_t>(note)] += elapsed;
+    });
+    
+    const NoteSet releasedNotes = activeNotes & ~presentNotes & ~pendingNoteOffs;
+    releasedNotes.forEach([this](int note) {
+        noteOffElapsed[static_cast<size_t>(note)] = 0;
+    });
+    pendingNoteOffs |= releasedNotes;
+    
+    NoteSet expiredNoteOffs;
+    pendingNoteOffs.forEach([this, &expiredNoteOffs, &midiBuffer, sampleNumber](int note) {
+        if (noteOffElapsed[static_cast<size_t>(note)] >= noteOffDelaySamples)
         {
-            pendingNoteOns.insert(note);
-            continue;
+            midiBuffer.addEvent(juce::MidiMessage::noteOff(midiChannel, note, 0.0f), sampleNumber);
+            expiredNoteOffs.set(note);
         }
+    });
+    
+    activeNotes &= ~expiredNoteOffs;
+    pendingNoteOffs &= ~expiredNoteOffs;
+    
+    // Note-ons: pending notes that dropped out start over; the others accumulate
+    // detected time and keep their loudest level, and new ones start from zero
+    const NoteSet candidateNotes = presentNotes & ~activeNotes;
+    pendingNoteOns &= candidateNotes;
+    
+    pendingNoteOns.forEach([this, elapsed, hasLevels](int note) {
+        const auto index = static_cast<size_t>(note);
+        noteOnElapsed[index] += elapsed;
         
-        // If the note has been pending long enough, send note-on
-        if (pendingNoteOns.find(note) != pendingNoteOns.end())
-        {
-            notesToSend.push_back(note);
-        }
-    }
+        if (hasLevels)
+            noteOnPeakLevels[index] = juce::jmax(noteOnPeakLevels[index], noteLevels[index]);
+    });
     
-    // Send note-on messages for validated notes
-    for (int note : notesToSend)
-    {
-        juce::MidiMessage noteOn = juce::MidiMessage::noteOn(midiChannel, note, (float)midiVelocity / 127.0f);
-        midiBuffer.addEvent(noteOn, sampleNumber);
-        activeNotes.insert(note);
-        pendingNoteOns.erase(note);
-    }
+    const NoteSet newNotes = candidateNotes & ~pendingNoteOns;
+    newNotes.forEach([this, hasLevels](int note) {
+        const auto index = static_cast<size_t>(note);
+        noteOnElapsed[index] = 0;
+        noteOnPeakLevels[index] = hasLevels ? noteLevels[index] : velocityCurve.minLevelDb;
+    });
+    pendingNoteOns |= newNotes;
     
-    // Remove notes from pending note-ons if they're no longer detected
-    std::vector<int> pendingToRemove;
-    for (int note : pendingNoteOns)
-    {
-        if (currentNotes.find(note) == currentNotes.end())
+    NoteSet confirmedNotes;
+    pendingNoteOns.forEach([this, &confirmedNotes, &midiBuffer, sampleNumber, hasLevels](int note) {
+        if (noteOnElapsed[static_cast<size_t>(note)] >= noteOnDelaySamples)
         {
-            pendingToRemove.push_back(note);
+            // Frames without levels (e.g. from a plain note list) keep the fixed velocity
+            const int velocity = velocityFromLevel && hasLevels
+                                     ? velocityCurve.getVelocity(noteOnPeakLevels[static_cast<size_t>(note)])
+                                     : midiVelocity;
+            midiBuffer.addEvent(juce::MidiMessage::noteOn(midiChannel, note, (float)velocity / 127.0f), sampleNumber);
+            confirmedNotes.set(note);
         }
-    }
+    });
     
-    for (int note : pendingToRemove)
-    {
-        pendingNoteOns.erase(note);
-    }
+    activeNotes |= confirmedNotes;
+    pendingNoteOns &= ~confirmedNotes;
 }
 
 void MIDIManager::reset(juce::MidiBuffer& midiBuffer, int sampleNumber)
 {
     // Send note-off messages for all active notes
-    for (int note : activeNotes)
-    {
-        juce::MidiMessage noteOff = juce::MidiMessage::noteOff(midiChannel, note, 0.0f);
-        midiBuffer.addEvent(noteOff, sampleNumber);
-    }
+    activeNotes.forEach([this, &midiBuffer, sampleNumber](int note) {
+        midiBuffer.addEvent(juce::MidiMessage::noteOff(midiChannel, note, 0.0f), sampleNumber);
+    });
     
     // Clear all states
     activeNotes.clear();
@@ -141,16 +162,34 @@ void MIDIManager::setMidiVelocity(int velocity)
     midiVelocity = juce::jlimit(0, 127, velocity);
 }
 
+void MIDIManager::setVelocityFromLevelEnabled(bool shouldBeEnabled)
+{
+    velocityFromLevel = shouldBeEnabled;
+}
+
+void MIDIManager::setVelocityCurve(const VelocityCurve& curve)
+{
+    velocityCurve = curve;
+    velocityCurve.minVelocity = juce::jlimit(1, 127, curve.minVelocity);
+    velocityCurve.maxVelocity = juce::jlimit(velocityCurve.minVelocity, 127, curve.maxVelocity);
+}
+
 void MIDIManager::setNoteOnDelayMs(int ms)
 {
-    double delaySeconds = ms / 1000.0;
-    noteOnDelaySamples = static_cast<int>(delaySeconds * sampleRate);
+    noteOnDelayMs = juce::jmax(0, ms);
+    noteOnDelaySamples = static_cast<int>(noteOnDelayMs * sampleRate / 1000.0);
 }
 
 void MIDIManager::setNoteOffDelayMs(int ms)
 {
-    double delaySeconds = ms / 1000.0;
-    noteOffDelaySamples = static_cast<int>(delaySeconds * sampleRate);
+    noteOffDelayMs = juce::jmax(0, ms);
+    noteOffDelaySamples = static_cast<int>(noteOffDelayMs * sampleRate / 1000.0);
+}
+
+void MIDIManager::setConfidenceThresholds(float onThreshold, float offThreshold)
+{
+    onConfidence = onThreshold;
+    offConfidence = juce::jmin(offThreshold, onThreshold);
 }
 
 void MIDIManager::updateSampleRate(double newSampleRate)
@@ -160,8 +199,8 @@ void MIDIManager::updateSampleRate(double newSampleRate)
     {
         sampleRate = newSampleRate;
         
-        // Recalculate sample delays
-        setNoteOnDelayMs(static_cast<int>(noteOnDelaySamples * 1000.0 / sampleRate));
-        setNoteOffDelayMs(static_cast<int>(noteOffDelaySamples * 1000.0 / sampleRate));
+        // The delays are kept in milliseconds, so only their sample counts change
+        setNoteOnDelayMs(noteOnDelayMs);
+        setNoteOffDelayMs(noteOffDelayMs);
     }
-}
\ No newline at end of file
+}
@@ -1,16 +1,48 @@
 #pragma once
 
 #include <juce_audio_basics/juce_audio_basics.h>
-#include <set>
+#include "NoteSet.h"
+#include "../dsp/NoteEvent.h"
+#include <array>
 #include <vector>
 
 /**
  * MIDIManager handles the generation and management of MIDI messages
  * for pitch detection output.
+ *
+ * Notes are debounced in time: a note is sent once it has been detected for the
+ * note-on delay, and released once it has been absent for the note-off delay.
+ * Time advances by the samples elapsed between analysis frames, so the delays
+ * mean the same thing for any FFT size, overlap or sample rate. Notes can also
+ * be debounced on confidence: a note must reach the on-threshold to start, but
+ * only has to stay above the lower off-threshold to keep sounding.
+ *
+ * Note-on velocities are either fixed, or follow the detector's level estimate
+ * through a velocity curve. The loudest level seen while a note is being
+ * confirmed is used, which catches the attack rather than the decay.
  */
 class MIDIManager
 {
 public:
+    /**
+     * Maps note levels to MIDI velocities
+     */
+    struct VelocityCurve
+    {
+        float minLevelDb = -60.0f;  // Level that maps to minVelocity
+        float maxLevelDb = -12.0f;  // Level that maps to maxVelocity
+        float exponent = 1.0f;      // Curve shape; below 1 lifts quiet notes, above 1 lowers them
+        int minVelocity = 1;
+        int maxVelocity = 127;
+        
+        /**
+         * Maps a level to a velocity
+         * @param levelDb Note level in dBFS
+         * @return Velocity between minVelocity and maxVelocity
+         */
+        int getVelocity(float levelDb) const;
+    };
+    
     /**
      * Constructor
      */
@@ -22,12 +54,27 @@ public:
     ~MIDIManager();
     
     /**
-     * Process a new set of detected notes, generating MIDI messages as needed
+     * Process the notes of one analysis frame, generating MIDI messages as needed.
+     * Every note counts as fully confident.
      * @param detectedNotes Vector of MIDI note numbers
      * @param midiBuffer MIDI buffer to add messages to
      * @param sampleNumber Sample position for the MIDI messages
+     * @param elapsedSamples Samples since the previous frame (the analysis hop size)
+     */
+    void processNotes(const std::vector<int>& detectedNotes, juce::MidiBuffer& midiBuffer,
+                      int sampleNumber, int elapsedSamples);
+    
+    /**
+     * Process the note events of one analysis frame, using their confidences for the
+     * hysteresis and their levels for the velocity
+     * @param events Detected notes
+     * @param numEvents Number of events
+     * @param midiBuffer MIDI buffer to add messages to
+     * @param sampleNumber Sample position for the MIDI messages
+     * @param elapsedSamples Samples since the previous frame (the analysis hop size)
      */
-    void processNotes(const std::vector<int>& detectedNotes, juce::MidiBuffer& midiBuffer, int sampleNumber);
+    void processNotes(const NoteEvent* events, int numEvents, juce::MidiBuffer& midiBuffer,
+                      int sampleNumber, int elapsedSamples);
     
     /**
      * Resets the manager, turning off all active notes
@@ -48,6 +95,30 @@ public:
      */
     void setMidiVelocity(int velocity);
     
+    /**
+     * Chooses between the fixed velocity and velocities that follow the note levels
+     * @param shouldBeEnabled True to map note levels through the velocity curve
+     */
+    void setVelocityFromLevelEnabled(bool shouldBeEnabled);
+    
+    /**
+     * Checks if velocities follow the note levels
+     * @return True if the velocity curve is used
+     */
+    bool isVelocityFromLevelEnabled() const { return velocityFromLevel; }
+    
+    /**
+     * Sets the curve that maps note levels to velocities
+     * @param curve New velocity curve
+     */
+    void setVelocityCurve(const VelocityCurve& curve);
+    
+    /**
+     * Gets the velocity curve
+     * @return Current velocity curve
+     */
+    const VelocityCurve& getVelocityCurve() const { return velocityCurve; }
+    
     /**
      * Sets the minimum time in milliseconds a note must be detected 
      * before sending a note-on message
@@ -61,23 +132,47 @@ public:
      * @param ms Time in milliseconds
      */
     void setNoteOffDelayMs(int ms);
+    
+    /**
+     * Sets the confidence hysteresis. A note starts once its confidence reaches the
+     * on-threshold and counts as present while it stays at or above the off-threshold.
+     * @param onThreshold Confidence needed to start a note (0 accepts every detection)
+     * @param offThreshold Confidence needed to keep it; clamped to the on-threshold
+     */
+    void setConfidenceThresholds(float onThreshold, float offThreshold);
 
+    /**
+     * Sets the sample rate the delays are converted with
+     * @param newSampleRate Sample rate in Hz
+     */
     void updateSampleRate(double newSampleRate);
     
 private:
-    std::set<int> activeNotes;         // Currently active (sounding) notes
-    std::set<int> pendingNoteOns;      // Notes waiting to be turned on
-    std::map<int, int> pendingNoteOffs; // Notes waiting to be turned off <note, samplesRemaining>
+    // Note state as fixed-size bitsets, so each frame is a handful of word operations
+    static constexpr int numMidiNotes = NoteSet::numNotes;
+    NoteSet activeNotes;                // Currently active (sounding) notes
+    NoteSet pendingNoteOns;             // Notes waiting to be turned on
+    NoteSet pendingNoteOffs;            // Notes waiting to be turned off
+    std::array<int, numMidiNotes> noteOnElapsed;    // Samples each pending note-on has been detected for
+    std::array<int, numMidiNotes> noteOffElapsed;   // Samples each pending note-off has been absent for
+    std::array<float, numMidiNotes> noteLevels;     // Level of each note in the current frame
+    std::array<float, numMidiNotes> noteOnPeakLevels; // Loudest level of each pending note-on
     
     int midiChannel;
     int midiVelocity;
     
+    int noteOnDelayMs;
+    int noteOffDelayMs;
     int noteOnDelaySamples;
     int noteOffDelaySamples;
     double sampleRate;
     
-    /**
-     * Updates the sample rate dependent parameters
-     * @param newSampleRate New sample rate in Hz
-     */
+    float onConfidence = 0.0f;
+    float offConfidence = 0.0f;
+    
+    bool velocityFromLevel = false;
+    VelocityCurve velocityCurve;
+    
+    void processFrame(const NoteSet& strongNotes, const NoteSet& weakNotes, bool hasLevels,
+                      juce::MidiBuffer& midiBuffer, int sampleNumber, int elapsedSamples);
 };
\ No newline at end of file
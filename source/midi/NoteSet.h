@@ -0,0 +1,60 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+/**
+ * NoteSet is a fixed-size set of MIDI notes (0-127) stored as a 128-bit mask.
+ *
+ * Set algebra (union, intersection, difference) is two word operations, and
+ * iterating over the members only visits set bits, in ascending note order.
+ * It never allocates, so it can be used freely on the audio thread.
+ */
+class NoteSet
+{
+public:
+    static constexpr int numNotes = 128;
+    
+    NoteSet() = default;
+    
+    void set(int note)              { if (isValid(note)) words[note >> 6] |= bit(note); }
+    void reset(int note)            { if (isValid(note)) words[note >> 6] &= ~bit(note); }
+    bool contains(int note) const   { return isValid(note) && (words[note >> 6] & bit(note)) != 0; }
+    
+    void clear()                    { words[0] = words[1] = 0; }
+    bool isEmpty() const            { return (words[0] | words[1]) == 0; }
+    int size() const                { return juce::countNumberOfBits(words[0]) + juce::countNumberOfBits(words[1]); }
+    
+    NoteSet operator| (const NoteSet& other) const { return { words[0] | other.words[0], words[1] | other.words[1] }; }
+    NoteSet operator& (const NoteSet& other) const { return { words[0] & other.words[0], words[1] & other.words[1] }; }
+    NoteSet operator~() const                      { return { ~words[0], ~words[1] }; }
+    NoteSet& operator|= (const NoteSet& other)     { return *this = *this | other; }
+    NoteSet& operator&= (const NoteSet& other)     { return *this = *this & other; }
+    bool operator== (const NoteSet& other) const   { return words[0] == other.words[0] && words[1] == other.words[1]; }
+    bool operator!= (const NoteSet& other) const   { return !(*this == other); }
+    
+    /**
+     * Calls a function for every note in the set, lowest note first
+     * @param callback Function taking the MIDI note number
+     */
+    template <typename Callback>
+    void forEach(Callback&& callback) const
+    {
+        for (int w = 0; w < 2; ++w)
+        {
+            for (juce::uint64 remaining = words[w]; remaining != 0; remaining &= remaining - 1)
+            {
+                // Index of the lowest set bit: the number of ones below it once it is isolated
+                const int index = juce::countNumberOfBits((remaining & (~remaining + 1)) - 1);
+                callback(w * 64 + index);
+            }
+        }
+    }
+
+private:
+    NoteSet(juce::uint64 low, juce::uint64 high) : words { low, high } {}
+    
+    static bool isValid(int note)           { return note >= 0 && note < numNotes; }
+    static juce::uint64 bit(int note)       { return juce::uint64 { 1 } << (note & 63); }
+    
+    juce::uint64 words[2] = { 0, 0 };
+};
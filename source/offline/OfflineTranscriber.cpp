@@ -0,0 +1,206 @@
+#include "OfflineTranscriber.h"
+
+OfflineTranscriber::OfflineTranscriber(const PitchDetector& templates, const Settings& transcriberSettings)
+    : settings(transcriberSettings),
+      detector(templates.getMaxPolyphony())
+{
+    settings.fftSize = juce::jmax(64, juce::nextPowerOfTwo(settings.fftSize));
+    settings.blockSize = juce::jmax(1, settings.blockSize);
+    
+    // The copy is private to this transcriber, so it can run beside the others
+    detector.copyProfilesFrom(templates, 0, 127);
+    
+    fftProcessor = std::make_unique<FFTProcessor>(settings.fftSize);
+    fftProcessor->setOverlapFactor(settings.overlapFactor);
+    fftProcessor->setInputGateEnabled(settings.inputGateEnabled);
+    fftProcessor->setSpectrumDataCallback([this](const float* spectrum, int size, int sampleOffset) {
+        handleSpectrum(spectrum, size, sampleOffset);
+    });
+    
+    midiManager.setMidiChannel(settings.midiChannel);
+    midiManager.setMidiVelocity(settings.midiVelocity);
+    midiManager.setVelocityFromLevelEnabled(settings.velocityFromLevel);
+    midiManager.setNoteOnDelayMs(settings.noteOnDelayMs);
+    midiManager.setNoteOffDelayMs(settings.noteOffDelayMs);
+    
+    readBuffer.setSize(2, settings.blockSize);
+}
+
+OfflineTranscriber::~OfflineTranscriber()
+{
+}
+
+juce::Result OfflineTranscriber::transcribe(juce::AudioFormatReader& reader, juce::MidiMessageSequence& sequence)
+{
+    if (reader.sampleRate <= 0.0 || reader.numChannels == 0)
+        return juce::Result::fail("The recording has no audio");
+    
+    // Linear-bin templates only line up with spectra taken at the rate they were learned at
+    if (settings.requiredSampleRate > 0.0 && std::abs(reader.sampleRate - settings.requiredSampleRate) > 0.5)
+        return juce::Result::fail("The recording is at " + juce::String(reader.sampleRate, 0) + " Hz, but the profile was learned at "
+                                  + juce::String(settings.requiredSampleRate, 0) + " Hz");
+    
+    start(reader.sampleRate);
+    
+    const bool isStereo = reader.numChannels > 1;
+    
+    for (juce::int64 position = 0; position < reader.lengthInSamples;)
+    {
+        const int numSamples = static_cast<int>(juce::jmin(static_cast<juce::int64>(settings.blockSize),
+                                                           reader.lengthInSamples - position));
+        
+        if (!reader.read(&readBuffer, 0, numSamples, position, true, isStereo))
+            return juce::Result::fail("Could not read the recording");
+        
+        // Mix to mono like the plugin does
+        if (isStereo)
+        {
+            StageTimings::Stopwatch stopwatch(stageTimings);
+            readBuffer.addFrom(0, 0, readBuffer, 1, 0, numSamples);
+            readBuffer.applyGain(0, 0, numSamples, 0.5f);
+            stopwatch.lap(StageTimings::Stage::mixdown);
+        }
+        
+        processBlock(readBuffer.getReadPointer(0), numSamples, sequence);
+        position += numSamples;
+    }
+    
+    finish(sequence);
+    return juce::Result::ok();
+}
+
+void OfflineTranscriber::transcribe(const juce::AudioBuffer<float>& audio, double newSampleRate,
+                                    juce::MidiMessageSequence& sequence)
+{
+    start(newSampleRate);
+    
+    const int numSamples = audio.getNumChannels() > 0 ? audio.getNumSamples() : 0;
+    
+    for (int position = 0; position < numSamples; position += settings.blockSize)
+        processBlock(audio.getReadPointer(0, position), juce::jmin(settings.blockSize, numSamples - position), sequence);
+    
+    finish(sequence);
+}
+
+juce::Result OfflineTranscriber::transcribeFile(const juce::File& audioFile, const juce::File& midiFile,
+                                                juce::AudioFormatManager& formatManager)
+{
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(audioFile));
+    
+    if (reader == nullptr)
+        return juce::Result::fail("Could not open " + audioFile.getFullPathName() + " as audio");
+    
+    juce::MidiMessageSequence sequence;
+    const auto result = transcribe(*reader, sequence);
+    
+    if (result.failed())
+        return result;
+    
+    if (!writeMidiFile(sequence, midiFile))
+        return juce::Result::fail("Could not write " + midiFile.getFullPathName());
+    
+    return juce::Result::ok();
+}
+
+bool OfflineTranscriber::writeMidiFile(const juce::MidiMessageSequence& sequence, const juce::File& file)
+{
+    // At 120 bpm a quarter note lasts half a second
+    constexpr double ticksPerSecond = midiTicksPerQuarterNote * 2.0;
+    
+    juce::MidiMessageSequence track;
+    track.addEvent(juce::MidiMessage::tempoMetaEvent(500000));
+    
+    double endTime = 0.0;
+    
+    for (int i = 0; i < sequence.getNumEvents(); ++i)
+    {
+        juce::MidiMessage message(sequence.getEventPointer(i)->message);
+        message.setTimeStamp(std::round(message.getTimeStamp() * ticksPerSecond));
+        endTime = juce::jmax(endTime, message.getTimeStamp());
+        track.addEvent(message);
+    }
+    
+    auto endOfTrack = juce::MidiMessage::endOfTrack();
+    endOfTrack.setTimeStamp(endTime);
+    track.addEvent(endOfTrack);
+    track.updateMatchedPairs();
+    
+    juce::MidiFile midiFile;
+    midiFile.setTicksPerQuarterNote(midiTicksPerQuarterNote);
+    midiFile.addTrack(track);
+    
+    file.deleteFile();
+    juce::FileOutputStream stream(file);
+    
+    if (!stream.openedOk())
+        return false;
+    
+    return midiFile.writeTo(stream);
+}
+
+double OfflineTranscriber::getLastDurationSeconds() const
+{
+    return sampleRate > 0.0 ? static_cast<double>(blockStartSample) / sampleRate : 0.0;
+}
+
+void OfflineTranscriber::setStageTimings(StageTimings* timings)
+{
+    stageTimings = timings;
+    fftProcessor->setStageTimings(stageTimings);
+    detector.setStageTimings(stageTimings);
+}
+
+void OfflineTranscriber::start(double newSampleRate)
+{
+    sampleRate = newSampleRate;
+    blockStartSample = 0;
+    
+    // Nothing carries over from the previous recording
+    detector.prepare(sampleRate, settings.fftSize);
+    detector.reset();
+    fftProcessor->reset();
+    midiManager.updateSampleRate(sampleRate);
+    midiManager.reset(blockMidi, 0);
+    blockMidi.clear();
+}
+
+void OfflineTranscriber::processBlock(const float* samples, int numSamples, juce::MidiMessageSequence& sequence)
+{
+    fftProcessor->processBlock(samples, numSamples);
+    collectMidi(sequence);
+    blockStartSample += numSamples;
+}
+
+void OfflineTranscriber::handleSpectrum(const float* spectrum, int spectrumSize, int sampleOffset)
+{
+    // Frames skipped by the input gate still advance the note timers, with no notes
+    int numEvents = 0;
+    
+    if (spectrum != nullptr)
+        numEvents = detector.processSpectrum(spectrum, spectrumSize, frameEvents.data(),
+                                             static_cast<int>(frameEvents.size()), blockStartSample + sampleOffset);
+    
+    StageTimings::Stopwatch stopwatch(stageTimings);
+    midiManager.processNotes(frameEvents.data(), numEvents, blockMidi, sampleOffset, fftProcessor->getHopSize());
+    stopwatch.lap(StageTimings::Stage::midiGeneration);
+}
+
+void OfflineTranscriber::collectMidi(juce::MidiMessageSequence& sequence)
+{
+    for (const auto metadata : blockMidi)
+    {
+        auto message = metadata.getMessage();
+        message.setTimeStamp(static_cast<double>(blockStartSample + metadata.samplePosition) / sampleRate);
+        sequence.addEvent(message);
+    }
+    
+    blockMidi.clear();
+}
+
+void OfflineTranscriber::finish(juce::MidiMessageSequence& sequence)
+{
+    // Release whatever is still sounding at the end of the recording
+    midiManager.reset(blockMidi, 0);
+    collectMidi(sequence);
+    sequence.updateMatchedPairs();
+}
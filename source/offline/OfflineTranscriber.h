@@ -0,0 +1,120 @@
+#pragma once
+
+#include <juce_audio_formats/juce_audio_formats.h>
+#include "../dsp/FFTProcessor.h"
+#include "../dsp/NoteEvent.h"
+#include "../dsp/PitchDetector.h"
+#include "../midi/MIDIManager.h"
+#include <array>
+#include <memory>
+
+/**
+ * OfflineTranscriber runs the plugin's analysis chain (FFTProcessor, PitchDetector,
+ * MIDIManager) over recorded audio and collects the MIDI it produces.
+ *
+ * Nothing waits on a clock, so a recording is transcribed as fast as the frames can
+ * be analysed. Each transcriber owns its own analysers and a copy of the templates;
+ * the detector the templates come from is only read, so one loaded profile can feed
+ * a transcriber per thread.
+ */
+class OfflineTranscriber
+{
+public:
+    struct Settings
+    {
+        int fftSize = 4096;
+        float overlapFactor = 0.75f;
+        int blockSize = 4096;               // Samples read from the file at a time
+        int midiChannel = 1;
+        int noteOnDelayMs = 50;
+        int noteOffDelayMs = 100;
+        int midiVelocity = 100;             // Used when velocityFromLevel is off
+        bool velocityFromLevel = true;
+        bool inputGateEnabled = true;       // Skip the FFT on silent stretches
+        double requiredSampleRate = 0.0;    // Only accept recordings at this rate (linear-bin templates), or 0 for any
+    };
+    
+    /**
+     * Constructor
+     * @param templates Detector whose templates and detection settings are copied
+     * @param settings Analysis and MIDI settings
+     */
+    OfflineTranscriber(const PitchDetector& templates, const Settings& settings);
+    
+    /**
+     * Destructor
+     */
+    ~OfflineTranscriber();
+    
+    /**
+     * Transcribes a whole recording. Stereo (or wider) recordings are analysed as the
+     * mix of their first two channels, like the plugin's input.
+     * @param reader Recording to read
+     * @param sequence Receives the MIDI, timestamped in seconds from the start of the recording
+     * @return Error description if the recording can't be analysed with these templates
+     */
+    juce::Result transcribe(juce::AudioFormatReader& reader, juce::MidiMessageSequence& sequence);
+    
+    /**
+     * Transcribes audio that is already in memory
+     * @param audio Mono audio (only the first channel is analysed)
+     * @param sampleRate Sample rate of the audio
+     * @param sequence Receives the MIDI, timestamped in seconds from the start of the audio
+     */
+    void transcribe(const juce::AudioBuffer<float>& audio, double sampleRate, juce::MidiMessageSequence& sequence);
+    
+    /**
+     * Transcribes an audio file to a Standard MIDI File
+     * @param audioFile Recording in any format the manager can read
+     * @param midiFile File to write; replaced if it exists
+     * @param formatManager Format manager used to open the recording
+     * @return Error description if the recording couldn't be read or the MIDI file written
+     */
+    juce::Result transcribeFile(const juce::File& audioFile, const juce::File& midiFile,
+                                juce::AudioFormatManager& formatManager);
+    
+    /**
+     * Writes a sequence timestamped in seconds as a single-track MIDI file at 120 bpm
+     * @param sequence MIDI to write
+     * @param file File to write; replaced if it exists
+     * @return True if the file was written
+     */
+    static bool writeMidiFile(const juce::MidiMessageSequence& sequence, const juce::File& file);
+    
+    /**
+     * Gets the length of the last transcribed recording
+     * @return Duration in seconds
+     */
+    double getLastDurationSeconds() const;
+    
+    /**
+     * Records the time of each analysis stage; one instance can be shared by
+     * transcribers on several threads
+     * @param timings Timing statistics, or nullptr to stop timing
+     */
+    void setStageTimings(StageTimings* timings);
+    
+    static constexpr int midiTicksPerQuarterNote = 960;
+
+private:
+    Settings settings;
+    PitchDetector detector;
+    std::unique_ptr<FFTProcessor> fftProcessor;
+    MIDIManager midiManager;
+    StageTimings* stageTimings = nullptr;
+    
+    juce::AudioBuffer<float> readBuffer;
+    juce::MidiBuffer blockMidi;
+    std::array<NoteEvent, PitchDetector::maxSupportedPolyphony> frameEvents;
+    
+    double sampleRate = 0.0;
+    juce::int64 blockStartSample = 0;
+    
+    void start(double newSampleRate);
+    void processBlock(const float* samples, int numSamples, juce::MidiMessageSequence& sequence);
+    void handleSpectrum(const float* spectrum, int spectrumSize, int sampleOffset);
+    void collectMidi(juce::MidiMessageSequence& sequence);
+    void finish(juce::MidiMessageSequence& sequence);
+    
+    JUCE_DECLARE_NON_COPYABLE(OfflineTranscriber)
+};
@@ -0,0 +1,260 @@
+#include "RealtimeSafety.h"
+
+void RealtimeSafety::Report::add(const Report& callback)
+{
+    ++numCallbacks;
+    numUnsafeCallbacks += callback.isClean() ? 0 : 1;
+    numAllocations += callback.numAllocations;
+    numDeallocations += callback.numDeallocations;
+    bytesAllocated += callback.bytesAllocated;
+    numLocks += callback.numLocks;
+    numBlockingCalls += callback.numBlockingCalls;
+    
+    if (callback.lastViolation != nullptr)
+        lastViolation = callback.lastViolation;
+}
+
+#if POLYPHONIC_TRACKER_REALTIME_CHECKS
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if JUCE_LINUX
+ #include <dlfcn.h>
+ #include <pthread.h>
+ #include <unistd.h>
+#endif
+
+namespace
+{
+    // The current callback's report; null on every thread outside a ScopedAudioCallback.
+    // A plain pointer, so reading it from operator new can't allocate.
+    thread_local RealtimeSafety::Report* currentReport = nullptr;
+    
+    std::atomic<bool> trapOnViolation { false };
+    
+    RealtimeSafety::Report* reportViolation(const char* description)
+    {
+        auto* report = currentReport;
+        
+        if (report == nullptr)
+            return nullptr;
+        
+        report->lastViolation = description;
+        
+        if (trapOnViolation.load(std::memory_order_relaxed))
+        {
+            // Nothing here may allocate: this is usually reached from operator new
+            currentReport = nullptr;
+            std::fputs("Real-time safety violation on the audio thread: ", stderr);
+            std::fputs(description, stderr);
+            std::fputs("\n", stderr);
+            std::abort();
+        }
+        
+        return report;
+    }
+    
+    void noteAllocation(size_t size)
+    {
+        if (auto* report = reportViolation("heap allocation"))
+        {
+            ++report->numAllocations;
+            report->bytesAllocated += size;
+        }
+    }
+    
+    void noteDeallocation(void* pointer)
+    {
+        if (pointer == nullptr)
+            return;
+        
+        if (auto* report = reportViolation("heap deallocation"))
+            ++report->numDeallocations;
+    }
+    
+    void* allocate(size_t size)
+    {
+        noteAllocation(size);
+        return std::malloc(size == 0 ? 1 : size);
+    }
+    
+    void* allocateAligned(size_t size, std::align_val_t alignment)
+    {
+        noteAllocation(size);
+        const auto align = juce::jmax(static_cast<size_t>(alignment), sizeof(void*));
+
+       #if JUCE_WINDOWS
+        return _aligned_malloc(size == 0 ? 1 : size, align);
+       #else
+        void* pointer = nullptr;
+        return posix_memalign(&pointer, align, size == 0 ? 1 : size) == 0 ? pointer : nullptr;
+       #endif
+    }
+    
+    void deallocate(void* pointer) noexcept
+    {
+        noteDeallocation(pointer);
+        std::free(pointer);
+    }
+    
+    void deallocateAligned(void* pointer) noexcept
+    {
+        noteDeallocation(pointer);
+
+       #if JUCE_WINDOWS
+        _aligned_free(pointer);
+       #else
+        std::free(pointer);
+       #endif
+    }
+    
+    void* allocateOrThrow(size_t size)
+    {
+        if (auto* pointer = allocate(size))
+            return pointer;
+        
+        throw std::bad_alloc();
+    }
+    
+    void* allocateAlignedOrThrow(size_t size, std::align_val_t alignment)
+    {
+        if (auto* pointer = allocateAligned(size, alignment))
+            return pointer;
+        
+        throw std::bad_alloc();
+    }
+}
+
+void RealtimeSafety::setTrapOnViolation(bool shouldTrap)
+{
+    trapOnViolation.store(shouldTrap);
+}
+
+bool RealtimeSafety::isAudioThread()
+{
+    return currentReport != nullptr;
+}
+
+void RealtimeSafety::noteLock(const char* description)
+{
+    if (auto* report = reportViolation(description))
+        ++report->numLocks;
+}
+
+void RealtimeSafety::noteBlockingCall(const char* description)
+{
+    if (auto* report = reportViolation(description))
+        ++report->numBlockingCalls;
+}
+
+RealtimeSafety::ScopedAudioCallback::ScopedAudioCallback(Report& lastCallbackToUse, Report& totalsToUse)
+    : lastCallback(lastCallbackToUse), totals(totalsToUse), previous(currentReport)
+{
+    current.numCallbacks = 1;
+    
+    if (previous == nullptr)
+        currentReport = &current;
+}
+
+RealtimeSafety::ScopedAudioCallback::~ScopedAudioCallback()
+{
+    if (previous != nullptr)
+        return;
+    
+    // Unmark the thread first: copying the reports must not count against them
+    currentReport = nullptr;
+    lastCallback = current;
+    totals.add(current);
+}
+
+//==============================================================================
+// Global allocation functions. Every form is replaced so that a pointer never
+// crosses between these and the standard library's.
+
+void* operator new(size_t size) { return allocateOrThrow(size); }
+void* operator new[](size_t size) { return allocateOrThrow(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocateAlignedOrThrow(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocateAlignedOrThrow(size, alignment); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return allocateAligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return allocateAligned(size, alignment); }
+
+void operator delete(void* pointer) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer) noexcept { deallocate(pointer); }
+void operator delete(void* pointer, size_t) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { deallocate(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { deallocate(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { deallocateAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { deallocateAligned(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { deallocateAligned(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { deallocateAligned(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { deallocateAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { deallocateAligned(pointer); }
+
+//==============================================================================
+// On Linux, the C library calls that can block are interposed as well, which
+// catches locks and I/O made inside JUCE and the standard library. Each wrapper
+// forwards to the next definition of the symbol, looked up on first use.
+
+#if JUCE_LINUX
+namespace
+{
+    template <typename Function>
+    Function findNext(std::atomic<Function>& cache, const char* name)
+    {
+        // No function-local static: its guard could itself take a lock
+        auto function = cache.load(std::memory_order_acquire);
+        
+        if (function == nullptr)
+        {
+            function = reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+            cache.store(function, std::memory_order_release);
+        }
+        
+        return function;
+    }
+    
+    std::atomic<int (*)(pthread_mutex_t*)> nextMutexLock { nullptr };
+    std::atomic<int (*)(pthread_cond_t*, pthread_mutex_t*)> nextConditionWait { nullptr };
+    std::atomic<ssize_t (*)(int, void*, size_t)> nextRead { nullptr };
+    std::atomic<ssize_t (*)(int, const void*, size_t)> nextWrite { nullptr };
+    std::atomic<int (*)(int)> nextFileSync { nullptr };
+}
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+    RealtimeSafety::noteLock("pthread_mutex_lock");
+    return findNext(nextMutexLock, "pthread_mutex_lock")(mutex);
+}
+
+extern "C" int pthread_cond_wait(pthread_cond_t* condition, pthread_mutex_t* mutex)
+{
+    RealtimeSafety::noteBlockingCall("pthread_cond_wait");
+    return findNext(nextConditionWait, "pthread_cond_wait")(condition, mutex);
+}
+
+extern "C" ssize_t read(int fileDescriptor, void* buffer, size_t count)
+{
+    RealtimeSafety::noteBlockingCall("read");
+    return findNext(nextRead, "read")(fileDescriptor, buffer, count);
+}
+
+extern "C" ssize_t write(int fileDescriptor, const void* buffer, size_t count)
+{
+    RealtimeSafety::noteBlockingCall("write");
+    return findNext(nextWrite, "write")(fileDescriptor, buffer, count);
+}
+
+extern "C" int fsync(int fileDescriptor)
+{
+    RealtimeSafety::noteBlockingCall("fsync");
+    return findNext(nextFileSync, "fsync")(fileDescriptor);
+}
+#endif
+
+#endif
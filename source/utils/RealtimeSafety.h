@@ -0,0 +1,142 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#ifndef POLYPHONIC_TRACKER_REALTIME_CHECKS
+ #define POLYPHONIC_TRACKER_REALTIME_CHECKS 0
+#endif
+
+/**
+ * RealtimeSafety catches work that can block the audio thread: heap allocation,
+ * locking and blocking I/O.
+ *
+ * Builds with POLYPHONIC_TRACKER_REALTIME_CHECKS=1 (the test build, or the plugin
+ * with the CMake option of the same name) replace the global operator new and
+ * delete. On Linux they also intercept pthread mutex locks and the read/write
+ * system calls, which covers juce::CriticalSection, std::mutex and file or pipe
+ * I/O made from inside JUCE. Locks of our own can be wrapped in CheckedLock.
+ *
+ * A ScopedAudioCallback marks the current thread as the audio thread for one
+ * callback. Anything caught while it is open is counted into that callback's
+ * report, or stops the process in trap mode. Other builds compile all of this
+ * to nothing.
+ */
+namespace RealtimeSafety
+{
+    /**
+     * What a callback did that it shouldn't have, or the totals over many callbacks
+     */
+    struct Report
+    {
+        juce::int64 numCallbacks = 0;
+        juce::int64 numUnsafeCallbacks = 0;     // Callbacks with at least one violation
+        int numAllocations = 0;
+        int numDeallocations = 0;
+        size_t bytesAllocated = 0;
+        int numLocks = 0;
+        int numBlockingCalls = 0;
+        const char* lastViolation = nullptr;    // Description of the most recent violation (a string literal)
+        
+        bool isClean() const { return numAllocations + numDeallocations + numLocks + numBlockingCalls == 0; }
+        
+        /**
+         * Adds one callback's report to these totals
+         * @param callback Report of a single callback
+         */
+        void add(const Report& callback);
+    };
+    
+    /**
+     * Checks whether violations are detected in this build
+     * @return True if built with POLYPHONIC_TRACKER_REALTIME_CHECKS
+     */
+    constexpr bool isEnabled() { return POLYPHONIC_TRACKER_REALTIME_CHECKS != 0; }
+
+   #if POLYPHONIC_TRACKER_REALTIME_CHECKS
+    /**
+     * Chooses between counting violations (the default) and aborting on the first
+     * one, so a debugger stops at the offending call
+     * @param shouldTrap True to abort on a violation
+     */
+    void setTrapOnViolation(bool shouldTrap);
+    
+    /**
+     * Checks if the calling thread is inside a ScopedAudioCallback
+     * @return True on the audio thread during a callback
+     */
+    bool isAudioThread();
+    
+    /**
+     * Reports a lock taken by the calling thread; only counts on the audio thread
+     * @param description What was locked (a string literal)
+     */
+    void noteLock(const char* description);
+    
+    /**
+     * Reports a call that may block, such as I/O or logging; only counts on the audio thread
+     * @param description What was called (a string literal)
+     */
+    void noteBlockingCall(const char* description);
+    
+    /**
+     * Marks the calling thread as the audio thread for the lifetime of this object.
+     * Scopes can nest; only the outermost one reports.
+     */
+    class ScopedAudioCallback
+    {
+    public:
+        /**
+         * @param lastCallback Receives this callback's report when the scope closes
+         * @param totals Accumulates the report of every callback
+         */
+        ScopedAudioCallback(Report& lastCallback, Report& totals);
+        ~ScopedAudioCallback();
+    
+    private:
+        Report& lastCallback;
+        Report& totals;
+        Report current;
+        Report* previous;
+        
+        JUCE_DECLARE_NON_COPYABLE(ScopedAudioCallback)
+    };
+   #else
+    inline void setTrapOnViolation(bool) {}
+    inline bool isAudioThread() { return false; }
+    inline void noteLock(const char*) {}
+    inline void noteBlockingCall(const char*) {}
+    
+    class ScopedAudioCallback
+    {
+    public:
+        ScopedAudioCallback(Report&, Report&) {}
+    
+    private:
+        JUCE_DECLARE_NON_COPYABLE(ScopedAudioCallback)
+    };
+   #endif
+    
+    /**
+     * Wraps a lock type (e.g. juce::CriticalSection) so that blocking acquisitions
+     * count as violations on the audio thread. tryEnter never blocks, so it isn't
+     * counted.
+     */
+    template <typename LockType>
+    class CheckedLock
+    {
+    public:
+        void enter() const noexcept
+        {
+            noteLock("CheckedLock::enter");
+            lock.enter();
+        }
+        
+        bool tryEnter() const noexcept { return lock.tryEnter(); }
+        void exit() const noexcept { lock.exit(); }
+        
+        using ScopedLockType = juce::GenericScopedLock<CheckedLock>;
+    
+    private:
+        LockType lock;
+    };
+}
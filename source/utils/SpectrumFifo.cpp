@@ -0,0 +1,38 @@
+#include "SpectrumFifo.h"
+
+SpectrumFifo::SpectrumFifo(int maxSpectrumSizeParam)
+    : maxSpectrumSize(maxSpectrumSizeParam),
+      slots(static_cast<size_t>(numSlots) * static_cast<size_t>(maxSpectrumSizeParam), 0.0f)
+{
+}
+
+void SpectrumFifo::push(const float* spectrum, int size)
+{
+    const int numToCopy = juce::jlimit(0, maxSpectrumSize, size);
+    
+    std::copy(spectrum, spectrum + numToCopy, slots.begin() + static_cast<std::ptrdiff_t>(writeSlot) * maxSpectrumSize);
+    slotSizes[static_cast<size_t>(writeSlot)] = numToCopy;
+    
+    // Publish the finished slot and take over the previous newest one; if the reader
+    // never took that frame, it is overwritten next time
+    const int previous = latestSlot.exchange(writeSlot | newFrameFlag, std::memory_order_acq_rel);
+    writeSlot = previous & slotMask;
+    
+    if ((previous & newFrameFlag) != 0)
+        droppedFrames.fetch_add(1, std::memory_order_relaxed);
+}
+
+int SpectrumFifo::pullLatest(float* destination, int maxSize)
+{
+    if ((latestSlot.load(std::memory_order_acquire) & newFrameFlag) == 0)
+        return 0;
+    
+    // Hand back the slot we read last time and take the newest frame
+    readSlot = latestSlot.exchange(readSlot, std::memory_order_acq_rel) & slotMask;
+    
+    const int numToCopy = juce::jmin(maxSize, slotSizes[static_cast<size_t>(readSlot)]);
+    const auto first = slots.begin() + static_cast<std::ptrdiff_t>(readSlot) * maxSpectrumSize;
+    
+    std::copy(first, first + numToCopy, destination);
+    return numToCopy;
+}
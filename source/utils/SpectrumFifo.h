@@ -0,0 +1,67 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <array>
+#include <atomic>
+#include <vector>
+
+/**
+ * SpectrumFifo passes magnitude spectra from the audio thread to the GUI
+ * without locks or allocations. It is a triple buffer: the writer fills one
+ * slot, the reader copies from another, and the third holds the newest
+ * finished spectrum. Publishing swaps the writer's slot with the newest one,
+ * and so does reading, so each side only ever touches a slot the other isn't using.
+ *
+ * The reader only ever wants the newest spectrum. A frame the reader hasn't
+ * taken yet is simply replaced by the next one, so however long the GUI is
+ * away, it finds the latest frame when it comes back rather than old ones.
+ */
+class SpectrumFifo
+{
+public:
+    /**
+     * Constructor
+     * @param maxSpectrumSize Largest spectrum that can be passed; longer spectra are truncated
+     */
+    SpectrumFifo(int maxSpectrumSize = 4096);
+    
+    /**
+     * Publishes a spectrum, replacing one the reader hasn't taken yet. One writer
+     * thread at a time; never blocks or allocates.
+     * @param spectrum Magnitude spectrum
+     * @param size Number of bins
+     */
+    void push(const float* spectrum, int size);
+    
+    /**
+     * Takes the newest spectrum, if one was published since the last call. GUI thread only.
+     * @param destination Receives the spectrum
+     * @param maxSize Capacity of destination
+     * @return Number of bins copied, or 0 if nothing new has arrived
+     */
+    int pullLatest(float* destination, int maxSize);
+    
+    /**
+     * Gets the number of frames that were replaced before the reader took them
+     * @return Replaced frame count since construction
+     */
+    int getNumDroppedFrames() const { return droppedFrames.load(std::memory_order_relaxed); }
+    
+    int getMaxSpectrumSize() const { return maxSpectrumSize; }
+
+private:
+    static constexpr int numSlots = 3;
+    static constexpr int slotMask = 3;
+    static constexpr int newFrameFlag = 4;  // Set in latestSlot until the reader takes the frame
+    
+    const int maxSpectrumSize;
+    std::vector<float> slots;               // numSlots x maxSpectrumSize
+    std::array<int, numSlots> slotSizes {};
+    
+    int writeSlot = 0;                      // Writer only
+    int readSlot = 1;                       // Reader only
+    std::atomic<int> latestSlot { 2 };      // Newest finished frame, plus newFrameFlag
+    std::atomic<int> droppedFrames { 0 };
+    
+    JUCE_DECLARE_NON_COPYABLE(SpectrumFifo)
+};
@@ -0,0 +1,174 @@
+#include "StageTimings.h"
+
+StageTimings::StageTimings()
+    : nanosecondsPerTick(1.0e9 / static_cast<double>(juce::Time::getHighResolutionTicksPerSecond()))
+{
+    reset();
+}
+
+juce::int64 StageTimings::record(Stage stage, juce::int64 startTicks) noexcept
+{
+    const auto endTicks = now();
+    addDuration(stage, static_cast<juce::int64>(static_cast<double>(endTicks - startTicks) * nanosecondsPerTick));
+    return endTicks;
+}
+
+void StageTimings::addDuration(Stage stage, juce::int64 nanoseconds) noexcept
+{
+    auto& data = stages[static_cast<size_t>(stage)];
+    nanoseconds = juce::jmax(juce::int64(0), nanoseconds);
+    
+    data.count.fetch_add(1, std::memory_order_relaxed);
+    data.totalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    data.buckets[static_cast<size_t>(getBucket(nanoseconds))].fetch_add(1, std::memory_order_relaxed);
+    
+    // Other threads may be recording the same stage, so the extremes are updated by compare-and-swap
+    auto minimum = data.minNanoseconds.load(std::memory_order_relaxed);
+    while (nanoseconds < minimum && !data.minNanoseconds.compare_exchange_weak(minimum, nanoseconds, std::memory_order_relaxed)) {}
+    
+    auto maximum = data.maxNanoseconds.load(std::memory_order_relaxed);
+    while (nanoseconds > maximum && !data.maxNanoseconds.compare_exchange_weak(maximum, nanoseconds, std::memory_order_relaxed)) {}
+}
+
+StageTimings::Summary StageTimings::getSummary(Stage stage) const
+{
+    const auto& data = stages[static_cast<size_t>(stage)];
+    Summary summary;
+    
+    // The histogram is read first and is the reference for the percentile, so runs
+    // recorded while this reads can't push the target past the buckets' total
+    std::array<juce::uint32, numBuckets> counts;
+    juce::int64 histogramCount = 0;
+    
+    for (size_t i = 0; i < counts.size(); ++i)
+    {
+        counts[i] = data.buckets[i].load(std::memory_order_relaxed);
+        histogramCount += counts[i];
+    }
+    
+    summary.count = data.count.load(std::memory_order_relaxed);
+    
+    if (summary.count == 0 || histogramCount == 0)
+        return summary;
+    
+    const auto maximum = data.maxNanoseconds.load(std::memory_order_relaxed);
+    summary.minMicroseconds = 1.0e-3 * static_cast<double>(data.minNanoseconds.load(std::memory_order_relaxed));
+    summary.maxMicroseconds = 1.0e-3 * static_cast<double>(maximum);
+    summary.meanMicroseconds = 1.0e-3 * static_cast<double>(data.totalNanoseconds.load(std::memory_order_relaxed))
+                             / static_cast<double>(summary.count);
+    
+    // The p99 is the upper edge of the bucket holding the 99th percentile, capped at the maximum
+    const auto target = (histogramCount * 99 + 99) / 100;
+    juce::int64 cumulative = 0;
+    
+    for (int i = 0; i < numBuckets; ++i)
+    {
+        cumulative += counts[static_cast<size_t>(i)];
+        
+        if (cumulative >= target)
+        {
+            summary.p99Microseconds = 1.0e-3 * static_cast<double>(juce::jmin(getBucketUpperEdge(i), maximum));
+            break;
+        }
+    }
+    
+    return summary;
+}
+
+void StageTimings::reset()
+{
+    for (auto& data : stages)
+    {
+        data.count.store(0, std::memory_order_relaxed);
+        data.totalNanoseconds.store(0, std::memory_order_relaxed);
+        data.minNanoseconds.store(std::numeric_limits<juce::int64>::max(), std::memory_order_relaxed);
+        data.maxNanoseconds.store(0, std::memory_order_relaxed);
+        
+        for (auto& bucket : data.buckets)
+            bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+juce::String StageTimings::toString() const
+{
+    juce::String text;
+    
+    for (int i = 0; i < numStages; ++i)
+    {
+        const auto stage = static_cast<Stage>(i);
+        const auto summary = getSummary(stage);
+        
+        if (summary.count == 0)
+            continue;
+        
+        text << getStageName(stage).paddedRight(' ', 18)
+             << "mean " << juce::String(summary.meanMicroseconds, 1)
+             << " us, p99 " << juce::String(summary.p99Microseconds, 1)
+             << " us, min " << juce::String(summary.minMicroseconds, 1)
+             << " us, max " << juce::String(summary.maxMicroseconds, 1)
+             << " us (" << juce::String(summary.count) << " runs)\n";
+    }
+    
+    return text;
+}
+
+juce::var StageTimings::toVar() const
+{
+    auto* result = new juce::DynamicObject();
+    
+    for (int i = 0; i < numStages; ++i)
+    {
+        const auto stage = static_cast<Stage>(i);
+        const auto summary = getSummary(stage);
+        
+        auto* stageResult = new juce::DynamicObject();
+        stageResult->setProperty("count", summary.count);
+        stageResult->setProperty("minUs", summary.minMicroseconds);
+        stageResult->setProperty("meanUs", summary.meanMicroseconds);
+        stageResult->setProperty("p99Us", summary.p99Microseconds);
+        stageResult->setProperty("maxUs", summary.maxMicroseconds);
+        result->setProperty(getStageName(stage), juce::var(stageResult));
+    }
+    
+    return juce::var(result);
+}
+
+juce::String StageTimings::getStageName(Stage stage)
+{
+    switch (stage)
+    {
+        case Stage::mixdown:            return "mixdown";
+        case Stage::windowing:          return "windowing";
+        case Stage::fft:                return "fft";
+        case Stage::magnitude:          return "magnitude";
+        case Stage::templateMatching:   return "templateMatching";
+        case Stage::decision:           return "decision";
+        case Stage::midiGeneration:     return "midiGeneration";
+        case Stage::numStages:          break;
+    }
+    
+    return {};
+}
+
+int StageTimings::getBucket(juce::int64 nanoseconds) noexcept
+{
+    if (nanoseconds < bucketsPerOctave)
+        return static_cast<int>(nanoseconds);
+    
+    // The octave is the highest set bit; the next two bits pick the quarter within it
+    const auto value = static_cast<juce::uint32>(juce::jmin(nanoseconds, juce::int64(0xffffffff)));
+    const int octave = juce::findHighestSetBit(value);
+    const int quarter = static_cast<int>((value >> (octave - 2)) & 3);
+    
+    return juce::jmin(numBuckets - 1, octave * bucketsPerOctave + quarter);
+}
+
+juce::int64 StageTimings::getBucketUpperEdge(int bucket) noexcept
+{
+    if (bucket < bucketsPerOctave)
+        return bucket + 1;
+    
+    const int octave = bucket / bucketsPerOctave;
+    const int quarter = bucket % bucketsPerOctave;
+    return juce::int64(bucketsPerOctave + quarter + 1) << (octave - 2);
+}
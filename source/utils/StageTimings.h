@@ -0,0 +1,136 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <array>
+#include <atomic>
+
+/**
+ * StageTimings records how long each stage of the analysis chain takes. Most
+ * stages are timed once per FFT frame; the mixdown is timed once per host block.
+ *
+ * Each stage keeps a count, a total, a minimum, a maximum and a log-scale
+ * histogram, all made of atomics. The audio thread, analysis workers and several
+ * strings' analysers can record into one instance without locks, and the editor or
+ * an offline dump can read summaries at any time.
+ *
+ * Durations come from juce::Time::getHighResolutionTicks. The histogram buckets
+ * are a quarter of an octave wide, so the p99 is reported to within about 19%.
+ */
+class StageTimings
+{
+public:
+    enum class Stage
+    {
+        mixdown,            // Input channels to the mono analysis signal (per block)
+        windowing,          // Frame assembly from the ring buffer and the analysis window
+        fft,                // Real-only forward transform
+        magnitude,          // Magnitude spectrum from the complex bins
+        templateMatching,   // Feature projection, onset flux, template scores and the activation solver
+        decision,           // Ranking, octave checks, level estimates and onset tracking
+        midiGeneration,     // Note state machine and MIDI events
+        numStages
+    };
+    
+    static constexpr int numStages = static_cast<int>(Stage::numStages);
+    
+    /**
+     * Statistics of one stage, in microseconds
+     */
+    struct Summary
+    {
+        juce::int64 count = 0;
+        double minMicroseconds = 0.0;
+        double meanMicroseconds = 0.0;
+        double p99Microseconds = 0.0;
+        double maxMicroseconds = 0.0;
+    };
+    
+    /**
+     * Times consecutive stages with one clock read per boundary: each lap records
+     * the time since the previous lap (or since construction) against a stage.
+     * Does nothing when constructed without a StageTimings.
+     */
+    class Stopwatch
+    {
+    public:
+        explicit Stopwatch(StageTimings* timingsToUse) noexcept
+            : timings(timingsToUse), lapStart(timingsToUse != nullptr ? now() : 0) {}
+        
+        void lap(Stage stage) noexcept
+        {
+            if (timings != nullptr)
+                lapStart = timings->record(stage, lapStart);
+        }
+    
+    private:
+        StageTimings* timings;
+        juce::int64 lapStart;
+    };
+    
+    StageTimings();
+    
+    /**
+     * Records one run of a stage. Lock-free; may be called from several threads at once.
+     * @param stage Stage that ran
+     * @param startTicks High-resolution ticks when it started
+     * @return The current ticks, which is where the next stage starts
+     */
+    juce::int64 record(Stage stage, juce::int64 startTicks) noexcept;
+    
+    /**
+     * Records one run of a stage from a duration already measured
+     * @param stage Stage that ran
+     * @param nanoseconds How long it took
+     */
+    void addDuration(Stage stage, juce::int64 nanoseconds) noexcept;
+    
+    /**
+     * Gets a stage's statistics since the last reset
+     * @param stage Stage to summarise
+     * @return Count, minimum, mean, p99 and maximum
+     */
+    Summary getSummary(Stage stage) const;
+    
+    /**
+     * Clears every stage. Runs recorded while the reset is in progress may be
+     * partly lost, which only skews the next summary slightly.
+     */
+    void reset();
+    
+    /**
+     * Formats every stage that has run as one line of text, for display
+     * @return Multi-line summary
+     */
+    juce::String toString() const;
+    
+    /**
+     * Gets every stage's summary as an object keyed by stage name, for JSON dumps
+     * @return Object holding count, min, mean, p99 and max (in microseconds) per stage
+     */
+    juce::var toVar() const;
+    
+    static juce::String getStageName(Stage stage);
+    static juce::int64 now() noexcept { return juce::Time::getHighResolutionTicks(); }
+
+private:
+    // Quarter-octave buckets of nanoseconds: 0-3 ns, then 4 buckets per power of two up to ~4.3 s
+    static constexpr int bucketsPerOctave = 4;
+    static constexpr int numBuckets = 32 * bucketsPerOctave;
+    
+    struct StageData
+    {
+        std::atomic<juce::int64> count { 0 };
+        std::atomic<juce::int64> totalNanoseconds { 0 };
+        std::atomic<juce::int64> minNanoseconds { std::numeric_limits<juce::int64>::max() };
+        std::atomic<juce::int64> maxNanoseconds { 0 };
+        std::array<std::atomic<juce::uint32>, numBuckets> buckets {};
+    };
+    
+    static int getBucket(juce::int64 nanoseconds) noexcept;
+    static juce::int64 getBucketUpperEdge(int bucket) noexcept;
+    
+    std::array<StageData, numStages> stages;
+    const double nanosecondsPerTick;
+    
+    JUCE_DECLARE_NON_COPYABLE(StageTimings)
+};
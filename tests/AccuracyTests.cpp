@@ -0,0 +1,331 @@
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "PluginProcessor.h"
+#include <vector>
+
+/**
+ * End-to-end accuracy and latency harness. Known chords are synthesised as
+ * additive harmonic tones, profiles for the same instrument are learned through
+ * the plugin's learning mode, and the chords are then played through
+ * PolyphonicTrackerAudioProcessor::processBlock at several host block sizes and
+ * sample rates. The MIDI note-ons that come out are matched to the chord notes
+ * to report precision, recall and onset-to-note-on latency in samples.
+ *
+ * The expectations are floors, so a change to FFT scheduling, the solver or
+ * gating that costs accuracy or adds latency fails here.
+ */
+class AccuracyTests : public juce::UnitTest
+{
+public:
+    AccuracyTests() : juce::UnitTest("Polyphonic Accuracy", "Accuracy") {}
+    
+    void runTest() override
+    {
+        // The processor starts a GUI timer, which needs a message manager
+        juce::ScopedJuceInitialiser_GUI juceInitialiser;
+        
+        ToneSettings clean;
+        
+        // Stiff strings, slightly out-of-tune notes and a noise floor
+        ToneSettings realistic;
+        realistic.inharmonicity = 0.0004f;
+        realistic.maxDetuneCents = 15.0f;
+        realistic.noiseLevel = 0.005f;
+        
+        // Cosine scores of a note's octave and fifth relatives are high enough to pass
+        // as notes on their own, so that engine runs with confidence thresholds
+        DetectorSetup cosine;
+        cosine.name = "cosine";
+        cosine.onThreshold = 0.5f;
+        cosine.offThreshold = 0.3f;
+        
+        DetectorSetup sparse;
+        sparse.name = "sparse";
+        sparse.engine = PitchDetector::DetectionEngine::SparseActivations;
+        
+        for (const auto& setup : { cosine, sparse })
+        {
+            for (double sampleRate : { 44100.0, 48000.0 })
+            {
+                for (int blockSize : { 64, 256, 1024 })
+                {
+                    beginTest("Clean chords, " + setup.name + " engine, " + juce::String(sampleRate, 0) + " Hz, "
+                              + juce::String(blockSize) + "-sample blocks");
+                    
+                    const auto score = runScenario(setup, clean, sampleRate, blockSize);
+                    report(setup, score);
+                    expectGreaterOrEqual(score.getPrecision(), 0.95);
+                    expectGreaterOrEqual(score.getRecall(), 0.9);
+                    expectLessOrEqual(score.maxLatency, score.latencyBound);
+                }
+            }
+            
+            beginTest("Detuned, inharmonic and noisy chords, " + setup.name + " engine");
+            {
+                const auto score = runScenario(setup, realistic, 44100.0, 256);
+                report(setup, score);
+                expectGreaterOrEqual(score.getPrecision(), 0.85);
+                expectGreaterOrEqual(score.getRecall(), 0.85);
+                expectLessOrEqual(score.maxLatency, score.latencyBound);
+            }
+        }
+    }
+
+private:
+    struct ToneSettings
+    {
+        int numHarmonics = 10;
+        float inharmonicity = 0.0f;     // Stiffness B; partial k sits at k * f0 * sqrt(1 + B * k^2)
+        float maxDetuneCents = 0.0f;    // Each played note is detuned by up to this much either way
+        float noiseLevel = 0.0f;        // Peak amplitude of white noise over the whole recording
+    };
+    
+    struct DetectorSetup
+    {
+        juce::String name;
+        PitchDetector::DetectionEngine engine = PitchDetector::DetectionEngine::CosineSimilarity;
+        float onThreshold = 0.0f;
+        float offThreshold = 0.0f;
+    };
+    
+    struct ReferenceNote
+    {
+        int midiNote = 0;
+        juce::int64 onset = 0;
+        juce::int64 offset = 0;
+    };
+    
+    struct Score
+    {
+        double sampleRate = 0.0;
+        int blockSize = 0;
+        int numReference = 0;
+        int numDetected = 0;
+        int numMatched = 0;
+        double meanLatency = 0.0;       // Samples from a note's onset to its note-on
+        juce::int64 maxLatency = 0;
+        juce::int64 latencyBound = 0;   // Note-on delay plus a window, a hop and a block
+        
+        double getPrecision() const { return numDetected > 0 ? numMatched / static_cast<double>(numDetected) : 0.0; }
+        double getRecall() const { return numReference > 0 ? numMatched / static_cast<double>(numReference) : 0.0; }
+    };
+    
+    static constexpr int lowestNote = 48;
+    static constexpr int highestNote = 72;
+    
+    void report(const DetectorSetup& setup, const Score& score)
+    {
+        logMessage(setup.name + ", " + juce::String(score.sampleRate, 0) + " Hz, block " + juce::String(score.blockSize)
+                   + ": precision " + juce::String(score.getPrecision(), 3)
+                   + ", recall " + juce::String(score.getRecall(), 3)
+                   + " (" + juce::String(score.numMatched) + " of " + juce::String(score.numReference) + " notes, "
+                   + juce::String(score.numDetected) + " note-ons), latency mean "
+                   + juce::String(juce::roundToInt(score.meanLatency)) + " max " + juce::String(score.maxLatency)
+                   + " samples (bound " + juce::String(score.latencyBound) + ")");
+    }
+    
+    static void renderNote(juce::AudioBuffer<float>& buffer, int midiNote, juce::int64 start, juce::int64 length,
+                           float gain, float detuneCents, const ToneSettings& tone, double sampleRate, juce::Random& random)
+    {
+        const double fundamental = 440.0 * std::pow(2.0, (midiNote - 69 + detuneCents / 100.0) / 12.0);
+        const int attack = static_cast<int>(sampleRate * 0.005);
+        const int release = static_cast<int>(sampleRate * 0.01);
+        const double decay = 1.0 / (sampleRate * 1.5);
+        const int end = static_cast<int>(juce::jmin(start + length, static_cast<juce::int64>(buffer.getNumSamples())));
+        auto* samples = buffer.getWritePointer(0);
+        
+        for (int harmonic = 1; harmonic <= tone.numHarmonics; ++harmonic)
+        {
+            const double frequency = harmonic * fundamental * std::sqrt(1.0 + tone.inharmonicity * harmonic * harmonic);
+            
+            if (frequency >= sampleRate * 0.45)
+                break;
+            
+            const double increment = juce::MathConstants<double>::twoPi * frequency / sampleRate;
+            const double amplitude = gain / harmonic;
+            double phase = random.nextDouble() * juce::MathConstants<double>::twoPi;
+            
+            for (int i = static_cast<int>(start); i < end; ++i)
+            {
+                const int position = i - static_cast<int>(start);
+                const double envelope = juce::jmin(1.0, position / static_cast<double>(attack))
+                                      * juce::jmin(1.0, (end - i) / static_cast<double>(release))
+                                      * std::exp(-position * decay);
+                
+                samples[i] += static_cast<float>(amplitude * envelope * std::sin(phase));
+                phase += increment;
+            }
+        }
+    }
+    
+    /**
+     * Plays a mono recording through the processor, stereo in, one host block at a time.
+     * Every MIDI event has to fall inside the block it was written to.
+     * @return Sample positions of the note-ons, with their notes
+     */
+    std::vector<ReferenceNote> play(PolyphonicTrackerAudioProcessor& processor, const juce::AudioBuffer<float>& recording,
+                                    int blockSize)
+    {
+        std::vector<ReferenceNote> noteOns;
+        juce::AudioBuffer<float> block(2, blockSize);
+        juce::MidiBuffer midi;
+        const int numSamples = recording.getNumSamples();
+        
+        for (int start = 0; start < numSamples; start += blockSize)
+        {
+            const int length = juce::jmin(blockSize, numSamples - start);
+            block.setSize(2, length, false, false, true);
+            block.copyFrom(0, 0, recording, 0, start, length);
+            block.copyFrom(1, 0, recording, 0, start, length);
+            
+            processor.processBlock(block, midi);
+            
+            for (const auto metadata : midi)
+            {
+                const auto message = metadata.getMessage();
+                
+                if (metadata.samplePosition < 0 || metadata.samplePosition >= length)
+                    expect(false, "MIDI event at " + juce::String(metadata.samplePosition) + " in a block of " + juce::String(length));
+                
+                if (message.isNoteOn())
+                    noteOns.push_back({ message.getNoteNumber(), start + metadata.samplePosition, 0 });
+            }
+        }
+        
+        return noteOns;
+    }
+    
+    /**
+     * Learns one template per note from the clean tone of the same instrument
+     */
+    void learnProfiles(PolyphonicTrackerAudioProcessor& processor, const ToneSettings& tone,
+                       double sampleRate, int blockSize)
+    {
+        ToneSettings learningTone;
+        learningTone.numHarmonics = tone.numHarmonics;
+        learningTone.inharmonicity = tone.inharmonicity;
+        
+        // Learning pauses over a window of silence between notes, so no frame mixes two of them
+        const int gapLength = processor.getFFTSize();
+        const int noteLength = static_cast<int>(sampleRate * 0.5);
+        juce::Random random(1);
+        
+        juce::AudioBuffer<float> silence(1, gapLength);
+        silence.clear();
+        
+        for (int note = lowestNote; note <= highestNote; ++note)
+        {
+            juce::AudioBuffer<float> noteAudio(1, noteLength);
+            noteAudio.clear();
+            renderNote(noteAudio, note, 0, noteLength, 0.3f, 0.0f, learningTone, sampleRate, random);
+            
+            processor.setLearningModeActive(false);
+            play(processor, silence, blockSize);
+            
+            processor.setCurrentLearningNote(note);
+            processor.setLearningModeActive(true);
+            play(processor, noteAudio, blockSize);
+        }
+        
+        processor.setLearningModeActive(false);
+        play(processor, silence, blockSize);
+    }
+    
+    Score runScenario(const DetectorSetup& setup, const ToneSettings& tone, double sampleRate, int blockSize)
+    {
+        PolyphonicTrackerAudioProcessor processor;
+        processor.prepareToPlay(sampleRate, blockSize);
+        learnProfiles(processor, tone, sampleRate, blockSize);
+        
+        processor.setDetectionEngine(setup.engine);
+        processor.setNoteConfidenceThresholds(setup.onThreshold, setup.offThreshold);
+        
+        // Chords of one to three notes, each half a second with a quarter second between.
+        // They avoid octaves and neighbouring semitones, so a miss points to a regression
+        // rather than to an ambiguity the templates can't resolve.
+        constexpr int numChords = 12;
+        const auto chordLength = static_cast<juce::int64>(sampleRate * 0.5);
+        const auto chordSpacing = static_cast<juce::int64>(sampleRate * 0.75);
+        
+        juce::Random random(42);
+        std::vector<ReferenceNote> reference;
+        
+        for (int chord = 0; chord < numChords; ++chord)
+        {
+            const juce::int64 onset = chordSpacing / 3 + chord * chordSpacing;
+            const int polyphony = 1 + chord % 3;
+            std::vector<int> notes;
+            
+            while (static_cast<int>(notes.size()) < polyphony)
+            {
+                const int candidate = lowestNote + random.nextInt(highestNote - lowestNote + 1);
+                bool fits = true;
+                
+                for (int note : notes)
+                    fits = fits && std::abs(note - candidate) > 2 && std::abs(note - candidate) % 12 != 0;
+                
+                if (fits)
+                    notes.push_back(candidate);
+            }
+            
+            for (int note : notes)
+                reference.push_back({ note, onset, onset + chordLength });
+        }
+        
+        const auto length = static_cast<int>(reference.back().offset + sampleRate * 0.5);
+        juce::AudioBuffer<float> recording(1, length);
+        recording.clear();
+        
+        for (const auto& note : reference)
+        {
+            const float detune = tone.maxDetuneCents * (2.0f * random.nextFloat() - 1.0f);
+            renderNote(recording, note.midiNote, note.onset, note.offset - note.onset, 0.15f + 0.15f * random.nextFloat(),
+                       detune, tone, sampleRate, random);
+        }
+        
+        if (tone.noiseLevel > 0.0f)
+        {
+            auto* samples = recording.getWritePointer(0);
+            
+            for (int i = 0; i < length; ++i)
+                samples[i] += tone.noiseLevel * (2.0f * random.nextFloat() - 1.0f);
+        }
+        
+        const auto noteOns = play(processor, recording, blockSize);
+        
+        // Each note-on is matched to an unmatched chord note of the same pitch that was sounding
+        Score score;
+        score.sampleRate = sampleRate;
+        score.blockSize = blockSize;
+        score.numReference = static_cast<int>(reference.size());
+        score.numDetected = static_cast<int>(noteOns.size());
+        
+        const int hopSize = juce::roundToInt(processor.getFFTSize() * (1.0f - processor.getFFTOverlap()));
+        score.latencyBound = static_cast<juce::int64>(sampleRate * 0.05) + processor.getFFTSize() + hopSize + blockSize;
+        
+        std::vector<bool> matched(reference.size(), false);
+        juce::int64 totalLatency = 0;
+        
+        for (const auto& noteOn : noteOns)
+        {
+            for (size_t r = 0; r < reference.size(); ++r)
+            {
+                const auto& note = reference[r];
+                
+                if (!matched[r] && note.midiNote == noteOn.midiNote
+                    && noteOn.onset >= note.onset && noteOn.onset < note.offset)
+                {
+                    matched[r] = true;
+                    ++score.numMatched;
+                    totalLatency += noteOn.onset - note.onset;
+                    score.maxLatency = juce::jmax(score.maxLatency, noteOn.onset - note.onset);
+                    break;
+                }
+            }
+        }
+        
+        score.meanLatency = score.numMatched > 0 ? totalLatency / static_cast<double>(score.numMatched) : 0.0;
+        return score;
+    }
+};
+
+static AccuracyTests accuracyTests;
@@ -0,0 +1,149 @@
+#include <juce_core/juce_core.h>
+#include "dsp/AnalysisWorker.h"
+
+class AnalysisWorkerTests : public juce::UnitTest
+{
+public:
+    AnalysisWorkerTests() : juce::UnitTest("AnalysisWorker", "DSP") {}
+    
+    void runTest() override
+    {
+        beginTest("Results are timestamped against the input timeline");
+        {
+            constexpr int hopSize = 256;
+            constexpr int blockSize = 32;
+            constexpr int numBlocks = 2000;
+            
+            // Pushing runs much faster than real time, so the ring holds the whole input
+            AnalysisWorker worker(numBlocks * blockSize + 1, 1024);
+            int samplesSinceHop = 0;
+            juce::int64 samplesReceived = 0;
+            bool contiguous = true;
+            
+            // Stand-in for the FFT: one result per completed hop, carrying the input value
+            worker.setAnalysisCallback([&](const float* samples, int numSamples, juce::int64 firstSample, bool followsGap) {
+                contiguous = contiguous && firstSample == samplesReceived && ! followsGap;
+                samplesReceived += numSamples;
+                
+                for (int i = 0; i < numSamples; ++i)
+                {
+                    if (++samplesSinceHop == hopSize)
+                    {
+                        samplesSinceHop = 0;
+                        
+                        AnalysisWorker::FrameResult result;
+                        result.frameEndSample = firstSample + i + 1;
+                        result.numNotes = 1;
+                        result.notes[0].midiNote = static_cast<int>(samples[i]);
+                        worker.pushResult(result);
+                    }
+                }
+            });
+            
+            worker.start();
+            
+            float block[blockSize];
+            juce::int64 position = 0;
+            juce::int64 expectedFrameEnd = hopSize;
+            bool timestampsMatch = true;
+            int numResults = 0;
+            
+            for (int b = 0; b < numBlocks; ++b)
+            {
+                for (int i = 0; i < blockSize; ++i)
+                    block[i] = static_cast<float>((position + i) % 1000);
+                
+                expect(worker.pushSamples(block, blockSize));
+                position += blockSize;
+                
+                while (const auto* result = worker.peekResult())
+                {
+                    // The last sample of each hop is (frameEnd - 1) on the input timeline
+                    timestampsMatch = timestampsMatch
+                                      && result->frameEndSample == expectedFrameEnd
+                                      && result->notes[0].midiNote == static_cast<int>((expectedFrameEnd - 1) % 1000);
+                    expectedFrameEnd += hopSize;
+                    ++numResults;
+                    worker.popResult();
+                }
+            }
+            
+            // Give the worker time to drain the ring
+            for (int i = 0; i < 1000 && numResults < (numBlocks * blockSize) / hopSize; ++i)
+            {
+                juce::Thread::sleep(1);
+                
+                while (worker.peekResult() != nullptr)
+                {
+                    ++numResults;
+                    worker.popResult();
+                }
+            }
+            
+            worker.stop();
+            
+            expect(contiguous);
+            expect(timestampsMatch);
+            expectEquals(numResults, (numBlocks * blockSize) / hopSize);
+            expectEquals(worker.getNumDroppedSamples(), 0);
+        }
+        
+        beginTest("Overflow drops whole blocks and keeps the timeline");
+        {
+            struct Chunk
+            {
+                juce::int64 firstSample;
+                int numSamples;
+                float firstValue;
+                bool followsGap;
+            };
+            
+            // The ring holds 63 samples
+            AnalysisWorker worker(64, 64);
+            std::vector<Chunk> chunks;
+            chunks.reserve(16);
+            std::atomic<int> samplesReceived { 0 };
+            
+            worker.setAnalysisCallback([&](const float* samples, int numSamples, juce::int64 firstSample, bool followsGap) {
+                chunks.push_back({ firstSample, numSamples, samples[0], followsGap });
+                samplesReceived += numSamples;
+            });
+            
+            std::vector<float> input(112);
+            for (size_t i = 0; i < input.size(); ++i)
+                input[i] = static_cast<float>(i);
+            
+            // Not started, so nothing is consumed: the second block doesn't fit and is dropped whole
+            expect(worker.pushSamples(input.data(), 48));
+            expect(! worker.pushSamples(input.data() + 48, 48));
+            expect(worker.pushSamples(input.data() + 96, 15));
+            expectEquals(worker.getNumDroppedSamples(), 48);
+            expect(worker.peekResult() == nullptr);
+            
+            worker.start();
+            
+            for (int i = 0; i < 1000 && samplesReceived < 63; ++i)
+                juce::Thread::sleep(1);
+            
+            worker.stop();
+            
+            // The samples after the drop keep their input positions, and no chunk spans the drop
+            expectEquals(samplesReceived.load(), 63);
+            expectEquals(static_cast<int>(chunks.size()), 2);
+            
+            if (chunks.size() == 2)
+            {
+                expectEquals(chunks[0].firstSample, static_cast<juce::int64>(0));
+                expectEquals(chunks[0].numSamples, 48);
+                expect(! chunks[0].followsGap);
+                
+                expectEquals(chunks[1].firstSample, static_cast<juce::int64>(96));
+                expectEquals(chunks[1].numSamples, 15);
+                expectEquals(chunks[1].firstValue, 96.0f);
+                expect(chunks[1].followsGap);
+            }
+        }
+    }
+};
+
+static AnalysisWorkerTests analysisWorkerTests;
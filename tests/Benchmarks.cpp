@@ -0,0 +1,291 @@
+#include <juce_core/juce_core.h>
+#include "dsp/FFTProcessor.h"
+#include "dsp/PitchDetector.h"
+#include <algorithm>
+#include <array>
+#include <iostream>
+
+/**
+ * PolyphonicTrackerBenchmarks times the per-frame hot paths and prints the results
+ * as JSON, so runs before and after a change can be compared by a script.
+ *
+ *   FFT:       FFTProcessor::processBlock across FFT sizes, overlaps and host block sizes
+ *   Detection: PitchDetector::processSpectrum (the full template search on every frame)
+ *              across profile counts (up to a full 6-string x 25-fret set and beyond),
+ *              polyphony, engines and candidate pruning
+ *
+ * Every case is run several times and the median and fastest runs are reported in
+ * nanoseconds per analysis frame; detection cases also report frames per second.
+ *
+ * Usage: PolyphonicTrackerBenchmarks [--quick] [--output <file.json>]
+ */
+namespace
+{
+    constexpr double sampleRate = 44100.0;
+    
+    struct RunOptions
+    {
+        int numRuns = 7;
+        double fftSeconds = 4.0;        // Audio pushed through each FFT case per run
+        int detectionFrames = 400;      // Spectra analysed per detection case per run
+    };
+    
+    struct Timing
+    {
+        double medianNs = 0.0;
+        double minNs = 0.0;
+    };
+    
+    template <typename Function>
+    Timing timePerFrame(int numRuns, Function&& runOnce)
+    {
+        // runOnce returns the number of frames it analysed; the first call only warms up
+        runOnce();
+        
+        std::vector<double> nsPerFrame;
+        
+        for (int run = 0; run < numRuns; ++run)
+        {
+            const auto start = juce::Time::getHighResolutionTicks();
+            const int numFrames = runOnce();
+            const double seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+            
+            nsPerFrame.push_back(seconds * 1.0e9 / juce::jmax(1, numFrames));
+        }
+        
+        std::sort(nsPerFrame.begin(), nsPerFrame.end());
+        return { nsPerFrame[nsPerFrame.size() / 2], nsPerFrame.front() };
+    }
+    
+    std::vector<float> renderTestSignal(int numSamples)
+    {
+        // A three-note chord over a little noise, so no frame is trivially silent
+        juce::Random random(1234);
+        std::vector<float> samples(static_cast<size_t>(numSamples));
+        
+        for (int i = 0; i < numSamples; ++i)
+        {
+            double value = 0.0;
+            
+            for (double frequency : { 110.0, 164.81, 220.0 })
+                value += 0.25 * std::sin(juce::MathConstants<double>::twoPi * frequency * i / sampleRate);
+            
+            samples[static_cast<size_t>(i)] = static_cast<float>(value) + 0.01f * (random.nextFloat() - 0.5f);
+        }
+        
+        return samples;
+    }
+    
+    /**
+     * Adds a harmonic note to a magnitude spectrum: partials falling off by rolloff
+     * per harmonic, each spread over a few bins like a windowed peak
+     */
+    void addHarmonicNote(std::vector<float>& spectrum, int midiNote, float gain, float rolloff, int fftSize)
+    {
+        const double fundamental = 440.0 * std::pow(2.0, (midiNote - 69) / 12.0);
+        const double binWidth = sampleRate / fftSize;
+        const int spectrumSize = static_cast<int>(spectrum.size());
+        
+        for (int harmonic = 1; harmonic <= 12; ++harmonic)
+        {
+            const double bin = fundamental * harmonic / binWidth;
+            const int centre = juce::roundToInt(bin);
+            
+            if (centre + 2 >= spectrumSize)
+                break;
+            
+            const float amplitude = gain * std::pow(rolloff, static_cast<float>(harmonic - 1));
+            
+            for (int k = juce::jmax(0, centre - 2); k <= centre + 2; ++k)
+            {
+                const double distance = (k - bin) / 0.8;
+                spectrum[static_cast<size_t>(k)] += amplitude * static_cast<float>(std::exp(-0.5 * distance * distance));
+            }
+        }
+    }
+    
+    juce::var benchmarkFFT(const RunOptions& options)
+    {
+        juce::Array<juce::var> results;
+        const auto signal = renderTestSignal(static_cast<int>(sampleRate * options.fftSeconds));
+        const int numSamples = static_cast<int>(signal.size());
+        
+        for (int fftSize : { 1024, 2048, 4096, 8192 })
+        {
+            for (float overlap : { 0.5f, 0.75f, 0.875f })
+            {
+                for (int blockSize : { 64, 256, 512, 1024 })
+                {
+                    FFTProcessor processor(fftSize);
+                    processor.setOverlapFactor(overlap);
+                    
+                    int numFrames = 0;
+                    processor.setSpectrumDataCallback([&numFrames](const float*, int, int) { ++numFrames; });
+                    
+                    const auto timing = timePerFrame(options.numRuns, [&] {
+                        processor.reset();
+                        numFrames = 0;
+                        
+                        for (int position = 0; position < numSamples; position += blockSize)
+                            processor.processBlock(signal.data() + position, juce::jmin(blockSize, numSamples - position));
+                        
+                        return numFrames;
+                    });
+                    
+                    const double framesPerSecond = sampleRate / processor.getHopSize();
+                    
+                    auto* result = new juce::DynamicObject();
+                    result->setProperty("fftSize", fftSize);
+                    result->setProperty("overlap", overlap);
+                    result->setProperty("blockSize", blockSize);
+                    result->setProperty("framesPerRun", numFrames);
+                    result->setProperty("nsPerFrame", timing.medianNs);
+                    result->setProperty("nsPerFrameMin", timing.minNs);
+                    result->setProperty("realTimeFactor", 1.0e9 / (timing.medianNs * framesPerSecond));
+                    results.add(juce::var(result));
+                    
+                    std::cerr << "fft " << fftSize << " overlap " << overlap << " block " << blockSize << ": "
+                              << juce::roundToInt(timing.medianNs) << " ns/frame\n";
+                }
+            }
+        }
+        
+        return results;
+    }
+    
+    juce::var benchmarkDetection(const RunOptions& options)
+    {
+        constexpr int fftSize = 4096;
+        constexpr int spectrumSize = fftSize / 2;
+        constexpr int lowestNote = 40;
+        constexpr int numNotes = 48;
+        constexpr int numTestFrames = 32;
+        
+        juce::Array<juce::var> results;
+        juce::Random random(5678);
+        
+        for (int numProfiles : { 12, 48, 50, 96, 150, 192, 500 })
+        {
+            for (int polyphony : { 1, 3, 6 })
+            {
+                // Chords of `polyphony` notes taken from the notes that have templates
+                std::vector<std::vector<float>> frames;
+                
+                for (int f = 0; f < numTestFrames; ++f)
+                {
+                    std::vector<float> frame(static_cast<size_t>(spectrumSize), 0.0f);
+                    
+                    for (int n = 0; n < polyphony; ++n)
+                        addHarmonicNote(frame, lowestNote + random.nextInt(juce::jmin(numProfiles, numNotes)),
+                                        0.5f + random.nextFloat(), 0.7f, fftSize);
+                    
+                    for (auto& value : frame)
+                        value += 0.001f * random.nextFloat();
+                    
+                    frames.push_back(std::move(frame));
+                }
+                
+                for (auto engine : { PitchDetector::DetectionEngine::CosineSimilarity,
+                                     PitchDetector::DetectionEngine::SparseActivations })
+                {
+                    for (bool pruning : { true, false })
+                    {
+                        PitchDetector detector(polyphony);
+                        detector.prepare(sampleRate, fftSize);
+                        detector.setDetectionEngine(engine);
+                        detector.setCandidatePruningEnabled(pruning);
+                        detector.setOnsetGatingEnabled(false); // Measure the full search on every frame
+                        
+                        // Several templates per note beyond numNotes profiles, like a guitar's strings;
+                        // the timbre cycles through four rolloffs so large sets stay realistic
+                        std::vector<float> profile(static_cast<size_t>(spectrumSize));
+                        
+                        for (int p = 0; p < numProfiles; ++p)
+                        {
+                            std::fill(profile.begin(), profile.end(), 0.0f);
+                            addHarmonicNote(profile, lowestNote + p % numNotes, 1.0f, 0.6f + 0.1f * static_cast<float>((p / numNotes) % 4), fftSize);
+                            detector.addProfile(lowestNote + p % numNotes, profile.data(), spectrumSize);
+                        }
+                        
+                        std::array<NoteEvent, PitchDetector::maxSupportedPolyphony> events;
+                        
+                        const auto timing = timePerFrame(options.numRuns, [&] {
+                            for (int f = 0; f < options.detectionFrames; ++f)
+                                detector.processSpectrum(frames[static_cast<size_t>(f % numTestFrames)].data(), spectrumSize,
+                                                         events.data(), static_cast<int>(events.size()));
+                            
+                            return options.detectionFrames;
+                        });
+                        
+                        const bool isSparse = engine == PitchDetector::DetectionEngine::SparseActivations;
+                        
+                        auto* result = new juce::DynamicObject();
+                        result->setProperty("engine", isSparse ? "sparse" : "cosine");
+                        result->setProperty("candidatePruning", pruning);
+                        result->setProperty("profiles", numProfiles);
+                        result->setProperty("polyphony", polyphony);
+                        result->setProperty("fftSize", fftSize);
+                        result->setProperty("framesPerRun", options.detectionFrames);
+                        result->setProperty("nsPerFrame", timing.medianNs);
+                        result->setProperty("nsPerFrameMin", timing.minNs);
+                        result->setProperty("framesPerSecond", 1.0e9 / timing.medianNs);
+                        results.add(juce::var(result));
+                        
+                        std::cerr << (isSparse ? "sparse" : "cosine") << (pruning ? " pruned" : "") << " profiles "
+                                  << numProfiles << " polyphony " << polyphony << ": "
+                                  << juce::roundToInt(timing.medianNs) << " ns/frame, "
+                                  << juce::roundToInt(1.0e9 / timing.medianNs) << " frames/s\n";
+                    }
+                }
+            }
+        }
+        
+        return results;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    juce::StringArray args;
+    for (int i = 1; i < argc; ++i)
+        args.add(juce::String::fromUTF8(argv[i]));
+    
+    RunOptions options;
+    
+    // A smoke run: every case, but too short to compare numbers with
+    if (args.contains("--quick"))
+    {
+        options.numRuns = 1;
+        options.fftSeconds = 0.5;
+        options.detectionFrames = 20;
+    }
+    
+    auto* report = new juce::DynamicObject();
+    report->setProperty("version", 1);
+    report->setProperty("cpu", juce::SystemStats::getCpuModel());
+    report->setProperty("os", juce::SystemStats::getOperatingSystemName());
+    report->setProperty("sampleRate", sampleRate);
+    report->setProperty("runs", options.numRuns);
+    report->setProperty("fft", benchmarkFFT(options));
+    report->setProperty("detection", benchmarkDetection(options));
+    
+    const auto json = juce::JSON::toString(juce::var(report));
+    const int outputIndex = args.indexOf("--output");
+    
+    if (outputIndex >= 0 && outputIndex + 1 < args.size())
+    {
+        const auto file = juce::File::getCurrentWorkingDirectory().getChildFile(args[outputIndex + 1]);
+        
+        if (!file.replaceWithText(json))
+        {
+            std::cerr << "Could not write " << file.getFullPathName() << "\n";
+            return 1;
+        }
+    }
+    else
+    {
+        std::cout << json << "\n";
+    }
+    
+    return 0;
+}
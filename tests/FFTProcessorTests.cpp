@@ -0,0 +1,106 @@
+#include <juce_core/juce_core.h>
+#include "dsp/FFTProcessor.h"
+#include "dsp/InputGate.h"
+
+class FFTProcessorTests : public juce::UnitTest
+{
+public:
+    FFTProcessorTests() : juce::UnitTest("FFTProcessor", "DSP") {}
+    
+    void runTest() override
+    {
+        beginTest("Input gate has hysteresis between its thresholds");
+        {
+            InputGate gate;
+            gate.setThresholds(-50.0f, -60.0f);
+            
+            // A constant level of -55 dBFS sits between the two thresholds
+            const std::vector<float> between(256, juce::Decibels::decibelsToGain(-55.0f));
+            const std::vector<float> loud(256, 0.5f);
+            const std::vector<float> silence(256, 0.0f);
+            
+            expect(! gate.process(between.data(), 256));
+            expect(gate.process(loud.data(), 256));
+            expect(gate.process(between.data(), 256));
+            expect(! gate.process(silence.data(), 256));
+            expect(! gate.process(between.data(), 256));
+        }
+        
+        beginTest("Gated frames skip the FFT but keep the frame clock");
+        {
+            constexpr int fftSize = 1024;
+            constexpr int blockSize = 256;
+            constexpr int toneStart = 8 * blockSize;
+            constexpr int toneEnd = 24 * blockSize;
+            constexpr int totalSamples = 40 * blockSize;
+            
+            FFTProcessor fft(fftSize);
+            fft.setOverlapFactor(0.5f);
+            fft.setInputGateEnabled(true);
+            
+            std::vector<float> input(static_cast<size_t>(totalSamples), 0.0f);
+            for (int i = toneStart; i < toneEnd; ++i)
+                input[static_cast<size_t>(i)] = 0.5f * std::sin(0.05f * static_cast<float>(i));
+            
+            // Absolute end position of every frame, and whether it carried a spectrum
+            std::vector<std::pair<int, bool>> frames;
+            int blockStart = 0;
+            fft.setSpectrumDataCallback([&](const float* spectrum, int, int sampleOffset) {
+                frames.emplace_back(blockStart + sampleOffset, spectrum != nullptr);
+            });
+            
+            for (; blockStart < totalSamples; blockStart += blockSize)
+                fft.processBlock(input.data() + blockStart, blockSize);
+            
+            expectEquals(static_cast<int>(frames.size()), (totalSamples - fftSize) / fft.getHopSize() + 1);
+            
+            int numAnalysed = 0;
+            for (const auto& frame : frames)
+            {
+                // Exactly the frames whose window overlaps the tone are analysed
+                const int frameStart = frame.first - fftSize;
+                const bool overlapsTone = frame.first > toneStart && frameStart < toneEnd;
+                expectEquals(frame.second, overlapsTone);
+                numAnalysed += frame.second ? 1 : 0;
+            }
+            
+            expectEquals(fft.getNumGatedFrames(), static_cast<int>(frames.size()) - numAnalysed);
+        }
+        
+        beginTest("Frames are reported where their hop ends, for any block size");
+        {
+            constexpr int fftSize = 4096;
+            constexpr int totalSamples = 16 * fftSize;
+            const std::vector<float> input(static_cast<size_t>(totalSamples), 0.25f);
+            
+            // Power-of-two blocks put every hop end on a block boundary; the others don't
+            for (int blockSize : { 64, 256, 1024, 2048, 441, 1000 })
+            {
+                FFTProcessor fft(fftSize);
+                fft.setOverlapFactor(0.75f);
+                
+                std::vector<int> frameEnds;
+                int blockStart = 0, currentBlockSize = 0;
+                fft.setSpectrumDataCallback([&](const float*, int, int sampleOffset) {
+                    // A hop ending on the block's last sample is reported one past it
+                    expect(sampleOffset > 0 && sampleOffset <= currentBlockSize,
+                           "offset " + juce::String(sampleOffset) + " in a block of " + juce::String(currentBlockSize));
+                    frameEnds.push_back(blockStart + sampleOffset);
+                });
+                
+                for (; blockStart < totalSamples; blockStart += blockSize)
+                {
+                    currentBlockSize = juce::jmin(blockSize, totalSamples - blockStart);
+                    fft.processBlock(input.data() + blockStart, currentBlockSize);
+                }
+                
+                expectEquals(static_cast<int>(frameEnds.size()), (totalSamples - fftSize) / fft.getHopSize() + 1);
+                
+                for (size_t i = 0; i < frameEnds.size(); ++i)
+                    expectEquals(frameEnds[i], fftSize + static_cast<int>(i) * fft.getHopSize());
+            }
+        }
+    }
+};
+
+static FFTProcessorTests fftProcessorTests;
@@ -0,0 +1,105 @@
+#include <juce_core/juce_core.h>
+#include "dsp/HexaphonicAnalyser.h"
+#include "TestSignals.h"
+#include <set>
+
+class HexaphonicAnalyserTests : public juce::UnitTest
+{
+public:
+    HexaphonicAnalyserTests() : juce::UnitTest("Hexaphonic Analyser", "DSP") {}
+    
+    void runTest() override
+    {
+        constexpr double sampleRate = 44100.0;
+        constexpr int fftSize = 4096;
+        
+        // Two strings, four frets each: string 0 plays 40-44, string 1 plays 45-49
+        PitchDetector::GuitarSettings settings;
+        settings.openStringMidiNotes = { 40, 45 };
+        settings.numFrets = 4;
+        
+        PitchDetector source;
+        source.prepare(sampleRate, fftSize);
+        
+        for (int note = 40; note <= 49; ++note)
+            source.addProfile(note, TestSignals::captureSpectrum(note, sampleRate, fftSize).data(), fftSize / 2);
+        
+        beginTest("Each string only gets its own fret range");
+        {
+            int lowest = 0, highest = 0;
+            HexaphonicAnalyser::getStringRange(settings, 1, lowest, highest);
+            expectEquals(lowest, 45);
+            expectEquals(highest, 49);
+            
+            PitchDetector stringDetector(1);
+            expectEquals(stringDetector.copyProfilesFrom(source, lowest, highest), 5);
+        }
+        
+        beginTest("Strings are analysed separately and merged per frame");
+        {
+            expect(runChord(source, settings, sampleRate, fftSize, false) == std::set<int>({ 42, 47 }));
+        }
+        
+        beginTest("Worker threads give the same notes");
+        {
+            expect(runChord(source, settings, sampleRate, fftSize, true) == std::set<int>({ 42, 47 }));
+        }
+    }
+
+private:
+    std::set<int> runChord(const PitchDetector& source, const PitchDetector::GuitarSettings& settings,
+                           double sampleRate, int fftSize, bool useWorkers)
+    {
+        constexpr int blockSize = 512;
+        constexpr int numBlocks = 64;
+        
+        HexaphonicAnalyser analyser;
+        analyser.prepare(source, settings, 2, sampleRate, fftSize, 0.5f, useWorkers, fftSize);
+        expectEquals(analyser.getNumStrings(), 2);
+        
+        // Notes seen in frames after the window has filled
+        std::set<int> notes;
+        int numFrames = 0;
+        analyser.setFrameCallback([&](const NoteEvent* events, int numEvents, int sampleOffset) {
+            expect(sampleOffset >= 0 && sampleOffset < blockSize);
+            
+            if (++numFrames <= 1)
+                return;
+            
+            for (int i = 0; i < numEvents; ++i)
+            {
+                // Each note is tagged with the string whose channel played it
+                const auto& event = events[i];
+                expect(event.guitarString == 0 || event.guitarString == 1);
+                
+                if (event.guitarString == 0 || event.guitarString == 1)
+                    expectEquals(event.guitarFret,
+                                 event.midiNote - settings.openStringMidiNotes[static_cast<size_t>(event.guitarString)]);
+                
+                expectWithinAbsoluteError(event.cents, 0.0f, 25.0f);
+                notes.insert(event.midiNote);
+            }
+        });
+        
+        const auto low = TestSignals::renderSine(42, sampleRate, blockSize * numBlocks);
+        const auto high = TestSignals::renderSine(47, sampleRate, blockSize * numBlocks);
+        juce::AudioBuffer<float> block(2, blockSize);
+        
+        for (int b = 0; b < numBlocks; ++b)
+        {
+            block.copyFrom(0, 0, low.data() + b * blockSize, blockSize);
+            block.copyFrom(1, 0, high.data() + b * blockSize, blockSize);
+            analyser.processBlock(block, blockSize);
+            
+            // Let the workers keep up, as they would in real time
+            if (useWorkers)
+                juce::Thread::sleep(2);
+        }
+        
+        expectGreaterThan(numFrames, 5);
+        expectEquals(analyser.getNumLateFrames(), 0);
+        return notes;
+    }
+};
+
+static HexaphonicAnalyserTests hexaphonicAnalyserTests;
@@ -0,0 +1,203 @@
+#include <juce_core/juce_core.h>
+#include "midi/MIDIManager.h"
+
+class MIDIManagerTests : public juce::UnitTest
+{
+public:
+    MIDIManagerTests() : juce::UnitTest("MIDIManager", "MIDI") {}
+    
+    void runTest() override
+    {
+        beginTest("Note sets combine word-wide and iterate in note order");
+        {
+            NoteSet a, b;
+            for (int note : { 0, 63, 64, 127 })
+                a.set(note);
+            for (int note : { 63, 100 })
+                b.set(note);
+            
+            a.set(128);
+            a.set(-1);
+            expectEquals(a.size(), 4);
+            expect(a.contains(64) && ! a.contains(65) && ! a.contains(128));
+            
+            expect(collect(a & b) == std::vector<int>({ 63 }));
+            expect(collect(a | b) == std::vector<int>({ 0, 63, 64, 100, 127 }));
+            expect(collect(a & ~b) == std::vector<int>({ 0, 64, 127 }));
+            
+            a.reset(0);
+            a.clear();
+            expect(a.isEmpty());
+        }
+        
+        beginTest("Notes are confirmed before note-on and released after the off delay");
+        {
+            // 20 ms = 960 samples, two 480-sample hops
+            MIDIManager manager;
+            manager.updateSampleRate(48000.0);
+            manager.setNoteOnDelayMs(20);
+            manager.setNoteOffDelayMs(20);
+            juce::MidiBuffer midi;
+            const int hop = 480;
+            
+            // The notes need two hops of detection after their first sighting
+            manager.processNotes({ 64, 60 }, midi, 0, hop);
+            manager.processNotes({ 60, 64 }, midi, 10, hop);
+            expect(midi.isEmpty());
+            
+            // Sent together, lowest note first
+            manager.processNotes({ 60, 64 }, midi, 20, hop);
+            expect(describe(midi) == std::vector<juce::String>({ "on 60 @20", "on 64 @20" }));
+            midi.clear();
+            
+            // A note that drops out for less than the off delay is not released
+            manager.processNotes({ 60 }, midi, 30, hop);
+            manager.processNotes({ 60 }, midi, 40, hop);
+            manager.processNotes({ 60, 64 }, midi, 50, hop);
+            expect(midi.isEmpty());
+            
+            // ...but is once it has been absent for the full delay
+            manager.processNotes({ 60 }, midi, 60, hop);
+            manager.processNotes({ 60 }, midi, 70, hop);
+            expect(midi.isEmpty());
+            manager.processNotes({ 60 }, midi, 80, hop);
+            expect(describe(midi) == std::vector<juce::String>({ "off 64 @80" }));
+            midi.clear();
+            
+            manager.reset(midi, 90);
+            expect(describe(midi) == std::vector<juce::String>({ "off 60 @90" }));
+        }
+        
+        beginTest("Delays follow the hop duration and the sample rate");
+        {
+            MIDIManager manager;
+            manager.setNoteOnDelayMs(20);
+            manager.setNoteOffDelayMs(0);
+            juce::MidiBuffer midi;
+            
+            // One 1024-sample hop at 44.1 kHz already covers 20 ms
+            manager.processNotes({ 60 }, midi, 0, 1024);
+            manager.processNotes({ 60 }, midi, 1, 1024);
+            expectEquals(midi.getNumEvents(), 1);
+            
+            // A zero off delay releases on the first absent frame
+            manager.processNotes({}, midi, 2, 1024);
+            expectEquals(midi.getNumEvents(), 2);
+            midi.clear();
+            
+            // Changing the sample rate rescales the delay set before it
+            manager.updateSampleRate(96000.0);
+            manager.processNotes({ 62 }, midi, 0, 1024);
+            manager.processNotes({ 62 }, midi, 1, 1024);
+            expect(midi.isEmpty());
+            manager.processNotes({ 62 }, midi, 2, 1024);
+            expect(describe(midi) == std::vector<juce::String>({ "on 62 @2" }));
+        }
+        
+        beginTest("Confidence hysteresis starts high and holds low");
+        {
+            MIDIManager manager;
+            manager.setNoteOnDelayMs(0);
+            manager.setNoteOffDelayMs(0);
+            manager.setConfidenceThresholds(0.6f, 0.3f);
+            juce::MidiBuffer midi;
+            const int hop = 512;
+            
+            // Below the on-threshold a detection does not start a note
+            processEvent(manager, makeEvent(60, 0.5f), midi, 0, hop);
+            expect(midi.isEmpty());
+            
+            processEvent(manager, makeEvent(60, 0.7f), midi, 1, hop);
+            expect(describe(midi) == std::vector<juce::String>({ "on 60 @1" }));
+            midi.clear();
+            
+            // Once sounding, it only has to stay above the off-threshold
+            processEvent(manager, makeEvent(60, 0.4f), midi, 2, hop);
+            expect(midi.isEmpty());
+            
+            processEvent(manager, makeEvent(60, 0.2f), midi, 3, hop);
+            expect(describe(midi) == std::vector<juce::String>({ "off 60 @3" }));
+        }
+        
+        beginTest("Velocities follow the loudest level before note-on");
+        {
+            MIDIManager::VelocityCurve curve;
+            expectEquals(curve.getVelocity(-100.0f), 1);
+            expectEquals(curve.getVelocity(-60.0f), 1);
+            expectEquals(curve.getVelocity(-12.0f), 127);
+            expectEquals(curve.getVelocity(0.0f), 127);
+            
+            curve.exponent = 2.0f;
+            expectEquals(curve.getVelocity(-24.0f), 72);
+            
+            // 20 ms at 44.1 kHz is two 512-sample hops
+            MIDIManager manager;
+            manager.setNoteOnDelayMs(20);
+            manager.setVelocityFromLevelEnabled(true);
+            juce::MidiBuffer midi;
+            const int hop = 512;
+            
+            processEvent(manager, makeEvent(60, 1.0f, -30.0f), midi, 0, hop);
+            processEvent(manager, makeEvent(60, 1.0f, -20.0f), midi, 1, hop);
+            processEvent(manager, makeEvent(60, 1.0f, -40.0f), midi, 2, hop);
+            expectEquals(velocityOf(midi, 60), 106);
+            
+            // Plain note lists carry no levels and keep the fixed velocity
+            manager.setNoteOnDelayMs(0);
+            manager.processNotes({ 60, 67 }, midi, 3, hop);
+            expectEquals(velocityOf(midi, 67), 100);
+        }
+    }
+
+private:
+    static std::vector<int> collect(const NoteSet& notes)
+    {
+        std::vector<int> result;
+        notes.forEach([&result](int note) { result.push_back(note); });
+        return result;
+    }
+    
+    static NoteEvent makeEvent(int note, float confidence, float levelDb = -100.0f)
+    {
+        NoteEvent event;
+        event.midiNote = note;
+        event.confidence = confidence;
+        event.levelDb = levelDb;
+        return event;
+    }
+    
+    static void processEvent(MIDIManager& manager, const NoteEvent& event, juce::MidiBuffer& midi,
+                             int sampleNumber, int elapsedSamples)
+    {
+        manager.processNotes(&event, 1, midi, sampleNumber, elapsedSamples);
+    }
+    
+    static int velocityOf(const juce::MidiBuffer& midi, int note)
+    {
+        for (const auto metadata : midi)
+        {
+            const auto message = metadata.getMessage();
+            
+            if (message.isNoteOn() && message.getNoteNumber() == note)
+                return message.getVelocity();
+        }
+        
+        return -1;
+    }
+    
+    static std::vector<juce::String> describe(const juce::MidiBuffer& midi)
+    {
+        std::vector<juce::String> events;
+        
+        for (const auto metadata : midi)
+        {
+            const auto message = metadata.getMessage();
+            events.push_back(juce::String(message.isNoteOn() ? "on " : "off ") + juce::String(message.getNoteNumber())
+                             + " @" + juce::String(metadata.samplePosition));
+        }
+        
+        return events;
+    }
+};
+
+static MIDIManagerTests midiManagerTests;
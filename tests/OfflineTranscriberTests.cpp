@@ -0,0 +1,121 @@
+#include <juce_core/juce_core.h>
+#include "offline/OfflineTranscriber.h"
+#include "TestSignals.h"
+#include <thread>
+
+class OfflineTranscriberTests : public juce::UnitTest
+{
+public:
+    OfflineTranscriberTests() : juce::UnitTest("Offline Transcriber", "Offline") {}
+    
+    void runTest() override
+    {
+        constexpr double sampleRate = 44100.0;
+        constexpr int fftSize = 4096;
+        
+        PitchDetector templates;
+        templates.prepare(sampleRate, fftSize);
+        
+        for (int note = 60; note <= 72; ++note)
+            templates.addProfile(note, TestSignals::captureSpectrum(note, sampleRate, fftSize).data(), fftSize / 2);
+        
+        // A quarter second of silence, one second of E4, then half a second of silence
+        const auto recording = renderRecording(64, sampleRate);
+        
+        OfflineTranscriber::Settings settings;
+        settings.fftSize = fftSize;
+        
+        beginTest("A recorded note becomes one note-on/note-off pair");
+        {
+            OfflineTranscriber transcriber(templates, settings);
+            juce::MidiMessageSequence sequence;
+            transcriber.transcribe(recording, sampleRate, sequence);
+            
+            expectWithinAbsoluteError(transcriber.getLastDurationSeconds(), 1.75, 1.0e-6);
+            expectEquals(sequence.getNumEvents(), 2);
+            
+            if (sequence.getNumEvents() == 2)
+            {
+                const auto& noteOn = sequence.getEventPointer(0)->message;
+                const auto& noteOff = sequence.getEventPointer(1)->message;
+                
+                expect(noteOn.isNoteOn());
+                expect(noteOff.isNoteOff());
+                expectEquals(noteOn.getNoteNumber(), 64);
+                expectEquals(noteOff.getNoteNumber(), 64);
+                
+                // Latency is the note-on delay plus up to a window and a hop
+                expectGreaterOrEqual(noteOn.getTimeStamp(), 0.25);
+                expectLessThan(noteOn.getTimeStamp(), 0.45);
+                expectGreaterOrEqual(noteOff.getTimeStamp(), 1.25);
+                expectLessThan(noteOff.getTimeStamp(), 1.55);
+            }
+        }
+        
+        beginTest("Nothing carries over between recordings");
+        {
+            OfflineTranscriber transcriber(templates, settings);
+            juce::MidiMessageSequence first, second;
+            transcriber.transcribe(recording, sampleRate, first);
+            transcriber.transcribe(recording, sampleRate, second);
+            
+            expect(sameMidi(first, second));
+        }
+        
+        beginTest("Transcribers on separate threads share one set of templates");
+        {
+            juce::MidiMessageSequence reference;
+            OfflineTranscriber(templates, settings).transcribe(recording, sampleRate, reference);
+            
+            std::vector<juce::MidiMessageSequence> results(4);
+            std::vector<std::thread> threads;
+            
+            for (auto& result : results)
+                threads.emplace_back([&templates, &settings, &recording, &result] {
+                    OfflineTranscriber transcriber(templates, settings);
+                    transcriber.transcribe(recording, sampleRate, result);
+                });
+            
+            for (auto& thread : threads)
+                thread.join();
+            
+            for (const auto& result : results)
+                expect(sameMidi(result, reference));
+        }
+    }
+
+private:
+    static juce::AudioBuffer<float> renderRecording(int midiNote, double sampleRate)
+    {
+        const int noteStart = static_cast<int>(sampleRate * 0.25);
+        const int noteLength = static_cast<int>(sampleRate);
+        const auto note = TestSignals::renderSine(midiNote, sampleRate, noteLength);
+        
+        juce::AudioBuffer<float> recording(1, static_cast<int>(sampleRate * 1.75));
+        recording.clear();
+        recording.copyFrom(0, noteStart, note.data(), noteLength);
+        return recording;
+    }
+    
+    static bool sameMidi(const juce::MidiMessageSequence& a, const juce::MidiMessageSequence& b)
+    {
+        if (a.getNumEvents() != b.getNumEvents())
+            return false;
+        
+        for (int i = 0; i < a.getNumEvents(); ++i)
+        {
+            const auto& first = a.getEventPointer(i)->message;
+            const auto& second = b.getEventPointer(i)->message;
+            
+            if (first.isNoteOn() != second.isNoteOn()
+                || first.getNoteNumber() != second.getNoteNumber()
+                || first.getVelocity() != second.getVelocity()
+                || std::abs(first.getTimeStamp() - second.getTimeStamp()) > 1.0e-9)
+                return false;
+        }
+        
+        return true;
+    }
+};
+
+static OfflineTranscriberTests offlineTranscriberTests;
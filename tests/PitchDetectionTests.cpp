@@ -0,0 +1,620 @@
+#include <juce_core/juce_core.h>
+#include "dsp/PitchDetector.h"
+#include "dsp/LogFrequencyProjector.h"
+#include "dsp/ProfileFile.h"
+#include "dsp/ProfileLearner.h"
+#include "dsp/ProfileMatrix.h"
+
+namespace
+{
+    constexpr double testSampleRate = 44100.0;
+    constexpr int testFFTSize = 4096;
+    constexpr int testSpectrumSize = testFFTSize / 2;
+    
+    // Builds an idealised magnitude spectrum with decaying harmonic peaks for a MIDI note
+    std::vector<float> makeHarmonicSpectrum(int midiNote, float amplitude = 1.0f, int fftSize = testFFTSize)
+    {
+        std::vector<float> spectrum(static_cast<size_t>(fftSize / 2), 0.0f);
+        const double fundamental = 440.0 * std::pow(2.0, (midiNote - 69) / 12.0);
+        const double binWidth = testSampleRate / fftSize;
+        
+        for (int harmonic = 1; harmonic <= 8; ++harmonic)
+        {
+            const int bin = static_cast<int>(std::round(fundamental * harmonic / binWidth));
+            if (bin >= fftSize / 2)
+                break;
+            
+            spectrum[static_cast<size_t>(bin)] += amplitude / static_cast<float>(harmonic);
+        }
+        
+        return spectrum;
+    }
+}
+
+class PitchDetectionTests : public juce::UnitTest
+{
+public:
+    PitchDetectionTests() : juce::UnitTest("PitchDetector", "Detection") {}
+    
+    void runTest() override
+    {
+        beginTest("Profile matrix product matches a scalar dot product");
+        {
+            auto random = getRandom();
+            const int numBins = 37; // Deliberately not a multiple of the SIMD width
+            const int numRows = 7;
+            
+            ProfileMatrix matrix;
+            std::vector<std::vector<float>> rows;
+            
+            for (int r = 0; r < numRows; ++r)
+            {
+                std::vector<float> row(static_cast<size_t>(numBins));
+                for (auto& value : row)
+                    value = random.nextFloat();
+                
+                matrix.addRow(row.data(), numBins);
+                rows.push_back(row);
+            }
+            
+            AlignedFloatBuffer input;
+            input.setSize(matrix.getRowStride());
+            for (int i = 0; i < numBins; ++i)
+                input.data()[i] = random.nextFloat();
+            
+            std::vector<float> output(static_cast<size_t>(numRows));
+            matrix.multiply(input.data(), output.data());
+            
+            for (int r = 0; r < numRows; ++r)
+            {
+                float expected = 0.0f;
+                for (int i = 0; i < numBins; ++i)
+                    expected += rows[static_cast<size_t>(r)][static_cast<size_t>(i)] * input.data()[i];
+                
+                expectWithinAbsoluteError(output[static_cast<size_t>(r)], expected, 1.0e-4f);
+            }
+        }
+        
+        beginTest("Profile matrix keeps its values when the bin count changes");
+        {
+            ProfileMatrix matrix;
+            const std::vector<float> row { 1.0f, 2.0f, 3.0f, 4.0f, 5.0f };
+            
+            for (int r = 0; r < 3; ++r)
+                matrix.addRow(row.data(), static_cast<int>(row.size()));
+            
+            // Growing past the padded width lays the rows out again; new bins are zero
+            matrix.setNumBins(13);
+            matrix.setValue(1, 12, 10.0f);
+            expectEquals(matrix.getNumBins(), 13);
+            expectEquals(matrix.getRow(2)[4], 5.0f);
+            expectEquals(matrix.getRow(2)[12], 0.0f);
+            expectEquals(matrix.getRow(1)[12], 10.0f);
+            
+            // Shrinking clears the dropped bins, so products ignore them
+            matrix.setNumBins(3);
+            
+            AlignedFloatBuffer ones;
+            ones.setSize(16);
+            std::fill(ones.data(), ones.data() + ones.getSize(), 1.0f);
+            
+            std::vector<float> output(3);
+            matrix.multiply(ones.data(), output.data());
+            
+            for (float sum : output)
+                expectEquals(sum, 6.0f);
+        }
+        
+        beginTest("Detects a single learned note");
+        {
+            PitchDetector detector(6);
+            detector.prepare(testSpectrumSize);
+            
+            for (int note : { 48, 52, 55, 60, 64, 67 })
+            {
+                auto spectrum = makeHarmonicSpectrum(note);
+                detector.addProfile(note, spectrum.data(), testSpectrumSize);
+            }
+            
+            auto input = makeHarmonicSpectrum(64, 0.3f);
+            const auto& detected = detector.processSpectrum(input.data(), testSpectrumSize);
+            
+            expect(! detected.empty());
+            expect(std::find(detected.begin(), detected.end(), 64) != detected.end());
+        }
+        
+        beginTest("Sparse activations resolve a chord without spurious notes");
+        {
+            PitchDetector detector(6);
+            detector.prepare(testSpectrumSize);
+            detector.setDetectionEngine(PitchDetector::DetectionEngine::SparseActivations);
+            detector.setOnsetGatingEnabled(false); // Repeated frames would otherwise skip the solver
+            
+            for (int note = 40; note <= 80; ++note)
+            {
+                auto spectrum = makeHarmonicSpectrum(note);
+                detector.addProfile(note, spectrum.data(), testSpectrumSize);
+            }
+            
+            std::vector<float> chord(static_cast<size_t>(testSpectrumSize), 0.0f);
+            for (int note : { 60, 64, 67 })
+            {
+                auto spectrum = makeHarmonicSpectrum(note);
+                for (size_t i = 0; i < chord.size(); ++i)
+                    chord[i] += spectrum[i];
+            }
+            
+            auto detected = detector.processSpectrum(chord.data(), testSpectrumSize);
+            std::sort(detected.begin(), detected.end());
+            expect(detected == std::vector<int>({ 60, 64, 67 }));
+            
+            // The next frame starts from the previous activations and converges sooner
+            const int coldIterations = detector.getLastSolverIterations();
+            detector.processSpectrum(chord.data(), testSpectrumSize);
+            expect(detector.getLastSolverIterations() < coldIterations);
+        }
+        
+        beginTest("Templates learned in place keep the solver's Gram matrix current");
+        {
+            // Learning rewrites each template every frame; the solver has to see the same
+            // products as a detector that loads the finished templates in one go
+            PitchDetector learned(6);
+            learned.prepare(testSampleRate, testFFTSize);
+            learned.setDetectionEngine(PitchDetector::DetectionEngine::SparseActivations);
+            learned.setOnsetGatingEnabled(false);
+            
+            for (int note : { 55, 60, 64, 67, 72 })
+            {
+                learned.setCurrentLearningNote(note);
+                learned.setLearningModeActive(true);
+                
+                for (int frame = 0; frame < 40; ++frame)
+                {
+                    auto spectrum = makeHarmonicSpectrum(note, 0.5f + 0.1f * static_cast<float>(frame % 5));
+                    spectrum[static_cast<size_t>(frame % 50)] += 0.05f;
+                    learned.processSpectrum(spectrum.data(), testSpectrumSize);
+                }
+            }
+            
+            learned.setLearningModeActive(false);
+            expectEquals(learned.getNumProfiles(), 5);
+            
+            auto file = juce::File::createTempFile(".ptpf");
+            expect(learned.saveInstrumentData(file.getFullPathName()));
+            
+            PitchDetector loaded(6);
+            loaded.prepare(testSampleRate, testFFTSize);
+            loaded.setDetectionEngine(PitchDetector::DetectionEngine::SparseActivations);
+            loaded.setOnsetGatingEnabled(false);
+            expect(loaded.loadInstrumentData(file.getFullPathName()));
+            
+            std::vector<float> chord(static_cast<size_t>(testSpectrumSize), 0.0f);
+            for (int note : { 60, 67 })
+            {
+                auto spectrum = makeHarmonicSpectrum(note);
+                for (size_t i = 0; i < chord.size(); ++i)
+                    chord[i] += spectrum[i];
+            }
+            
+            NoteEvent learnedEvents[6], loadedEvents[6];
+            const int numLearned = learned.processSpectrum(chord.data(), testSpectrumSize, learnedEvents, 6, 0);
+            const int numLoaded = loaded.processSpectrum(chord.data(), testSpectrumSize, loadedEvents, 6, 0);
+            
+            expectEquals(numLearned, numLoaded);
+            expectEquals(learned.getLastSolverIterations(), loaded.getLastSolverIterations());
+            
+            for (int i = 0; i < juce::jmin(numLearned, numLoaded); ++i)
+            {
+                expectEquals(learnedEvents[i].midiNote, loadedEvents[i].midiNote);
+                expectWithinAbsoluteError(learnedEvents[i].confidence, loadedEvents[i].confidence, 1.0e-4f);
+            }
+            
+            file.deleteFile();
+        }
+        
+        beginTest("Learning keeps running statistics instead of raw frames");
+        {
+            ProfileLearner learner;
+            learner.prepare(4);
+            learner.setReservoirCapacity(3);
+            
+            const float frames[][4] = { { 1.0f, 0.0f, 2.0f, 4.0f },
+                                        { 3.0f, 0.0f, 2.0f, 0.0f },
+                                        { 5.0f, 0.0f, 2.0f, 2.0f },
+                                        { 7.0f, 0.0f, 2.0f, 6.0f } };
+            
+            for (const auto& frame : frames)
+                learner.addFrame(64, frame, 4);
+            
+            expectEquals(static_cast<int>(learner.getNumFrames(64)), 4);
+            expectEquals(learner.getReservoirSize(64), 3);
+            expect(learner.getMean(63) == nullptr);
+            
+            float variance[4];
+            expect(learner.getVariance(64, variance));
+            expectWithinAbsoluteError(learner.getMean(64)[0], 4.0f, 1.0e-5f);
+            expectWithinAbsoluteError(learner.getMean(64)[3], 3.0f, 1.0e-5f);
+            expectWithinAbsoluteError(variance[0], 20.0f / 3.0f, 1.0e-4f);
+            expectWithinAbsoluteError(variance[2], 0.0f, 1.0e-6f);
+            
+            learner.clearNote(64);
+            expectEquals(static_cast<int>(learner.getNumFrames(64)), 0);
+            expectEquals(learner.getReservoirSize(64), 0);
+        }
+        
+        beginTest("Profile files round-trip and reject corruption");
+        {
+            PitchDetector detector(6);
+            detector.prepare(testSampleRate, testFFTSize);
+            
+            for (int note : { 48, 52, 55, 60, 64, 67 })
+            {
+                auto spectrum = makeHarmonicSpectrum(note);
+                detector.addProfile(note, spectrum.data(), testSpectrumSize);
+            }
+            
+            auto file = juce::File::createTempFile(".ptpf");
+            expect(detector.saveInstrumentData(file.getFullPathName()));
+            
+            PitchDetector loaded(6);
+            loaded.prepare(testSampleRate, testFFTSize);
+            expect(loaded.loadInstrumentData(file.getFullPathName()));
+            expectEquals(loaded.getNumProfiles(), 6);
+            
+            auto input = makeHarmonicSpectrum(64, 0.3f);
+            const auto& detected = loaded.processSpectrum(input.data(), testSpectrumSize);
+            expect(std::find(detected.begin(), detected.end(), 64) != detected.end());
+            
+            // A detector running at a different FFT size can't use these templates
+            PitchDetector mismatched(6);
+            mismatched.prepare(testSampleRate, testFFTSize * 2);
+            expect(! mismatched.loadInstrumentData(file.getFullPathName()));
+            
+            juce::MemoryBlock contents;
+            expect(file.loadFileAsData(contents));
+            
+            ProfileFile profileFile;
+            expect(profileFile.openFromMemory(contents.getData(), contents.getSize()).wasOk());
+            expectEquals(profileFile.getFFTSize(), testFFTSize);
+            expectEquals(profileFile.getNumBins(), testSpectrumSize);
+            expectEquals(profileFile.getProfileInfo(4).midiNote, 64);
+            
+            // The checksum covers the header and its extension as well as the templates:
+            // a damaged sample rate (bytes 16-23) or log axis (64-79) is caught too
+            for (size_t offset : { size_t(16), size_t(20), size_t(64), contents.getSize() - 1 })
+            {
+                juce::MemoryBlock damaged(contents);
+                static_cast<char*>(damaged.getData())[offset] ^= 1;
+                expect(profileFile.openFromMemory(damaged.getData(), damaged.getSize()).failed());
+            }
+            
+            expect(profileFile.openFromMemory(contents.getData(), contents.getSize() / 2).failed());
+            
+            // Linear templates must have one bin per FFT bin
+            ProfileMatrix matrix;
+            matrix.addRow(input.data(), testSpectrumSize);
+            std::vector<ProfileFile::ProfileInfo> info(1);
+            info[0].midiNote = 64;
+            const auto wrongSize = ProfileFile::createFileData(testSampleRate, testFFTSize * 2, ProfileFile::BinLayout::LinearMagnitude,
+                                                               info, matrix, {});
+            expect(profileFile.openFromMemory(wrongSize.getData(), wrongSize.getSize()).failed());
+            
+            // A note outside the MIDI range is rejected even when the checksum matches
+            std::vector<ProfileFile::ProfileInfo> badInfo(1);
+            badInfo[0].midiNote = -3;
+            ProfileMatrix badMatrix;
+            badMatrix.addRow(input.data(), testSpectrumSize);
+            const auto badData = ProfileFile::createFileData(testSampleRate, testFFTSize, ProfileFile::BinLayout::LinearMagnitude,
+                                                             badInfo, badMatrix, {});
+            expect(profileFile.openFromMemory(badData.getData(), badData.getSize()).failed());
+            
+            // So is one in a file from before the versioned format
+            for (int note : { 60, -3, 128 })
+            {
+                file.deleteFile();
+                
+                {
+                    juce::FileOutputStream legacy(file);
+                    legacy.writeInt(1);
+                    legacy.writeInt(note);
+                    legacy.writeInt(0);
+                    legacy.writeInt(4);
+                    
+                    for (int i = 0; i < 4; ++i)
+                        legacy.writeFloat(1.0f);
+                }
+                
+                expectEquals(loaded.loadInstrumentData(file.getFullPathName()), note == 60);
+            }
+            
+            file.deleteFile();
+        }
+        
+        beginTest("Log-frequency templates are compact and independent of the FFT size");
+        {
+            LogFrequencyProjector projector;
+            projector.prepare(testSampleRate, testFFTSize, 3);
+            expectEquals(projector.getNumBins(), LogFrequencyProjector::calculateNumBins(3, 27.5f, 8000.0f));
+            expectLessThan(projector.getNumBins() * 6, testSpectrumSize);
+            
+            // A4 is 48 semitones above A0, so it peaks in bin 3 * 48
+            std::vector<float> spectrum(static_cast<size_t>(testSpectrumSize), 0.0f);
+            spectrum[static_cast<size_t>(std::round(440.0 * testFFTSize / testSampleRate))] = 1.0f;
+            std::vector<float> projected(static_cast<size_t>(projector.getNumBins()));
+            projector.project(spectrum.data(), testSpectrumSize, projected.data());
+            expectEquals(static_cast<int>(std::max_element(projected.begin(), projected.end()) - projected.begin()), 144);
+            
+            PitchDetector detector(6);
+            detector.prepare(testSampleRate, testFFTSize);
+            detector.setLogFrequencyResolution(3);
+            expectEquals(detector.getFeatureSize(), projector.getNumBins());
+            
+            for (int note : { 48, 52, 55, 60, 64, 67 })
+            {
+                auto harmonics = makeHarmonicSpectrum(note);
+                detector.addProfile(note, harmonics.data(), testSpectrumSize);
+            }
+            
+            auto file = juce::File::createTempFile(".ptpf");
+            expect(detector.saveInstrumentData(file.getFullPathName()));
+            
+            // Unlike linear templates, these load and match at a different FFT size
+            PitchDetector loaded(6);
+            loaded.prepare(testSampleRate, testFFTSize * 2);
+            expect(loaded.loadInstrumentData(file.getFullPathName()));
+            expectEquals(loaded.getLogFrequencyResolution(), 3);
+            expectEquals(loaded.getNumProfiles(), 6);
+            
+            auto input = makeHarmonicSpectrum(64, 0.3f, testFFTSize * 2);
+            const auto& detected = loaded.processSpectrum(input.data(), testFFTSize);
+            expect(std::find(detected.begin(), detected.end(), 64) != detected.end());
+            
+            file.deleteFile();
+        }
+        
+        beginTest("Onset gating reuses sustained notes and re-detects on changes");
+        {
+            PitchDetector detector(6);
+            detector.prepare(testSpectrumSize);
+            detector.setDetectionEngine(PitchDetector::DetectionEngine::SparseActivations);
+            detector.setMaxReusedFrames(100);
+            
+            for (int note = 40; note <= 80; ++note)
+            {
+                auto spectrum = makeHarmonicSpectrum(note);
+                detector.addProfile(note, spectrum.data(), testSpectrumSize);
+            }
+            
+            auto mix = [](std::initializer_list<int> notes, float amplitude) {
+                std::vector<float> spectrum(static_cast<size_t>(testSpectrumSize), 0.0f);
+                for (int note : notes)
+                {
+                    auto harmonics = makeHarmonicSpectrum(note, amplitude);
+                    for (size_t i = 0; i < spectrum.size(); ++i)
+                        spectrum[i] += harmonics[i];
+                }
+                return spectrum;
+            };
+            
+            auto detectSorted = [&detector](const std::vector<float>& spectrum) {
+                auto notes = detector.processSpectrum(spectrum.data(), testSpectrumSize);
+                std::sort(notes.begin(), notes.end());
+                return notes;
+            };
+            
+            // A decaying chord only needs the full search on its first frame
+            float amplitude = 1.0f;
+            for (int frame = 0; frame < 20; ++frame, amplitude *= 0.9f)
+                expect(detectSorted(mix({ 60, 64, 67 }, amplitude)) == std::vector<int>({ 60, 64, 67 }));
+            
+            expectEquals(detector.getNumFullDetections(), 1);
+            expectEquals(detector.getNumReusedFrames(), 19);
+            
+            // A new note is an onset
+            expect(detectSorted(mix({ 60, 64, 67, 71 }, amplitude)) == std::vector<int>({ 60, 64, 67, 71 }));
+            expectEquals(detector.getNumFullDetections(), 2);
+            
+            // A released note adds no flux, but fails verification
+            expect(detectSorted(mix({ 64, 67, 71 }, amplitude)) == std::vector<int>({ 64, 67, 71 }));
+            expectEquals(detector.getNumFullDetections(), 3);
+            
+            // Without gating every frame runs the full search
+            detector.setOnsetGatingEnabled(false);
+            for (int frame = 0; frame < 5; ++frame)
+                detectSorted(mix({ 64, 67, 71 }, amplitude));
+            
+            expectEquals(detector.getNumReusedFrames(), 0);
+        }
+        
+        beginTest("Salience pruning only scores candidate templates");
+        {
+            PitchDetector pruned(6), full(6);
+            
+            for (auto* detector : { &pruned, &full })
+            {
+                detector->prepare(testSampleRate, testFFTSize);
+                detector->setDetectionEngine(PitchDetector::DetectionEngine::SparseActivations);
+                detector->setOnsetGatingEnabled(false);
+                
+                for (int note = 40; note <= 80; ++note)
+                {
+                    auto spectrum = makeHarmonicSpectrum(note);
+                    detector->addProfile(note, spectrum.data(), testSpectrumSize);
+                }
+            }
+            
+            full.setCandidatePruningEnabled(false);
+            
+            for (auto chordNotes : { std::vector<int>({ 45 }), std::vector<int>({ 60, 64, 67 }), std::vector<int>({ 40, 52, 71 }) })
+            {
+                std::vector<float> chord(static_cast<size_t>(testSpectrumSize), 0.0f);
+                for (int note : chordNotes)
+                {
+                    auto spectrum = makeHarmonicSpectrum(note);
+                    for (size_t i = 0; i < chord.size(); ++i)
+                        chord[i] += spectrum[i];
+                }
+                
+                auto prunedNotes = pruned.processSpectrum(chord.data(), testSpectrumSize);
+                auto fullNotes = full.processSpectrum(chord.data(), testSpectrumSize);
+                std::sort(prunedNotes.begin(), prunedNotes.end());
+                std::sort(fullNotes.begin(), fullNotes.end());
+                
+                expect(prunedNotes == chordNotes);
+                expect(prunedNotes == fullNotes);
+                expectLessThan(pruned.getNumScoredProfiles(), full.getNumScoredProfiles() / 2);
+            }
+        }
+        
+        beginTest("Note levels follow the input level");
+        {
+            PitchDetector detector(6);
+            detector.prepare(testSampleRate, testFFTSize);
+            detector.setDetectionEngine(PitchDetector::DetectionEngine::SparseActivations);
+            
+            for (int note = 40; note <= 80; ++note)
+            {
+                auto spectrum = makeHarmonicSpectrum(note);
+                detector.addProfile(note, spectrum.data(), testSpectrumSize);
+            }
+            
+            // A Hann-windowed sine of amplitude a peaks at a * fftSize / 4
+            const float fullScale = 0.25f * static_cast<float>(testFFTSize);
+            auto loud = makeHarmonicSpectrum(64, 0.1f * fullScale);
+            auto quiet = makeHarmonicSpectrum(64, 0.01f * fullScale);
+            NoteEvent events[PitchDetector::maxSupportedPolyphony];
+            
+            expectEquals(detector.processSpectrum(loud.data(), testSpectrumSize, events, PitchDetector::maxSupportedPolyphony), 1);
+            const float loudLevel = events[0].levelDb;
+            expectWithinAbsoluteError(loudLevel, -20.0f, 3.0f);
+            
+            // The quieter frame reuses the note through onset gating but is still re-measured
+            expectEquals(detector.processSpectrum(quiet.data(), testSpectrumSize, events, PitchDetector::maxSupportedPolyphony), 1);
+            expectWithinAbsoluteError(events[0].levelDb, loudLevel - 20.0f, 0.5f);
+            
+            // In a chord, each note gets its own level
+            auto chord = makeHarmonicSpectrum(48, 0.1f * fullScale);
+            const auto softNote = makeHarmonicSpectrum(55, 0.02f * fullScale);
+            for (size_t i = 0; i < chord.size(); ++i)
+                chord[i] += softNote[i];
+            
+            const int numEvents = detector.processSpectrum(chord.data(), testSpectrumSize, events,
+                                                           PitchDetector::maxSupportedPolyphony);
+            const auto* loudEvent = std::find_if(events, events + numEvents, [](const NoteEvent& e) { return e.midiNote == 48; });
+            const auto* softEvent = std::find_if(events, events + numEvents, [](const NoteEvent& e) { return e.midiNote == 55; });
+            expect(loudEvent != events + numEvents && softEvent != events + numEvents);
+            
+            if (loudEvent != events + numEvents && softEvent != events + numEvents)
+                expectGreaterThan(loudEvent->levelDb, softEvent->levelDb + 6.0f);
+        }
+        
+        beginTest("Note events carry tuning, onset position and string/fret");
+        {
+            PitchDetector detector(6);
+            detector.prepare(testSampleRate, testFFTSize);
+            
+            for (int note = 60; note <= 76; ++note)
+            {
+                auto spectrum = makeHarmonicSpectrum(note);
+                detector.addProfile(note, spectrum.data(), testSpectrumSize, 2, note - 55);
+            }
+            
+            // A4 played 20 cents sharp, with window-shaped peaks so the tuning can be interpolated
+            std::vector<float> sharp(static_cast<size_t>(testSpectrumSize), 0.0f);
+            const double frequency = 440.0 * std::pow(2.0, 20.0 / 1200.0);
+            const double binWidth = testSampleRate / testFFTSize;
+            
+            for (int harmonic = 1; harmonic <= 8; ++harmonic)
+            {
+                const double centre = frequency * harmonic / binWidth;
+                for (int bin = static_cast<int>(centre) - 3; bin <= static_cast<int>(centre) + 4; ++bin)
+                    sharp[static_cast<size_t>(bin)] += static_cast<float>(std::exp(-0.5 * (bin - centre) * (bin - centre)) / harmonic);
+            }
+            
+            const std::vector<float> silence(static_cast<size_t>(testSpectrumSize), 0.0f);
+            NoteEvent events[4];
+            
+            expectEquals(detector.processSpectrum(sharp.data(), testSpectrumSize, events, 4, 1000), 1);
+            expectEquals(events[0].midiNote, 69);
+            expectWithinAbsoluteError(events[0].cents, 20.0f, 5.0f);
+            expectWithinAbsoluteError(events[0].frequency, static_cast<float>(frequency), 1.5f);
+            expectEquals(events[0].guitarString, 2);
+            expectEquals(events[0].guitarFret, 14);
+            expectEquals(events[0].onsetSampleOffset, 0);
+            
+            // A sustained note reports how long ago it started
+            expectEquals(detector.processSpectrum(sharp.data(), testSpectrumSize, events, 4, 1512), 1);
+            expectEquals(events[0].onsetSampleOffset, -512);
+            
+            // After a gap it is a new note again
+            expectEquals(detector.processSpectrum(silence.data(), testSpectrumSize, events, 4, 2024), 0);
+            expectEquals(detector.processSpectrum(sharp.data(), testSpectrumSize, events, 4, 2536), 1);
+            expectEquals(events[0].onsetSampleOffset, 0);
+            
+            // Events beyond the buffer's capacity are dropped, not written
+            expectEquals(detector.processSpectrum(sharp.data(), testSpectrumSize, events, 0, 3048), 0);
+        }
+        
+        beginTest("Learning the same pitch on two strings keeps a template for each position");
+        {
+            PitchDetector detector(6);
+            detector.prepare(testSampleRate, testFFTSize);
+            detector.setDetectionEngine(PitchDetector::DetectionEngine::SparseActivations);
+            detector.setOnsetGatingEnabled(false);
+            
+            // E4 as the open high E string, and with a brighter tone at the fifth fret of the B string
+            auto openString = makeHarmonicSpectrum(64);
+            auto fretted = makeHarmonicSpectrum(64);
+            auto octave = makeHarmonicSpectrum(76);
+            for (size_t i = 0; i < fretted.size(); ++i)
+                fretted[i] += 2.0f * octave[i];
+            
+            auto learnAt = [&detector](int stringIndex, int fret, const std::vector<float>& spectrum) {
+                const int note = detector.setCurrentGuitarPosition(stringIndex, fret);
+                detector.setCurrentLearningNote(note);
+                detector.setLearningModeActive(true);
+                
+                for (int frame = 0; frame < 20; ++frame)
+                    detector.processSpectrum(spectrum.data(), testSpectrumSize);
+                
+                detector.setLearningModeActive(false);
+            };
+            
+            learnAt(5, 0, openString);
+            learnAt(4, 5, fretted);
+            expectEquals(detector.getNumProfiles(), 2);
+            
+            // Relearning a position replaces its own template only
+            learnAt(5, 0, openString);
+            expectEquals(detector.getNumProfiles(), 2);
+            
+            NoteEvent events[6];
+            expectEquals(detector.processSpectrum(openString.data(), testSpectrumSize, events, 6, 0), 1);
+            expectEquals(events[0].midiNote, 64);
+            expectEquals(events[0].guitarString, 5);
+            expectEquals(events[0].guitarFret, 0);
+            
+            expectGreaterOrEqual(detector.processSpectrum(fretted.data(), testSpectrumSize, events, 6, 512), 1);
+            expectEquals(events[0].midiNote, 64);
+            expectEquals(events[0].guitarString, 4);
+            expectEquals(events[0].guitarFret, 5);
+            
+            // A learning note the selected position doesn't play is stored without a position
+            detector.setCurrentGuitarPosition(0, 0);
+            detector.setCurrentLearningNote(67);
+            detector.setLearningModeActive(true);
+            
+            auto other = makeHarmonicSpectrum(67);
+            for (int frame = 0; frame < 20; ++frame)
+                detector.processSpectrum(other.data(), testSpectrumSize);
+            
+            detector.setLearningModeActive(false);
+            expectEquals(detector.getNumProfiles(), 3);
+            expectGreaterOrEqual(detector.processSpectrum(other.data(), testSpectrumSize, events, 6, 1024), 1);
+            expectEquals(events[0].midiNote, 67);
+            expectEquals(events[0].guitarString, -1);
+        }
+    }
+};
+
+static PitchDetectionTests pitchDetectionTests;
@@ -0,0 +1,295 @@
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "PluginProcessor.h"
+#include "utils/RealtimeSafety.h"
+#include <memory>
+#include <vector>
+
+/**
+ * Checks the audio-thread watchdog itself, then runs the processor's audio path
+ * under it: after prepareToPlay, no processBlock call may allocate, lock or block,
+ * with either detection engine, in direct or background analysis mode.
+ */
+class RealtimeSafetyTests : public juce::UnitTest
+{
+public:
+    RealtimeSafetyTests() : juce::UnitTest("Real-time Safety", "RealtimeSafety") {}
+    
+    void runTest() override
+    {
+        if (!RealtimeSafety::isEnabled())
+        {
+            logMessage("Built without POLYPHONIC_TRACKER_REALTIME_CHECKS; skipping");
+            return;
+        }
+        
+        beginTest("Allocations are only counted inside an audio callback");
+        {
+            RealtimeSafety::Report lastCallback, totals;
+            
+            // Outside a callback nothing is counted
+            heldAllocation = std::make_unique<std::vector<float>>(64);
+            heldAllocation.reset();
+            expect(!RealtimeSafety::isAudioThread());
+            
+            {
+                RealtimeSafety::ScopedAudioCallback callback(lastCallback, totals);
+                expect(RealtimeSafety::isAudioThread());
+                heldAllocation = std::make_unique<std::vector<float>>(64);
+            }
+            
+            expect(!RealtimeSafety::isAudioThread());
+            expectEquals(lastCallback.numAllocations, 2);
+            expectGreaterOrEqual(lastCallback.bytesAllocated, 64 * sizeof(float));
+            expectEquals(lastCallback.numDeallocations, 0);
+            
+            {
+                RealtimeSafety::ScopedAudioCallback callback(lastCallback, totals);
+                heldAllocation.reset();
+            }
+            
+            expectEquals(lastCallback.numAllocations, 0);
+            expectEquals(lastCallback.numDeallocations, 2);
+            
+            expectEquals(totals.numCallbacks, static_cast<juce::int64>(2));
+            expectEquals(totals.numUnsafeCallbacks, static_cast<juce::int64>(2));
+            expectEquals(totals.numAllocations, 2);
+            expectEquals(totals.numDeallocations, 2);
+        }
+        
+        beginTest("Locks and blocking calls are counted");
+        {
+            RealtimeSafety::Report lastCallback, totals;
+            RealtimeSafety::CheckedLock<juce::CriticalSection> lock;
+            
+            {
+                RealtimeSafety::ScopedAudioCallback callback(lastCallback, totals);
+                
+                if (lock.tryEnter())
+                    lock.exit();
+            }
+            
+            expect(lastCallback.isClean(), "tryEnter never blocks");
+            
+            {
+                RealtimeSafety::ScopedAudioCallback callback(lastCallback, totals);
+                const RealtimeSafety::CheckedLock<juce::CriticalSection>::ScopedLockType scopedLock(lock);
+                RealtimeSafety::noteBlockingCall("test");
+            }
+            
+            expectGreaterOrEqual(lastCallback.numLocks, 1);
+            expectEquals(lastCallback.numBlockingCalls, 1);
+            expectEquals(juce::String(lastCallback.lastViolation), juce::String("test"));
+            expectEquals(totals.numCallbacks, static_cast<juce::int64>(2));
+            expectEquals(totals.numUnsafeCallbacks, static_cast<juce::int64>(1));
+        }
+        
+        beginTest("Nested callbacks report once, to the outermost scope");
+        {
+            RealtimeSafety::Report outerLast, outerTotals, innerLast, innerTotals;
+            
+            {
+                RealtimeSafety::ScopedAudioCallback outer(outerLast, outerTotals);
+                
+                {
+                    RealtimeSafety::ScopedAudioCallback inner(innerLast, innerTotals);
+                    RealtimeSafety::noteBlockingCall("nested");
+                }
+                
+                expect(RealtimeSafety::isAudioThread());
+            }
+            
+            expectEquals(outerLast.numBlockingCalls, 1);
+            expectEquals(outerTotals.numCallbacks, static_cast<juce::int64>(1));
+            expectEquals(innerTotals.numCallbacks, static_cast<juce::int64>(0));
+        }
+        
+        // The processor starts a GUI timer, which needs a message manager
+        juce::ScopedJuceInitialiser_GUI juceInitialiser;
+        
+        // Each engine in direct and background mode, then the per-string analysers. The
+        // sparse engine is chosen before learning, so its first frames detect with freshly
+        // changed templates. Learning is checked too: it adds templates on the audio thread.
+        for (int setup = 0; setup < 6; ++setup)
+        {
+            const bool isSparse = setup >= 2;
+            const bool background = (setup & 1) != 0;
+            const bool hexaphonic = setup >= 4;
+            const auto engine = isSparse ? PitchDetector::DetectionEngine::SparseActivations
+                                         : PitchDetector::DetectionEngine::CosineSimilarity;
+            
+            beginTest(juce::String("processBlock neither allocates, locks nor blocks (")
+                      + (isSparse ? "sparse" : "cosine") + " engine, " + (background ? "background" : "direct") + " analysis"
+                      + (hexaphonic ? ", hexaphonic" : "") + ")");
+            
+            PolyphonicTrackerAudioProcessor processor;
+            processor.setBackgroundAnalysisEnabled(background);
+            processor.setHexaphonicModeEnabled(hexaphonic);
+            processor.setDetectionEngine(engine);
+            processor.prepareToPlay(sampleRate, blockSize);
+            processor.resetRealtimeSafetyReport();
+            learnProfiles(processor);
+            
+            // Two seconds of a chord starting and stopping, so notes are switched on and off
+            juce::AudioBuffer<float> recording(2, static_cast<int>(sampleRate * 2.0));
+            recording.clear();
+            
+            for (int note : { 60, 64, 67 })
+                addSine(recording, note, static_cast<int>(sampleRate * 0.25), static_cast<int>(sampleRate));
+            
+            recording.copyFrom(1, 0, recording, 0, 0, recording.getNumSamples());
+            
+            const int numNoteOns = play(processor, recording);
+            const auto& totals = processor.getRealtimeSafetyReport();
+            
+            expectGreaterOrEqual(numNoteOns, 1, "the chord should produce MIDI");
+            expectGreaterThan(totals.numCallbacks, static_cast<juce::int64>(0));
+            expectEquals(totals.numUnsafeCallbacks, static_cast<juce::int64>(0));
+            expectEquals(totals.numAllocations, 0);
+            expectEquals(totals.numDeallocations, 0);
+            expectEquals(totals.numLocks, 0);
+            expectEquals(totals.numBlockingCalls, 0);
+            
+            if (totals.lastViolation != nullptr)
+                logMessage(juce::String("Last violation: ") + totals.lastViolation);
+            
+            processor.releaseResources();
+        }
+        
+        beginTest("Templates learned in hexaphonic mode reach the string detectors");
+        {
+            for (bool background : { false, true })
+            {
+                PolyphonicTrackerAudioProcessor processor;
+                processor.setHexaphonicModeEnabled(true);
+                processor.setBackgroundAnalysisEnabled(background);
+                processor.setDetectionEngine(PitchDetector::DetectionEngine::SparseActivations);
+                processor.prepareToPlay(sampleRate, blockSize);
+                
+                // Learning runs through the main detector; the strings start out with no templates
+                learnProfiles(processor);
+                
+                juce::AudioBuffer<float> recording(2, static_cast<int>(sampleRate));
+                recording.clear();
+                addSine(recording, 60, static_cast<int>(sampleRate * 0.25), static_cast<int>(sampleRate * 0.5));
+                recording.copyFrom(1, 0, recording, 0, 0, recording.getNumSamples());
+                
+                expectGreaterOrEqual(play(processor, recording), 1, "the strings should detect the learned note");
+                
+                processor.releaseResources();
+            }
+        }
+        
+        beginTest("Changing the FFT size or overlap rebuilds the background scheduling");
+        {
+            PolyphonicTrackerAudioProcessor processor;
+            processor.setBackgroundAnalysisEnabled(true);
+            processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+            processor.prepareToPlay(sampleRate, blockSize);
+            
+            // Without latency compensation the reported latency is the scheduling delay: a hop and two blocks
+            auto getExpectedLatency = [&processor] {
+                return static_cast<int>(static_cast<float>(processor.getFFTSize()) * (1.0f - processor.getFFTOverlap())) + 2 * blockSize;
+            };
+            
+            expectEquals(processor.getLatencySamples(), getExpectedLatency());
+            
+            processor.setFFTSize(2048);
+            expectEquals(processor.getFFTSize(), 2048);
+            expectEquals(processor.getLatencySamples(), getExpectedLatency());
+            
+            // A new overlap changes the hop, so the delay follows it too
+            processor.setFFTOverlap(0.5f);
+            expectEquals(processor.getFFTOverlap(), 0.5f);
+            expectEquals(processor.getLatencySamples(), getExpectedLatency());
+            
+            // The rebuilt worker analyses at the new size without touching the audio thread's budget
+            learnProfiles(processor);
+            processor.resetRealtimeSafetyReport();
+            
+            juce::AudioBuffer<float> recording(2, static_cast<int>(sampleRate));
+            recording.clear();
+            
+            for (int note : { 60, 64, 67 })
+                addSine(recording, note, static_cast<int>(sampleRate * 0.25), static_cast<int>(sampleRate * 0.5));
+            
+            recording.copyFrom(1, 0, recording, 0, 0, recording.getNumSamples());
+            
+            expectGreaterOrEqual(play(processor, recording), 1, "the chord should produce MIDI");
+            expect(processor.getRealtimeSafetyReport().isClean());
+            
+            processor.releaseResources();
+        }
+    }
+
+private:
+    static constexpr double sampleRate = 44100.0;
+    static constexpr int blockSize = 256;
+    
+    std::unique_ptr<std::vector<float>> heldAllocation;
+    
+    static void addSine(juce::AudioBuffer<float>& buffer, int midiNote, int start, int length)
+    {
+        const double frequency = 440.0 * std::pow(2.0, (midiNote - 69) / 12.0);
+        auto* samples = buffer.getWritePointer(0);
+        
+        for (int i = 0; i < length; ++i)
+            samples[start + i] += 0.2f * static_cast<float>(std::sin(juce::MathConstants<double>::twoPi * frequency * i / sampleRate));
+    }
+    
+    /**
+     * Plays a recording through the processor block by block, the way a host would:
+     * the buffers are allocated once up front. In background mode each block is
+     * followed by a short pause so the worker keeps up, as it would at real-time rate.
+     * @return Number of note-ons produced
+     */
+    static int play(PolyphonicTrackerAudioProcessor& processor, const juce::AudioBuffer<float>& recording)
+    {
+        juce::AudioBuffer<float> block(2, blockSize);
+        juce::MidiBuffer midi;
+        midi.ensureSize(4096);
+        int numNoteOns = 0;
+        
+        for (int start = 0; start + blockSize <= recording.getNumSamples(); start += blockSize)
+        {
+            for (int channel = 0; channel < 2; ++channel)
+                block.copyFrom(channel, 0, recording, juce::jmin(channel, recording.getNumChannels() - 1), start, blockSize);
+            
+            processor.processBlock(block, midi);
+            
+            if (processor.isBackgroundAnalysisEnabled())
+                juce::Thread::sleep(2);
+            
+            for (const auto metadata : midi)
+                numNoteOns += metadata.getMessage().isNoteOn() ? 1 : 0;
+        }
+        
+        return numNoteOns;
+    }
+    
+    /**
+     * Learns a template for each note of the test chord
+     */
+    static void learnProfiles(PolyphonicTrackerAudioProcessor& processor)
+    {
+        const int gapLength = processor.getFFTSize();
+        const int noteLength = static_cast<int>(sampleRate * 0.5);
+        
+        for (int note : { 60, 64, 67 })
+        {
+            juce::AudioBuffer<float> noteAudio(1, noteLength + gapLength);
+            noteAudio.clear();
+            addSine(noteAudio, note, gapLength, noteLength);
+            
+            processor.setLearningModeActive(false);
+            play(processor, noteAudio);
+            
+            processor.setCurrentLearningNote(note);
+            processor.setLearningModeActive(true);
+            play(processor, noteAudio);
+        }
+        
+        processor.setLearningModeActive(false);
+    }
+};
+
+static RealtimeSafetyTests realtimeSafetyTests;
@@ -0,0 +1,96 @@
+#include <juce_core/juce_core.h>
+#include "utils/SpectrumFifo.h"
+#include <thread>
+
+class SpectrumFifoTests : public juce::UnitTest
+{
+public:
+    SpectrumFifoTests() : juce::UnitTest("SpectrumFifo", "Utilities") {}
+    
+    void runTest() override
+    {
+        beginTest("Reader gets the newest frame and older frames are replaced");
+        {
+            SpectrumFifo fifo(8);
+            float frame[8];
+            float pulled[8];
+            
+            expectEquals(fifo.pullLatest(pulled, 8), 0);
+            
+            // With no reader, each frame replaces the previous one instead of queueing
+            for (int i = 1; i <= 10; ++i)
+            {
+                std::fill(std::begin(frame), std::end(frame), static_cast<float>(i));
+                fifo.push(frame, 8);
+            }
+            
+            expectEquals(fifo.getNumDroppedFrames(), 9);
+            
+            expectEquals(fifo.pullLatest(pulled, 8), 8);
+            expectEquals(pulled[0], 10.0f);
+            expectEquals(fifo.pullLatest(pulled, 8), 0);
+            
+            // A reader that comes back later still starts at the newest frame
+            for (int i = 11; i <= 13; ++i)
+            {
+                std::fill(std::begin(frame), std::end(frame), static_cast<float>(i));
+                fifo.push(frame, 8);
+            }
+            
+            expectEquals(fifo.pullLatest(pulled, 8), 8);
+            expectEquals(pulled[0], 13.0f);
+            
+            // Oversized frames are truncated to the slot size
+            float large[16] = {};
+            fifo.push(large, 16);
+            expectEquals(fifo.pullLatest(pulled, 8), 8);
+            expectEquals(pulled[0], 0.0f);
+        }
+        
+        beginTest("Concurrent reader never sees a torn frame");
+        {
+            constexpr int frameSize = 2048;
+            constexpr int numFrames = 20000;
+            SpectrumFifo fifo(frameSize);
+            std::atomic<bool> finished { false };
+            
+            std::thread producer([&] {
+                std::vector<float> frame(static_cast<size_t>(frameSize));
+                for (int i = 1; i <= numFrames; ++i)
+                {
+                    std::fill(frame.begin(), frame.end(), static_cast<float>(i));
+                    fifo.push(frame.data(), frameSize);
+                }
+                finished = true;
+            });
+            
+            std::vector<float> pulled(static_cast<size_t>(frameSize));
+            float lastFrame = 0.0f;
+            bool consistent = true;
+            bool ordered = true;
+            
+            for (;;)
+            {
+                const bool producerFinished = finished;
+                
+                if (fifo.pullLatest(pulled.data(), frameSize) > 0)
+                {
+                    consistent = consistent && std::all_of(pulled.begin(), pulled.end(),
+                                                           [&](float v) { return v == pulled[0]; });
+                    ordered = ordered && pulled[0] > lastFrame;
+                    lastFrame = pulled[0];
+                }
+                else if (producerFinished)
+                {
+                    break;
+                }
+            }
+            
+            producer.join();
+            expect(consistent);
+            expect(ordered);
+        }
+    }
+};
+
+static SpectrumFifoTests spectrumFifoTests;
@@ -0,0 +1,175 @@
+#include <juce_core/juce_core.h>
+#include "utils/StageTimings.h"
+#include "dsp/FFTProcessor.h"
+#include "dsp/PitchDetector.h"
+#include "offline/OfflineTranscriber.h"
+#include "TestSignals.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+class StageTimingsTests : public juce::UnitTest
+{
+public:
+    StageTimingsTests() : juce::UnitTest("Stage Timings", "Performance") {}
+    
+    void runTest() override
+    {
+        using Stage = StageTimings::Stage;
+        
+        beginTest("Summaries follow the recorded durations");
+        {
+            StageTimings timings;
+            
+            for (int i = 0; i < 99; ++i)
+                timings.addDuration(Stage::fft, 1000);
+            
+            timings.addDuration(Stage::fft, 100000);
+            
+            const auto summary = timings.getSummary(Stage::fft);
+            expectEquals(summary.count, static_cast<juce::int64>(100));
+            expectWithinAbsoluteError(summary.minMicroseconds, 1.0, 1.0e-9);
+            expectWithinAbsoluteError(summary.maxMicroseconds, 100.0, 1.0e-9);
+            expectWithinAbsoluteError(summary.meanMicroseconds, 1.99, 1.0e-9);
+            
+            // 99 of the 100 runs took a microsecond; the p99 is that run's bucket edge
+            expectGreaterOrEqual(summary.p99Microseconds, 1.0);
+            expectLessOrEqual(summary.p99Microseconds, 1.25);
+            
+            // Stages are independent
+            expectEquals(timings.getSummary(Stage::magnitude).count, static_cast<juce::int64>(0));
+            expectEquals(timings.getSummary(Stage::magnitude).p99Microseconds, 0.0);
+            
+            // One more slow run moves the p99 into the tail, capped at the maximum
+            timings.addDuration(Stage::fft, 100000);
+            expectWithinAbsoluteError(timings.getSummary(Stage::fft).p99Microseconds, 100.0, 1.0e-9);
+        }
+        
+        beginTest("The p99 is accurate to the bucket width");
+        {
+            StageTimings timings;
+            juce::Random random(7);
+            std::vector<juce::int64> durations;
+            
+            for (int i = 0; i < 5000; ++i)
+            {
+                const auto nanoseconds = static_cast<juce::int64>(1000.0 * std::pow(1000.0, random.nextDouble()));
+                durations.push_back(nanoseconds);
+                timings.addDuration(Stage::templateMatching, nanoseconds);
+            }
+            
+            std::sort(durations.begin(), durations.end());
+            const double exact = 1.0e-3 * static_cast<double>(durations[durations.size() * 99 / 100 - 1]);
+            const double reported = timings.getSummary(Stage::templateMatching).p99Microseconds;
+            
+            expectGreaterOrEqual(reported, exact);
+            expectLessOrEqual(reported, exact * 1.25);
+        }
+        
+        beginTest("Threads record into one instance without losing runs");
+        {
+            StageTimings timings;
+            std::vector<std::thread> threads;
+            
+            for (int t = 0; t < 4; ++t)
+                threads.emplace_back([&timings, t] {
+                    for (int i = 0; i < 10000; ++i)
+                        timings.addDuration(Stage::decision, 100 + t * 100 + i % 7);
+                });
+            
+            for (auto& thread : threads)
+                thread.join();
+            
+            const auto summary = timings.getSummary(Stage::decision);
+            expectEquals(summary.count, static_cast<juce::int64>(40000));
+            expectWithinAbsoluteError(summary.minMicroseconds, 0.1, 1.0e-9);
+            expectWithinAbsoluteError(summary.maxMicroseconds, 0.406, 1.0e-9);
+            
+            timings.reset();
+            expectEquals(timings.getSummary(Stage::decision).count, static_cast<juce::int64>(0));
+        }
+        
+        beginTest("A stopwatch records each lap against its stage");
+        {
+            StageTimings timings;
+            
+            StageTimings::Stopwatch stopwatch(&timings);
+            stopwatch.lap(Stage::windowing);
+            stopwatch.lap(Stage::fft);
+            stopwatch.lap(Stage::fft);
+            
+            expectEquals(timings.getSummary(Stage::windowing).count, static_cast<juce::int64>(1));
+            expectEquals(timings.getSummary(Stage::fft).count, static_cast<juce::int64>(2));
+            
+            // Without a StageTimings it does nothing
+            StageTimings::Stopwatch disabled(nullptr);
+            disabled.lap(Stage::fft);
+            expectEquals(timings.getSummary(Stage::fft).count, static_cast<juce::int64>(2));
+            
+            const auto dump = timings.toVar();
+            expect(dump.hasProperty("windowing"));
+            expect(dump.hasProperty("midiGeneration"));
+            expectEquals(static_cast<int>(dump["fft"]["count"]), 2);
+            expect(timings.toString().contains("windowing"));
+            expect(!timings.toString().contains("decision"));
+        }
+        
+        beginTest("The analysis chain times every frame's stages");
+        {
+            constexpr double sampleRate = 44100.0;
+            constexpr int fftSize = 2048;
+            
+            PitchDetector detector;
+            detector.prepare(sampleRate, fftSize);
+            detector.setOnsetGatingEnabled(false);
+            
+            const auto tone = TestSignals::renderSine(64, sampleRate, fftSize * 4);
+            detector.addProfile(64, TestSignals::captureSpectrum(tone, fftSize).data(), fftSize / 2);
+            
+            StageTimings timings;
+            FFTProcessor fft(fftSize);
+            fft.setOverlapFactor(0.5f);
+            fft.setStageTimings(&timings);
+            detector.setStageTimings(&timings);
+            
+            int numFrames = 0;
+            fft.setSpectrumDataCallback([&](const float* spectrum, int size, int) {
+                ++numFrames;
+                detector.processSpectrum(spectrum, size, nullptr, 0);
+            });
+            
+            fft.processBlock(tone.data(), static_cast<int>(tone.size()));
+            
+            const auto frames = static_cast<juce::int64>(numFrames);
+            expectGreaterThan(numFrames, 0);
+            
+            for (auto stage : { Stage::windowing, Stage::fft, Stage::magnitude, Stage::templateMatching, Stage::decision })
+                expectEquals(timings.getSummary(stage).count, frames, StageTimings::getStageName(stage));
+            
+            // Learning frames aren't detection work
+            detector.setCurrentLearningNote(64);
+            detector.setLearningModeActive(true);
+            fft.processBlock(tone.data(), static_cast<int>(tone.size()));
+            expectEquals(timings.getSummary(Stage::decision).count, frames);
+            expectGreaterThan(timings.getSummary(Stage::fft).count, frames);
+            
+            // The offline transcriber adds the MIDI generation (and mixdown for stereo files)
+            StageTimings offlineTimings;
+            OfflineTranscriber::Settings settings;
+            settings.fftSize = fftSize;
+            
+            OfflineTranscriber transcriber(detector, settings);
+            transcriber.setStageTimings(&offlineTimings);
+            
+            juce::AudioBuffer<float> recording(1, static_cast<int>(tone.size()));
+            recording.copyFrom(0, 0, tone.data(), static_cast<int>(tone.size()));
+            juce::MidiMessageSequence sequence;
+            transcriber.transcribe(recording, sampleRate, sequence);
+            
+            expectGreaterThan(offlineTimings.getSummary(Stage::midiGeneration).count, static_cast<juce::int64>(0));
+            expectGreaterThan(offlineTimings.getSummary(Stage::templateMatching).count, static_cast<juce::int64>(0));
+        }
+    }
+};
+
+static StageTimingsTests stageTimingsTests;
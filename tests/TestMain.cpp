@@ -0,0 +1,17 @@
+#include <juce_core/juce_core.h>
+
+int main(int argc, char* argv[])
+{
+    juce::ignoreUnused(argc, argv);
+    
+    juce::UnitTestRunner runner;
+    runner.setAssertOnFailure(false);
+    runner.runAllTests();
+    
+    // Report failure to CTest if any test failed
+    int failures = 0;
+    for (int i = 0; i < runner.getNumResults(); ++i)
+        failures += runner.getResult(i)->failures;
+    
+    return failures > 0 ? 1 : 0;
+}
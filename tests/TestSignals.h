@@ -0,0 +1,44 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include "dsp/FFTProcessor.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/**
+ * Synthetic signals shared by the unit tests.
+ */
+namespace TestSignals
+{
+    /** Renders a sine at the pitch of a MIDI note, at half scale. */
+    inline std::vector<float> renderSine(int midiNote, double sampleRate, int numSamples)
+    {
+        const double frequency = 440.0 * std::pow(2.0, (midiNote - 69) / 12.0);
+        std::vector<float> samples(static_cast<size_t>(numSamples));
+        
+        for (int i = 0; i < numSamples; ++i)
+            samples[static_cast<size_t>(i)] = 0.5f * static_cast<float>(std::sin(juce::MathConstants<double>::twoPi * frequency * i / sampleRate));
+        
+        return samples;
+    }
+    
+    /** Runs samples through an FFTProcessor and returns the last magnitude spectrum. */
+    inline std::vector<float> captureSpectrum(const std::vector<float>& samples, int fftSize)
+    {
+        std::vector<float> spectrum(static_cast<size_t>(fftSize / 2));
+        FFTProcessor fft(fftSize);
+        fft.setSpectrumDataCallback([&spectrum](const float* data, int size, int) {
+            std::copy(data, data + size, spectrum.begin());
+        });
+        
+        fft.processBlock(samples.data(), static_cast<int>(samples.size()));
+        return spectrum;
+    }
+    
+    /** Spectrum of a sine at the pitch of a MIDI note, two frames long. */
+    inline std::vector<float> captureSpectrum(int midiNote, double sampleRate, int fftSize)
+    {
+        return captureSpectrum(renderSine(midiNote, sampleRate, fftSize * 2), fftSize);
+    }
+}
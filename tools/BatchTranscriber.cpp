@@ -0,0 +1,352 @@
+#include <juce_audio_formats/juce_audio_formats.h>
+#include "dsp/PitchDetector.h"
+#include "dsp/ProfileFile.h"
+#include "offline/OfflineTranscriber.h"
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+/**
+ * PolyphonicTrackerBatch transcribes recordings to Standard MIDI Files without a host.
+ *
+ * The profile is loaded once; every worker thread copies its templates into its own
+ * OfflineTranscriber and takes the next file from a shared index until none are left.
+ *
+ * Usage: PolyphonicTrackerBatch --profile <file> [options] <audio files or folders>...
+ */
+namespace
+{
+    struct Options
+    {
+        juce::File profile;
+        juce::File outputDirectory;         // Next to each recording if not set
+        juce::File timingsFile;             // Per-stage timings as JSON, if set
+        int numThreads = juce::SystemStats::getNumCpus();
+        int maxPolyphony = 6;
+        bool useSparseEngine = false;
+        bool fftSizeWasSet = false;
+        OfflineTranscriber::Settings settings;
+        juce::Array<juce::File> inputs;
+        juce::Array<juce::File> inputRoots; // Folder each input was found in; its path below it is kept under --output
+    };
+    
+    const char* const audioWildcard = "*.wav;*.aif;*.aiff;*.flac";
+    
+    void printUsage()
+    {
+        std::cout << "Usage: PolyphonicTrackerBatch --profile <file> [options] <audio files or folders>...\n"
+                     "\n"
+                     "Options:\n"
+                     "  --profile <file>        Instrument profile saved by the plugin (required)\n"
+                     "  --output <folder>       Where to write the .mid files, keeping each recording's path\n"
+                     "                          below the folder it was found in (default: next to each recording)\n"
+                     "  --threads <n>           Files transcribed at once (default: number of CPUs)\n"
+                     "  --fft <size>            FFT size (default: the profile's, or 4096)\n"
+                     "  --overlap <0-0.95>      Frame overlap (default: 0.75)\n"
+                     "  --note-on-ms <ms>       Time a note must be detected before its note-on (default: 50)\n"
+                     "  --note-off-ms <ms>      Time a note must be absent before its note-off (default: 100)\n"
+                     "  --velocity <1-127>      Fixed velocity instead of following the note levels\n"
+                     "  --channel <1-16>        MIDI channel (default: 1)\n"
+                     "  --polyphony <1-16>      Most notes detected at once (default: 6)\n"
+                     "  --sparse                Use the sparse decomposition engine\n"
+                     "  --timings <file.json>   Write the time spent in each analysis stage\n"
+                     "\n"
+                     "Folders are searched recursively for " << audioWildcard << " files.\n";
+    }
+    
+    juce::File getFileArgument(const juce::String& path)
+    {
+        return juce::File::getCurrentWorkingDirectory().getChildFile(path.unquoted());
+    }
+    
+    bool parseOptions(const juce::StringArray& args, Options& options, juce::String& error)
+    {
+        for (int i = 0; i < args.size(); ++i)
+        {
+            const auto& arg = args[i];
+            
+            if (!arg.startsWith("--"))
+            {
+                const auto input = getFileArgument(arg);
+                
+                if (input.isDirectory())
+                {
+                    auto files = input.findChildFiles(juce::File::findFiles, true, audioWildcard);
+                    files.sort();
+                    
+                    for (const auto& file : files)
+                    {
+                        options.inputs.add(file);
+                        options.inputRoots.add(input);
+                    }
+                }
+                else if (input.existsAsFile())
+                {
+                    options.inputs.add(input);
+                    options.inputRoots.add(input.getParentDirectory());
+                }
+                else
+                {
+                    error = "No such file or folder: " + arg;
+                    return false;
+                }
+                
+                continue;
+            }
+            
+            if (arg == "--sparse")
+            {
+                options.useSparseEngine = true;
+                continue;
+            }
+            
+            if (i + 1 >= args.size())
+            {
+                error = "Missing value for " + arg;
+                return false;
+            }
+            
+            const auto value = args[++i];
+            
+            if (arg == "--profile")
+                options.profile = getFileArgument(value);
+            else if (arg == "--output")
+                options.outputDirectory = getFileArgument(value);
+            else if (arg == "--timings")
+                options.timingsFile = getFileArgument(value);
+            else if (arg == "--threads")
+                options.numThreads = juce::jlimit(1, 256, value.getIntValue());
+            else if (arg == "--fft")
+            {
+                options.settings.fftSize = value.getIntValue();
+                options.fftSizeWasSet = true;
+            }
+            else if (arg == "--overlap")
+                options.settings.overlapFactor = juce::jlimit(0.0f, 0.95f, value.getFloatValue());
+            else if (arg == "--note-on-ms")
+                options.settings.noteOnDelayMs = value.getIntValue();
+            else if (arg == "--note-off-ms")
+                options.settings.noteOffDelayMs = value.getIntValue();
+            else if (arg == "--velocity")
+            {
+                options.settings.midiVelocity = juce::jlimit(1, 127, value.getIntValue());
+                options.settings.velocityFromLevel = false;
+            }
+            else if (arg == "--channel")
+                options.settings.midiChannel = value.getIntValue();
+            else if (arg == "--polyphony")
+                options.maxPolyphony = value.getIntValue();
+            else
+            {
+                error = "Unknown option: " + arg;
+                return false;
+            }
+        }
+        
+        if (options.profile == juce::File())
+        {
+            error = "No profile given (--profile)";
+            return false;
+        }
+        
+        if (options.inputs.isEmpty())
+        {
+            error = "No recordings to transcribe";
+            return false;
+        }
+        
+        return true;
+    }
+    
+    /**
+     * Matches the analysis to the profile: linear-bin templates only fit spectra of the
+     * FFT size and sample rate they were learned with. Log-frequency templates and old
+     * files without a header fit any.
+     */
+    bool applyProfileFormat(Options& options, juce::String& error)
+    {
+        ProfileFile header;
+        
+        if (header.open(options.profile).failed()
+            || header.getBinLayout() != ProfileFile::BinLayout::LinearMagnitude)
+            return true;
+        
+        if (header.getFFTSize() > 0)
+        {
+            if (options.fftSizeWasSet && options.settings.fftSize != header.getFFTSize())
+            {
+                error = "The profile was learned with an FFT size of " + juce::String(header.getFFTSize());
+                return false;
+            }
+            
+            options.settings.fftSize = header.getFFTSize();
+        }
+        
+        options.settings.requiredSampleRate = header.getSampleRate();
+        return true;
+    }
+    
+    juce::File getOutputFile(const Options& options, int index)
+    {
+        const auto& input = options.inputs.getReference(index);
+        
+        if (options.outputDirectory == juce::File())
+            return input.withFileExtension("mid");
+        
+        // Recordings with the same name in different subfolders keep apart
+        const auto relativePath = input.getRelativePathFrom(options.inputRoots.getReference(index));
+        return options.outputDirectory.getChildFile(relativePath).withFileExtension("mid");
+    }
+    
+    /**
+     * Works out every output file before any thread starts, creating their folders.
+     * Fails if two recordings would be written to the same file (e.g. take.wav and
+     * take.flac, or the same name given from two folders).
+     */
+    bool prepareOutputFiles(const Options& options, juce::Array<juce::File>& outputs, juce::String& error)
+    {
+        std::map<juce::String, int> inputByOutput;
+        
+        for (int i = 0; i < options.inputs.size(); ++i)
+        {
+            const auto output = getOutputFile(options, i);
+            const auto inserted = inputByOutput.emplace(output.getFullPathName(), i);
+            
+            if (!inserted.second)
+            {
+                error = options.inputs.getReference(inserted.first->second).getFullPathName() + " and "
+                      + options.inputs.getReference(i).getFullPathName() + " would both be written to "
+                      + output.getFullPathName();
+                return false;
+            }
+            
+            if (!output.getParentDirectory().createDirectory())
+            {
+                error = "Could not create " + output.getParentDirectory().getFullPathName();
+                return false;
+            }
+            
+            outputs.add(output);
+        }
+        
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    juce::StringArray args;
+    for (int i = 1; i < argc; ++i)
+        args.add(juce::String::fromUTF8(argv[i]));
+    
+    if (args.isEmpty() || args.contains("--help") || args.contains("-h"))
+    {
+        printUsage();
+        return args.isEmpty() ? 1 : 0;
+    }
+    
+    Options options;
+    juce::String error;
+    
+    if (!parseOptions(args, options, error) || !applyProfileFormat(options, error))
+    {
+        std::cerr << error << "\n\n";
+        printUsage();
+        return 1;
+    }
+    
+    juce::Array<juce::File> outputs;
+    
+    if (!prepareOutputFiles(options, outputs, error))
+    {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    
+    // Loaded once; the workers only read it
+    PitchDetector templates(options.maxPolyphony);
+    
+    if (options.useSparseEngine)
+        templates.setDetectionEngine(PitchDetector::DetectionEngine::SparseActivations);
+    
+    if (!templates.loadInstrumentData(options.profile.getFullPathName()) || templates.getNumProfiles() == 0)
+    {
+        std::cerr << "Could not load the profile " << options.profile.getFullPathName() << "\n";
+        return 1;
+    }
+    
+    const int numFiles = options.inputs.size();
+    const int numThreads = juce::jmin(options.numThreads, numFiles);
+    
+    std::cout << "Transcribing " << numFiles << " file(s) with " << numThreads << " thread(s)\n";
+    
+    std::atomic<int> nextFile { 0 };
+    std::atomic<int> numFailed { 0 };
+    std::mutex outputLock;
+    double audioSeconds = 0.0;
+    StageTimings stageTimings;              // Shared by every transcriber; recording is lock-free
+    
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+    
+    {
+        juce::ThreadPool pool(numThreads);
+        
+        for (int t = 0; t < numThreads; ++t)
+        {
+            pool.addJob([&] {
+                OfflineTranscriber transcriber(templates, options.settings);
+                juce::AudioFormatManager formatManager;
+                
+                if (options.timingsFile != juce::File())
+                    transcriber.setStageTimings(&stageTimings);
+                
+                formatManager.registerBasicFormats();
+                
+                for (int index = nextFile++; index < numFiles; index = nextFile++)
+                {
+                    const auto& input = options.inputs.getReference(index);
+                    const auto& output = outputs.getReference(index);
+                    const auto result = transcriber.transcribeFile(input, output, formatManager);
+                    
+                    const std::lock_guard<std::mutex> lock(outputLock);
+                    
+                    if (result.wasOk())
+                    {
+                        audioSeconds += transcriber.getLastDurationSeconds();
+                        std::cout << "[" << index + 1 << "/" << numFiles << "] " << input.getFullPathName()
+                                  << " -> " << output.getFullPathName() << "\n";
+                    }
+                    else
+                    {
+                        ++numFailed;
+                        std::cerr << "[" << index + 1 << "/" << numFiles << "] " << input.getFullPathName()
+                                  << ": " << result.getErrorMessage() << "\n";
+                    }
+                }
+            });
+        }
+        
+        while (pool.getNumJobs() > 0)
+            juce::Thread::sleep(20);
+    }
+    
+    const double elapsedSeconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+    
+    std::cout << "Done: " << numFiles - numFailed.load() << " transcribed, " << numFailed.load() << " failed, "
+              << juce::String(audioSeconds, 1) << " s of audio in " << juce::String(elapsedSeconds, 1) << " s ("
+              << juce::String(audioSeconds / juce::jmax(elapsedSeconds, 0.001), 1) << "x real time)\n";
+    
+    if (options.timingsFile != juce::File())
+    {
+        std::cout << stageTimings.toString();
+        
+        if (!options.timingsFile.replaceWithText(juce::JSON::toString(stageTimings.toVar())))
+        {
+            std::cerr << "Could not write " << options.timingsFile.getFullPathName() << "\n";
+            return 1;
+        }
+    }
+    
+    return numFailed.load() == 0 ? 0 : 1;
+}